@@ -13,8 +13,10 @@ using sofa::simulation::SceneLoaderXML;
 using sofa::core::ExecParams;
 
 #include <ImageProcessing/camera/common/CameraSettings.h>
+#include <opencv2/calib3d.hpp>
 using sofacv::cam::CameraSettings;
 using sofa::defaulttype::Vec2i;
+using sofa::defaulttype::Vector2;
 using sofa::defaulttype::Vector3;
 using sofa::defaulttype::Matrix3;
 using sofa::defaulttype::Matrix4;
@@ -27,6 +29,9 @@ struct CameraSettings_test : public sofa::Sofa_test<>
   sofa::simulation::Node::SPtr root;
   CameraSettings::SPtr cam;
   Vector3 A, B, C, D, P;
+  // setGenericCamera()'s intrinsics, rotation and camera center
+  cv::Matx33d genericK, genericR;
+  cv::Vec3d genericT;
 
   CameraSettings_test() {}
 
@@ -67,6 +72,63 @@ struct CameraSettings_test : public sofa::Sofa_test<>
   }
 
   void TearDown() {}
+
+  /// a camera with a generic pose and intrinsics, looking along +z
+  void setGenericCamera()
+  {
+    cv::Rodrigues(cv::Vec3d(0.1, -0.2, 0.05), genericR);
+    genericK = cv::Matx33d(1100, 0, 650, 0, 1050, 370, 0, 0, 1);
+    genericT = cv::Vec3d(0.1, -0.05, -0.2);
+    Matrix3 r, k;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+      {
+        r[i][j] = genericR(i, j);
+        k[i][j] = genericK(i, j);
+      }
+    cam->setPosition(Vector3(genericT[0], genericT[1], genericT[2]), false);
+    cam->setRotationMatrix(r, false);
+    cam->setIntrinsicCameraMatrix(k, true);
+  }
+
+  /// n random 3D points in front of the generic camera
+  static std::vector<Vector3> randomPoints(size_t n)
+  {
+    cv::RNG rng(int(n));
+    std::vector<Vector3> pts(n);
+    for (Vector3& p : pts)
+      p = Vector3(rng.uniform(-1.0, 1.0), rng.uniform(-0.6, 0.6),
+                  rng.uniform(1.5, 4.0));
+    return pts;
+  }
+
+  /// batch sizes covering a single point, odd SIMD tails, several 256 point
+  /// chunks and several 4096 point blocks
+  static std::vector<size_t> batchSizes()
+  {
+    return std::vector<size_t>{1, 7, 257, 4097, 10001};
+  }
+
+  /// reads every representation, so that they are all recomposed right away
+  static void composeAll(const CameraSettings& c)
+  {
+    c.getIntrinsicCameraMatrix();
+    c.getProjectionMatrix();
+    c.getGLProjection();
+    c.getGLModelview();
+    c.getOrientation();
+    c.getCorners();
+  }
+
+  template <int L, int C>
+  static double maxDiff(const sofa::defaulttype::Mat<L, C, double>& a,
+                        const sofa::defaulttype::Mat<L, C, double>& b)
+  {
+    double d = 0;
+    for (int i = 0; i < L; ++i)
+      for (int j = 0; j < C; ++j) d = std::max(d, std::fabs(a[i][j] - b[i][j]));
+    return d;
+  }
 };
 
 TEST_F(CameraSettings_test, KRTBuild)
@@ -117,6 +179,227 @@ TEST_F(CameraSettings_test, KRTBuild)
 
 }
 
+TEST_F(CameraSettings_test, projectPoints)
+{
+  setGenericCamera();
+  for (size_t n : batchSizes())
+  {
+    const std::vector<Vector3> pts = randomPoints(n);
+    std::vector<Vector2> out(n);
+    cam->projectPoints(pts.data(), out.data(), n);
+
+    std::vector<double> x(n), y(n), z(n), u(n), v(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      x[i] = pts[i][0];
+      y[i] = pts[i][1];
+      z[i] = pts[i][2];
+    }
+    cam->projectPoints(x.data(), y.data(), z.data(), u.data(), v.data(), n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+      const Vector2 expected = cam->get2DFrom3DPosition(pts[i]);
+      EXPECT_LT((out[i] - expected).norm(), 1e-8) << n << " points, " << i;
+      EXPECT_LT((Vector2(u[i], v[i]) - expected).norm(), 1e-8)
+          << n << " points, " << i;
+    }
+  }
+}
+
+TEST_F(CameraSettings_test, unprojectPoints)
+{
+  setGenericCamera();
+  for (size_t n : batchSizes())
+  {
+    cv::RNG rng(int(n));
+    std::vector<Vector2> pts(n);
+    std::vector<double> u(n), v(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      pts[i] = Vector2(rng.uniform(0.0, 1280.0), rng.uniform(0.0, 720.0));
+      u[i] = pts[i][0];
+      v[i] = pts[i][1];
+    }
+
+    // on the image plane (fz = f), and at a given distance
+    for (double fz : {-1.0, 2.5})
+    {
+      std::vector<Vector3> out(n);
+      cam->unprojectPoints(pts.data(), out.data(), n, fz);
+      std::vector<double> x(n), y(n), z(n);
+      cam->unprojectPoints(u.data(), v.data(), x.data(), y.data(), z.data(),
+                           n, fz);
+
+      // closed form, independent from the batch code get3DFrom2DPosition()
+      // now relies on: R^T (K^-1 (u, v, 1) f) + t
+      const double f = (fz == -1) ? (cam->getFocalDistance()) : (fz);
+      const cv::Matx33d iK = genericK.inv();
+      for (size_t i = 0; i < n; ++i)
+      {
+        const cv::Vec3d w =
+            genericR.t() * (iK * cv::Vec3d(u[i], v[i], 1.0) * f) + genericT;
+        const Vector3 expected(w[0], w[1], w[2]);
+        EXPECT_LT((out[i] - expected).norm(), 1e-9) << n << " points, " << i;
+        EXPECT_LT((Vector3(x[i], y[i], z[i]) - expected).norm(), 1e-9)
+            << n << " points, " << i;
+        // round trip through the projection matrix
+        EXPECT_LT((cam->get2DFrom3DPosition(out[i]) - pts[i]).norm(), 1e-6)
+            << n << " points, " << i;
+      }
+    }
+  }
+}
+
+// EXACT distortion must follow OpenCV's model, with 5 and 8 coefficients
+TEST_F(CameraSettings_test, projectDistortedPoints)
+{
+  setGenericCamera();
+  const sofa::helper::vector<double> coefs[] = {
+      {-0.12, 0.03, 0.001, -0.0005, -0.004},
+      {-0.12, 0.03, 0.001, -0.0005, -0.004, 0.01, 0.002, 0.0005}};
+  const Matrix3& R = cam->getRotationMatrix();
+  const Matrix3& K = cam->getIntrinsicCameraMatrix();
+  const Vector3& t = cam->getPosition();
+  cv::Matx33d Rc, Kc;
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j)
+    {
+      Rc(i, j) = R[i][j];
+      Kc(i, j) = K[i][j];
+    }
+  // M = K [R | -R t]
+  cv::Vec3d rvec;
+  cv::Rodrigues(Rc, rvec);
+  const cv::Vec3d tvec = -(Rc * cv::Vec3d(t[0], t[1], t[2]));
+
+  for (const sofa::helper::vector<double>& d : coefs)
+  {
+    cam->setDistortionCoefficients(d);
+    for (size_t n : batchSizes())
+    {
+      const std::vector<Vector3> pts = randomPoints(n);
+      std::vector<Vector2> out(n);
+      cam->projectDistortedPoints(pts.data(), out.data(), n, false);
+
+      std::vector<cv::Point3d> obj(n);
+      for (size_t i = 0; i < n; ++i)
+        obj[i] = cv::Point3d(pts[i][0], pts[i][1], pts[i][2]);
+      std::vector<cv::Point2d> expected;
+      cv::projectPoints(obj, rvec, tvec, Kc, d, expected);
+
+      for (size_t i = 0; i < n; ++i)
+        EXPECT_LT((out[i] - Vector2(expected[i].x, expected[i].y)).norm(),
+                  1e-6)
+            << d.size() << " coefficients, " << n << " points, " << i;
+    }
+  }
+}
+
+// GRID distortion must stay within 0.02 pixel of EXACT in the image and its
+// margin, and fall back to EXACT out of the grid
+TEST_F(CameraSettings_test, projectDistortedPointsGrid)
+{
+  setGenericCamera();
+  cam->setDistortionCoefficients(
+      sofa::helper::vector<double>{-0.12, 0.03, 0.001, -0.0005, -0.004});
+
+  // points on a dense grid of pixels covering the image, its margin and
+  // beyond, unprojected at various depths
+  std::vector<Vector2> pixels;
+  for (double v = -400.0; v <= 1120.0; v += 3.7)
+    for (double u = -600.0; u <= 1880.0; u += 3.7)
+      pixels.push_back(Vector2(u, v));
+  const size_t n = pixels.size();
+  std::vector<Vector3> pts(n);
+  cam->unprojectPoints(pixels.data(), pts.data(), n, 2.0);
+  for (size_t i = 0; i < n; i += 3) pts[i] *= 1.5;
+
+  std::vector<Vector2> exact(n), grid(n), undistorted(n);
+  cam->projectDistortedPoints(pts.data(), exact.data(), n, false);
+  cam->projectDistortedPoints(pts.data(), grid.data(), n, true);
+  cam->projectPoints(pts.data(), undistorted.data(), n);
+
+  // the grid covers the image and a margin of 1/8th of its size around it,
+  // rounded up to whole 8 pixel cells: [-160, 1440[ x [-96, 816[
+  for (size_t i = 0; i < n; ++i)
+  {
+    const double u = undistorted[i][0], v = undistorted[i][1];
+    const bool inGrid = u >= -160.0 && u < 1440.0 && v >= -96.0 && v < 816.0;
+    EXPECT_LT((grid[i] - exact[i]).norm(), inGrid ? 0.02 : 1e-9)
+        << "pixel " << u << ", " << v;
+  }
+}
+
+// representations are only recomposed when read: after a sequence of setters
+// they must match those recomposed after each setter, and Data linked to them
+// must be up to date without any getter being called
+TEST_F(CameraSettings_test, lazyRepresentations)
+{
+  CameraSettings::SPtr ref = modeling::addNew<CameraSettings>(root);
+  ref->setName("ref");
+  ref->setImageSize(Vec2i(1280, 720), false);
+  ref->setFocalDistance(1.0);
+
+  sofa::Data<Mat3x4d> linkedM;
+  sofa::Data<Matrix4> linkedModelview;
+  linkedM.setParent(&cam->d_M);
+  linkedModelview.setParent(&cam->d_glModelview);
+
+  const Matrix3 K(Matrix3::Line(1100, 0, 650), Matrix3::Line(0, 1050, 370),
+                  Matrix3::Line(0, 0, 1));
+  cv::Matx33d cvR;
+  cv::Rodrigues(cv::Vec3d(-0.3, 0.1, 0.2), cvR);
+  Matrix3 R;
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j) R[i][j] = cvR(i, j);
+  const Vector3 t(0.3, 0.1, -0.5);
+
+  for (CameraSettings* c : {cam.get(), ref.get()})
+  {
+    const bool eager = (c == ref.get());
+    c->setIntrinsicCameraMatrix(K, true);
+    if (eager) composeAll(*c);
+    c->setPosition(Vector3(-0.2, 0.4, 0.1), true);
+    if (eager) composeAll(*c);
+    c->setRotationMatrix(R, true);
+    if (eager) composeAll(*c);
+    c->setGLZClip(Vector2(0.05, 50));
+    if (eager) composeAll(*c);
+    c->setFocalDistance(2.0);
+    if (eager) composeAll(*c);
+    c->setPosition(t, true);
+    if (eager) composeAll(*c);
+  }
+
+  // M = K [R | -R t]
+  Mat3x4d M;
+  const Vector3 Rt = R * t;
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int j = 0; j < 3; ++j) M[i][j] = R[i][j];
+    M[i][3] = -Rt[i];
+  }
+  M = K * M;
+
+  EXPECT_LT(maxDiff(M, ref->getProjectionMatrix()), 1e-9);
+  EXPECT_LT(maxDiff(linkedM.getValue(), ref->getProjectionMatrix()), 1e-9);
+  EXPECT_LT(maxDiff(linkedModelview.getValue(), ref->getGLModelview()), 1e-9);
+
+  EXPECT_LT(maxDiff(cam->getProjectionMatrix(), ref->getProjectionMatrix()),
+            1e-9);
+  EXPECT_LT(
+      maxDiff(cam->getIntrinsicCameraMatrix(), ref->getIntrinsicCameraMatrix()),
+      1e-9);
+  EXPECT_LT(maxDiff(cam->getGLProjection(), ref->getGLProjection()), 1e-9);
+  EXPECT_LT(maxDiff(cam->getGLModelview(), ref->getGLModelview()), 1e-9);
+  for (int i = 0; i < 4; ++i)
+    EXPECT_NEAR(ref->getOrientation()[i], cam->getOrientation()[i], 1e-9);
+  ASSERT_EQ(ref->getCorners().size(), cam->getCorners().size());
+  for (size_t i = 0; i < cam->getCorners().size(); ++i)
+    EXPECT_LT((ref->getCorners()[i] - cam->getCorners()[i]).norm(), 1e-9);
+}
+
 // TEST_F(CameraSettings_test, buildFromIntrinsicCamPosLookAtAndUpVector)
 //{
 //  this->cam->buildFromIntrinsicCamPosLookAtAndUpVector();
@@ -0,0 +1,81 @@
+#include <SceneCreator/SceneCreator.h>
+
+#include <SofaTest/Sofa_test.h>
+
+#include <SofaSimulationGraph/DAGSimulation.h>
+#include <sofa/simulation/Simulation.h>
+
+#include <ImageProcessing/camera/common/DisparityEngine.h>
+using sofacv::cam::DisparityEngine;
+
+#include <opencv2/imgproc.hpp>
+
+namespace sofa
+{
+struct DisparityEngine_test : public sofa::Sofa_test<>
+{
+  sofa::simulation::Node::SPtr root;
+  DisparityEngine::SPtr engine;
+  cv::Mat left, right;
+
+  void SetUp()
+  {
+    using modeling::addNew;
+    simulation::Simulation* simu;
+    sofa::simulation::setSimulation(
+        simu = new sofa::simulation::graph::DAGSimulation());
+    root = simu->createNewGraph("root");
+
+    engine = addNew<DisparityEngine>(root);
+    engine->setName("disparity");
+    sofa::simulation::getSimulation()->init(root.get());
+
+    // textured plane tilted along y: the disparity changes from row to row,
+    // and so across the band borders
+    cv::RNG rng(3);
+    cv::Mat noise(240, 320, CV_8U);
+    rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+    cv::GaussianBlur(noise, left, cv::Size(3, 3), 0.8);
+    cv::Mat mapX(left.size(), CV_32F), mapY(left.size(), CV_32F);
+    for (int y = 0; y < left.rows; ++y)
+      for (int x = 0; x < left.cols; ++x)
+      {
+        mapX.at<float>(y, x) = float(x) + 8.f + float(y) / 12.f;
+        mapY.at<float>(y, x) = float(y);
+      }
+    // right(x) = left(x + d)
+    cv::remap(left, right, mapX, mapY, cv::INTER_LINEAR, cv::BORDER_REFLECT);
+  }
+
+  void TearDown()
+  {
+    if (root) sofa::simulation::getSimulation()->unload(root);
+  }
+
+  cv::Mat disparity(int bands)
+  {
+    engine->d_bands.setValue(bands);
+    engine->d_img.setValue(left);
+    engine->d_img2.setValue(right);
+    engine->doUpdate();
+    return engine->d_disparity.getValue().clone();
+  }
+};
+
+// padded bands must give the same BM disparities as a single pass, including
+// the rows next to the band borders
+TEST_F(DisparityEngine_test, bmBands)
+{
+  engine->d_algorithm.beginEdit()->setSelectedItem("BM");
+  engine->d_algorithm.endEdit();
+
+  const cv::Mat single = disparity(1);
+  const cv::Mat banded = disparity(4);
+  ASSERT_EQ(single.size(), banded.size());
+  ASSERT_FALSE(single.empty());
+  EXPECT_EQ(0, cv::countNonZero(single != banded));
+  // the pair is actually matched
+  EXPECT_GT(cv::countNonZero(single >= 8.f), int(single.total()) / 2);
+}
+
+}  // namespace sofa
@@ -0,0 +1,221 @@
+#include <SceneCreator/SceneCreator.h>
+
+#include <SofaTest/Sofa_test.h>
+
+#include <SofaSimulationGraph/DAGSimulation.h>
+#include <sofa/simulation/Simulation.h>
+
+#include <ImageProcessing/camera/common/CameraSettings.h>
+#include <ImageProcessing/camera/common/StereoSettings.h>
+using sofacv::cam::CameraSettings;
+using sofacv::cam::StereoSettings;
+using sofa::defaulttype::Vec2i;
+using sofa::defaulttype::Vector2;
+using sofa::defaulttype::Vector3;
+using sofa::defaulttype::Matrix3;
+
+#include <cmath>
+
+namespace sofa
+{
+struct StereoSettings_test : public sofa::Sofa_test<>
+{
+  sofa::simulation::Node::SPtr root;
+  CameraSettings::SPtr cam1, cam2;
+  StereoSettings::SPtr stereo;
+
+  // 3D points in front of both cameras, and their projections
+  std::vector<Vector3> points;
+  std::vector<cv::Point2f> x1, x2;
+
+  void SetUp()
+  {
+    using modeling::addNew;
+    simulation::Simulation* simu;
+    sofa::simulation::setSimulation(
+        simu = new sofa::simulation::graph::DAGSimulation());
+    root = simu->createNewGraph("root");
+
+    const Matrix3 K(Matrix3::Line(1000, 0, 640), Matrix3::Line(0, 1000, 360),
+                    Matrix3::Line(0, 0, 1));
+
+    cam1 = addNew<CameraSettings>(root);
+    cam1->setName("cam1");
+    cam1->setImageSize(Vec2i(1280, 720), false);
+    cam1->setPosition(Vector3(0, 0, 0), false);
+    cam1->setRotationMatrix(Matrix3(Matrix3::Line(1, 0, 0),
+                                    Matrix3::Line(0, 1, 0),
+                                    Matrix3::Line(0, 0, 1)),
+                            false);
+    cam1->setIntrinsicCameraMatrix(K, true);
+
+    // second camera 20cm to the right, turned 10 degrees towards the first
+    // one's optical axis
+    const double a = -10.0 * M_PI / 180.0;
+    cam2 = addNew<CameraSettings>(root);
+    cam2->setName("cam2");
+    cam2->setImageSize(Vec2i(1280, 720), false);
+    cam2->setPosition(Vector3(0.2, 0, 0), false);
+    cam2->setRotationMatrix(
+        Matrix3(Matrix3::Line(std::cos(a), 0, std::sin(a)),
+                Matrix3::Line(0, 1, 0),
+                Matrix3::Line(-std::sin(a), 0, std::cos(a))),
+        false);
+    cam2->setIntrinsicCameraMatrix(K, true);
+
+    stereo = addNew<StereoSettings>(root);
+    stereo->setName("stereo");
+    stereo->findLink("cam1")->read("@cam1");
+    stereo->findLink("cam2")->read("@cam2");
+    sofa::simulation::getSimulation()->init(root.get());
+
+    for (int i = 0; i < 5; ++i)
+      for (int j = 0; j < 5; ++j)
+        for (int k = 0; k < 4; ++k)
+          points.push_back(
+              Vector3(-0.3 + 0.15 * i, -0.2 + 0.1 * j, 0.8 + 0.6 * k));
+    for (const Vector3& p : points)
+    {
+      const Vector2 p1 = cam1->get2DFrom3DPosition(p);
+      const Vector2 p2 = cam2->get2DFrom3DPosition(p);
+      x1.push_back(cv::Point2f(float(p1.x()), float(p1.y())));
+      x2.push_back(cv::Point2f(float(p2.x()), float(p2.y())));
+    }
+  }
+
+  void TearDown()
+  {
+    if (root) sofa::simulation::getSimulation()->unload(root);
+  }
+
+  /// angle between the 2 viewing rays of p, in degrees
+  static double parallax(const Vector3& p)
+  {
+    const Vector3 r1 = p - Vector3(0, 0, 0);
+    const Vector3 r2 = p - Vector3(0.2, 0, 0);
+    return std::acos(r1 * r2 / (r1.norm() * r2.norm())) * 180.0 / M_PI;
+  }
+};
+
+// single points, through the Vector2 and cv::Point2d overloads: x and y must
+// not be mixed up between the 2 views
+TEST_F(StereoSettings_test, triangulatePoint)
+{
+  for (size_t i = 0; i < points.size(); ++i)
+  {
+    const Vector2 p1(x1[i].x, x1[i].y), p2(x2[i].x, x2[i].y);
+    // float pixel coordinates: a few 1e-4 pixels of rounding error
+    EXPECT_LT((stereo->triangulate(p1, p2) - points[i]).norm(), 1e-4);
+    EXPECT_LT((stereo->triangulate(cv::Point2d(x1[i]), cv::Point2d(x2[i])) -
+               points[i])
+                  .norm(),
+              1e-4);
+  }
+}
+
+TEST_F(StereoSettings_test, triangulateBatch)
+{
+  const size_t n = points.size();
+  std::vector<Vector3> w(n), wParallel(n);
+  std::vector<double> errors(n), angles(n);
+  std::vector<unsigned char> valid(n);
+  stereo->triangulate(x1.data(), x2.data(), w.data(), n, errors.data(),
+                      angles.data(), valid.data(), false);
+  stereo->triangulate(x1.data(), x2.data(), wParallel.data(), n, true);
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    EXPECT_LT((w[i] - points[i]).norm(), 1e-4) << "point " << i;
+    EXPECT_EQ(w[i], wParallel[i]) << "point " << i;
+    EXPECT_LT(errors[i], 1e-3) << "point " << i;
+    EXPECT_NEAR(parallax(points[i]), angles[i], 1e-3) << "point " << i;
+    EXPECT_EQ(1, valid[i]) << "point " << i;
+  }
+}
+
+// noisy matches and points behind the cameras
+TEST_F(StereoSettings_test, triangulateQuality)
+{
+  cv::RNG rng(42);
+  std::vector<cv::Point2f> n1(x1), n2(x2);
+  for (size_t i = 0; i < n1.size(); ++i)
+  {
+    n1[i] += cv::Point2f(float(rng.gaussian(0.5)), float(rng.gaussian(0.5)));
+    n2[i] += cv::Point2f(float(rng.gaussian(0.5)), float(rng.gaussian(0.5)));
+  }
+  const Vector3 behind(0.1, 0.05, -2.0);
+  const Vector2 b1 = cam1->get2DFrom3DPosition(behind);
+  const Vector2 b2 = cam2->get2DFrom3DPosition(behind);
+  n1.push_back(cv::Point2f(float(b1.x()), float(b1.y())));
+  n2.push_back(cv::Point2f(float(b2.x()), float(b2.y())));
+
+  const size_t n = n1.size();
+  std::vector<Vector3> w(n);
+  std::vector<double> errors(n), angles(n);
+  std::vector<unsigned char> valid(n);
+  stereo->triangulate(n1.data(), n2.data(), w.data(), n, errors.data(),
+                      angles.data(), valid.data(), true);
+
+  for (size_t i = 0; i + 1 < n; ++i)
+  {
+    EXPECT_GT(errors[i], 0.0) << "point " << i;
+    EXPECT_LT(errors[i], 2.0) << "point " << i;
+    EXPECT_EQ(1, valid[i]) << "point " << i;
+  }
+  EXPECT_LT((w[n - 1] - behind).norm(), 1e-3);
+  EXPECT_EQ(0, valid[n - 1]);
+}
+
+// 5mm baseline: points 2 to 4m away are seen with a parallax of about 0.1
+// degree, and identical rays do not determine any point
+TEST_F(StereoSettings_test, smallBaseline)
+{
+  const Vector3 c2(0.005, 0, 0);
+  cam2->setPosition(c2, false);
+  cam2->setRotationMatrix(Matrix3(Matrix3::Line(1, 0, 0),
+                                  Matrix3::Line(0, 1, 0),
+                                  Matrix3::Line(0, 0, 1)),
+                          true);
+
+  std::vector<Vector3> far;
+  std::vector<Vector2> y1, y2;
+  std::vector<cv::Point2f> z1, z2;
+  for (int i = 0; i < 5; ++i)
+    for (int k = 0; k < 3; ++k)
+    {
+      far.push_back(Vector3(-0.4 + 0.2 * i, 0.1, 2.0 + k));
+      y1.push_back(cam1->get2DFrom3DPosition(far.back()));
+      y2.push_back(cam2->get2DFrom3DPosition(far.back()));
+      z1.push_back(cv::Point2f(float(y1.back().x()), float(y1.back().y())));
+      z2.push_back(cv::Point2f(float(y2.back().x()), float(y2.back().y())));
+    }
+  const size_t n = far.size();
+
+  // exact pixel coordinates: the solve itself must not lose accuracy
+  std::vector<Vector3> w(n);
+  stereo->triangulate(y1.data(), y2.data(), w.data(), n);
+  for (size_t i = 0; i < n; ++i)
+    EXPECT_LT((w[i] - far[i]).norm(), 1e-6) << "point " << i;
+
+  std::vector<double> errors(n), angles(n);
+  std::vector<unsigned char> valid(n);
+  stereo->triangulate(z1.data(), z2.data(), w.data(), n, errors.data(),
+                      angles.data(), valid.data());
+  for (size_t i = 0; i < n; ++i)
+  {
+    const Vector3 r1 = far[i], r2 = far[i] - c2;
+    const double parallax =
+        std::acos(r1 * r2 / (r1.norm() * r2.norm())) * 180.0 / M_PI;
+    EXPECT_NEAR(parallax, angles[i], 1e-3) << "point " << i;
+    EXPECT_LT(parallax, 0.15) << "point " << i;
+    EXPECT_EQ(1, valid[i]) << "point " << i;
+  }
+
+  // the same pixel in both views, with a camera moved onto the first one
+  cam2->setPosition(Vector3(0, 0, 0), true);
+  stereo->triangulate(z1.data(), z1.data(), w.data(), 1, errors.data(),
+                      angles.data(), valid.data());
+  EXPECT_EQ(0, valid[0]);
+}
+
+}  // namespace sofa
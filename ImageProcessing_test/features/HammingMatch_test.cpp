@@ -0,0 +1,128 @@
+#include <SofaTest/Sofa_test.h>
+
+#include <ImageProcessing/features/HammingKernels.h>
+#include <ImageProcessing/features/HammingMatch.h>
+using sofacv::features::hammingKnnMatch;
+namespace hamming = sofacv::features::hamming;
+
+#include <opencv2/core/utility.hpp>
+#include <opencv2/features2d.hpp>
+
+namespace sofa
+{
+struct HammingMatch_test : public sofa::Sofa_test<>
+{
+  cv::Mat query, train;
+
+  void makeDescriptors(int bytes)
+  {
+    cv::RNG rng(bytes);
+    query.create(200, bytes, CV_8U);
+    train.create(301, bytes, CV_8U);
+    rng.fill(query, cv::RNG::UNIFORM, 0, 256);
+    rng.fill(train, cv::RNG::UNIFORM, 0, 256);
+    // a few exact and near duplicates, so that small distances are tested
+    for (int i = 0; i < 20; ++i)
+    {
+      train.row(7 * i).copyTo(query.row(i));
+      query.at<uchar>(i, i % bytes) ^= uchar(1 << (i % 8));
+    }
+  }
+
+  /// compares to OpenCV's brute force matcher. Indices are only compared
+  /// where the distances leave no tie
+  void checkAgainstBF(const std::vector<std::vector<cv::DMatch> >& matches,
+                      int k)
+  {
+    std::vector<std::vector<cv::DMatch> > expected;
+    cv::BFMatcher(cv::NORM_HAMMING).knnMatch(query, train, expected, k);
+    ASSERT_EQ(expected.size(), matches.size());
+    for (size_t i = 0; i < matches.size(); ++i)
+    {
+      ASSERT_EQ(expected[i].size(), matches[i].size()) << "query " << i;
+      for (size_t j = 0; j < matches[i].size(); ++j)
+      {
+        EXPECT_EQ(int(i), matches[i][j].queryIdx);
+        EXPECT_EQ(expected[i][j].distance, matches[i][j].distance)
+            << "query " << i << ", neighbor " << j;
+      }
+      if (k == 1 || expected[i][0].distance < expected[i][1].distance)
+        EXPECT_EQ(expected[i][0].trainIdx, matches[i][0].trainIdx)
+            << "query " << i;
+    }
+  }
+
+  /// runs a kernel directly, on zero-padded copies of the descriptors
+  void runKernel(hamming::KnnKernel kernel, std::vector<hamming::Top2>& best)
+  {
+    const int words = (query.cols + 7) / 8;
+    cv::Mat q = cv::Mat::zeros(query.rows, words * 8, CV_8U);
+    cv::Mat t = cv::Mat::zeros(train.rows, words * 8, CV_8U);
+    query.copyTo(q.colRange(0, query.cols));
+    train.copyTo(t.colRange(0, train.cols));
+    hamming::DescriptorSet qs = {q.data, q.step, q.rows, words};
+    hamming::DescriptorSet ts = {t.data, t.step, t.rows, words};
+    best.resize(size_t(query.rows));
+    kernel(qs, 0, query.rows, ts, best.data());
+  }
+
+  void checkKernels(int bytes)
+  {
+    makeDescriptors(bytes);
+
+    for (int k = 1; k <= 2; ++k)
+    {
+      std::vector<std::vector<cv::DMatch> > matches;
+      hammingKnnMatch(query, train, matches, k);
+      checkAgainstBF(matches, k);
+      // chunked matching must give the same output
+      hammingKnnMatch(query, train, matches, k, 16);
+      checkAgainstBF(matches, k);
+    }
+
+    // every kernel this CPU supports must agree with the portable one, not
+    // only the one picked by hammingKnnMatch()
+    std::vector<hamming::Top2> expected, best;
+    runKernel(hamming::knnScalar, expected);
+#ifdef SOFACV_HAMMING_AVX2
+    if (cv::checkHardwareSupport(CV_CPU_AVX2) &&
+        cv::checkHardwareSupport(CV_CPU_POPCNT))
+    {
+      runKernel(hamming::knnAVX2, best);
+      for (size_t i = 0; i < best.size(); ++i)
+      {
+        EXPECT_EQ(expected[i].d1, best[i].d1) << "AVX2, query " << i;
+        EXPECT_EQ(expected[i].d2, best[i].d2) << "AVX2, query " << i;
+      }
+    }
+#endif  // SOFACV_HAMMING_AVX2
+#if defined(SOFACV_HAMMING_AVX512) && defined(CV_CPU_AVX_512VPOPCNTDQ)
+    if (cv::checkHardwareSupport(CV_CPU_AVX_512F) &&
+        cv::checkHardwareSupport(CV_CPU_AVX_512VPOPCNTDQ))
+    {
+      runKernel(hamming::knnAVX512, best);
+      for (size_t i = 0; i < best.size(); ++i)
+      {
+        EXPECT_EQ(expected[i].d1, best[i].d1) << "AVX512, query " << i;
+        EXPECT_EQ(expected[i].d2, best[i].d2) << "AVX512, query " << i;
+      }
+    }
+#endif  // SOFACV_HAMMING_AVX512 && CV_CPU_AVX_512VPOPCNTDQ
+  }
+};
+
+// ORB / BRIEF (32 bytes) and BRISK (64 bytes) sized descriptors
+TEST_F(HammingMatch_test, wholeWords)
+{
+  checkKernels(32);
+  checkKernels(64);
+}
+
+// AKAZE (61 bytes) and other descriptors padded to whole 64-bit words
+TEST_F(HammingMatch_test, paddedWords)
+{
+  checkKernels(61);
+  checkKernels(13);
+}
+
+}  // namespace sofa
@@ -0,0 +1,143 @@
+#include <SofaTest/Sofa_test.h>
+
+#include <ImageProcessing/features/RobustEstimator.h>
+using sofacv::features::RobustEstimator;
+
+#include <opencv2/calib3d.hpp>
+
+#include <numeric>
+
+namespace sofa
+{
+struct RobustEstimator_test : public sofa::Sofa_test<>
+{
+  std::vector<cv::Point2f> pts1, pts2;
+  std::vector<unsigned char> truth;  ///< ground truth inlier mask
+
+  static const double threshold;
+
+  static cv::Point2f randomPixel(cv::RNG& rng)
+  {
+    return cv::Point2f(rng.uniform(0.f, 1280.f), rng.uniform(0.f, 720.f));
+  }
+
+  /// squared Sampson distance of (a, b) to F
+  static double sampson(const cv::Matx33d& F, const cv::Point2f& a,
+                        const cv::Point2f& b)
+  {
+    const cv::Vec3d x1(a.x, a.y, 1), x2(b.x, b.y, 1);
+    const cv::Vec3d Fx1 = F * x1, Ftx2 = F.t() * x2;
+    const double num = x2.dot(Fx1);
+    return num * num / (Fx1[0] * Fx1[0] + Fx1[1] * Fx1[1] +
+                        Ftx2[0] * Ftx2[0] + Ftx2[1] * Ftx2[1]);
+  }
+
+  /// squared transfer distance of (a, b) to H
+  static double transfer(const cv::Matx33d& H, const cv::Point2f& a,
+                         const cv::Point2f& b)
+  {
+    const cv::Vec3d x = H * cv::Vec3d(a.x, a.y, 1);
+    const double dx = x[0] / x[2] - b.x, dy = x[1] / x[2] - b.y;
+    return dx * dx + dy * dy;
+  }
+
+  /// distance between 2 matrices up to scale (and sign)
+  static double scaledDistance(const cv::Matx33d& A, const cv::Matx33d& B)
+  {
+    const cv::Matx33d a = A * (1.0 / cv::norm(A));
+    const cv::Matx33d b = B * (1.0 / cv::norm(B));
+    return std::min(cv::norm(a - b), cv::norm(a + b));
+  }
+
+  /// replaces the second point of a random 'ratio' of the pairs by a random
+  /// pixel, far enough from 'model' not to be an inlier by chance
+  template <class Error>
+  void addOutliers(double ratio, const cv::Matx33d& model, Error error,
+                   cv::RNG& rng)
+  {
+    truth.assign(pts1.size(), 1);
+    std::vector<size_t> idx(pts1.size());
+    std::iota(idx.begin(), idx.end(), 0);
+    cv::randShuffle(idx, 1.0, &rng);
+    for (size_t k = 0; k < size_t(ratio * double(pts1.size())); ++k)
+    {
+      const size_t i = idx[k];
+      do
+        pts2[i] = randomPixel(rng);
+      while (error(model, pts1[i], pts2[i]) < 9.0 * threshold * threshold);
+      truth[i] = 0;
+    }
+  }
+
+  /// estimates the model sequentially and concurrently, and checks both
+  /// against the ground truth
+  void check(RobustEstimator::Model model, const cv::Matx33d& expected)
+  {
+    RobustEstimator estimator;
+    estimator.model = model;
+    estimator.threshold = threshold;
+
+    cv::Matx33d M;
+    std::vector<unsigned char> mask;
+    ASSERT_TRUE(estimator.estimate(pts1, pts2, M, mask));
+    EXPECT_LT(scaledDistance(expected, M), 1e-3);
+    ASSERT_EQ(truth.size(), mask.size());
+    for (size_t i = 0; i < mask.size(); ++i)
+      EXPECT_EQ(truth[i], mask[i]) << "pair " << i;
+
+    // batches are sampled sequentially: verifying them concurrently must
+    // give exactly the same result
+    estimator.parallel = true;
+    cv::Matx33d Mp;
+    std::vector<unsigned char> maskp;
+    ASSERT_TRUE(estimator.estimate(pts1, pts2, Mp, maskp));
+    for (int i = 0; i < 9; ++i) EXPECT_EQ(M.val[i], Mp.val[i]);
+    EXPECT_EQ(mask, maskp);
+  }
+};
+
+const double RobustEstimator_test::threshold = 1.0;
+
+// points of a 3D scene seen by 2 cameras, 30% outliers
+TEST_F(RobustEstimator_test, fundamental)
+{
+  const cv::Matx33d K(1000, 0, 640, 0, 1000, 360, 0, 0, 1);
+  cv::Matx33d R;
+  cv::Rodrigues(cv::Vec3d(0.05, -0.1, 0.02), R);
+  const cv::Vec3d t(-0.3, 0.02, 0.05);  // x2 = R x1 + t
+  const cv::Matx33d tx(0, -t[2], t[1], t[2], 0, -t[0], -t[1], t[0], 0);
+  const cv::Matx33d F = K.inv().t() * tx * R * K.inv();
+
+  cv::RNG rng(42);
+  for (int i = 0; i < 300; ++i)
+  {
+    const cv::Vec3d X(rng.uniform(-1.5, 1.5), rng.uniform(-1.0, 1.0),
+                      rng.uniform(3.0, 8.0));
+    const cv::Vec3d x1 = K * X, x2 = K * (R * X + t);
+    pts1.push_back(cv::Point2f(float(x1[0] / x1[2]), float(x1[1] / x1[2])));
+    pts2.push_back(cv::Point2f(float(x2[0] / x2[2]), float(x2[1] / x2[2])));
+  }
+  addOutliers(0.3, F, sampson, rng);
+
+  check(RobustEstimator::FUNDAMENTAL, F);
+}
+
+// planar scene, 50% outliers
+TEST_F(RobustEstimator_test, homography)
+{
+  const cv::Matx33d H(1.1, 0.05, 20, -0.03, 0.95, -15, 1e-4, -5e-5, 1);
+
+  cv::RNG rng(7);
+  for (int i = 0; i < 300; ++i)
+  {
+    const cv::Point2f a = randomPixel(rng);
+    const cv::Vec3d x = H * cv::Vec3d(a.x, a.y, 1);
+    pts1.push_back(a);
+    pts2.push_back(cv::Point2f(float(x[0] / x[2]), float(x[1] / x[2])));
+  }
+  addOutliers(0.5, H, transfer, rng);
+
+  check(RobustEstimator::HOMOGRAPHY, H);
+}
+
+}  // namespace sofa
@@ -1,4 +1,8 @@
 #include "CalibratedCamera.h"
+#include "utils/ReleaseIfShared.h"
+
+#include <algorithm>
+#include <cstring>
 
 namespace sofacv
 {
@@ -28,9 +32,16 @@ CalibratedCamera::CalibratedCamera()
           "displays the camera's reference frame and projection cone")),
       d_captureFrame(initData(&d_captureFrame, false, "captureFrame",
                               "captures the camera frame")),
+      d_pboCount(initData(&d_pboCount, 2, "pboCount",
+                          "number of pixel buffer objects the frames are "
+                          "captured through asynchronously (the captured "
+                          "frame lags pboCount - 1 frames behind). 0 reads "
+                          "frames synchronously")),
       d_img(initData(&d_img, "img_out", "The captured camera frame"))
 {
   m_storeMatrices = false;
+  m_pboIndex = 0;
+  m_pendingReads = 0;
 }
 
 void CalibratedCamera::init()
@@ -147,21 +158,9 @@ void CalibratedCamera::preDrawScene(sofa::core::visual::VisualParams *vparams)
 void CalibratedCamera::postDrawScene(sofa::core::visual::VisualParams *)
 {
   if (d_captureFrame.getValue())
-  {
-    GLint viewport[4];
-    glGetIntegerv(GL_VIEWPORT, viewport);
-
-    cvMat &img = *d_img.beginEdit();
-    img.release();
-    img = cvMat(viewport[3], viewport[2], CV_8UC3);
-
-    glReadBuffer(GL_FRONT);
-    glPixelStorei(GL_PACK_ALIGNMENT, 1);
-    glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3], GL_RGB,
-                 GL_UNSIGNED_BYTE, img.data);
-    glReadBuffer(GL_BACK);
-    d_img.endEdit();
-  }
+    captureFrame();
+  else
+    m_pendingReads = 0;  // frames read before capture was disabled are stale
   if (!d_freeProj.getValue())
   {
     glMatrixMode(GL_PROJECTION);
@@ -174,6 +173,96 @@ void CalibratedCamera::postDrawScene(sofa::core::visual::VisualParams *)
   }
 }
 
+void CalibratedCamera::allocatePBOs(size_t count, size_t bytes)
+{
+  releasePBOs();
+  m_pbos.resize(count);
+  glGenBuffers(GLsizei(count), m_pbos.data());
+  for (GLuint pbo : m_pbos)
+  {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(bytes), nullptr,
+                 GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void CalibratedCamera::releasePBOs()
+{
+  if (!m_pbos.empty()) glDeleteBuffers(GLsizei(m_pbos.size()), m_pbos.data());
+  m_pbos.clear();
+  m_pboIndex = 0;
+  m_pendingReads = 0;
+}
+
+void CalibratedCamera::cleanup() { releasePBOs(); }
+
+void CalibratedCamera::captureFrame()
+{
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  if (viewport[2] <= 0 || viewport[3] <= 0) return;
+  const size_t bytes = size_t(viewport[2]) * size_t(viewport[3]) * 3;
+
+  // Reads the buffer that was just drawn: the back buffer of double-buffered
+  // windows, or the single / FBO color buffer of offscreen contexts
+  GLint readBuffer, drawBuffer, packAlignment;
+  glGetIntegerv(GL_READ_BUFFER, &readBuffer);
+  glGetIntegerv(GL_DRAW_BUFFER, &drawBuffer);
+  glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+  glReadBuffer(GLenum(drawBuffer));
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+  const size_t pboCount = size_t(std::max(0, d_pboCount.getValue()));
+  static const bool hasPBO =
+      sofa::helper::gl::CanUseGlExtension("GL_ARB_pixel_buffer_object");
+  const uchar *frame = nullptr;
+  if (hasPBO && pboCount > 0)
+  {
+    const cv::Size size(viewport[2], viewport[3]);
+    if (m_pbos.size() != pboCount || size != m_readSize)
+      allocatePBOs(pboCount, bytes);
+    m_readSize = size;
+
+    // queues the read back of this frame...
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[m_pboIndex]);
+    glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3], GL_RGB,
+                 GL_UNSIGNED_BYTE, nullptr);
+    m_pboIndex = (m_pboIndex + 1) % pboCount;
+    ++m_pendingReads;
+
+    // ...and maps the oldest one once the ring is full: its transfer was
+    // queued pboCount - 1 frames ago and should be complete by now
+    if (m_pendingReads == pboCount)
+    {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[m_pboIndex]);
+      frame = static_cast<const uchar *>(
+          glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+      --m_pendingReads;
+    }
+  }
+  else if (!m_pbos.empty())
+    releasePBOs();
+
+  if (frame || m_pbos.empty())
+  {
+    cvMat &img = *d_img.beginWriteOnly();
+    utils::releaseIfShared(img);
+    img.create(viewport[3], viewport[2], CV_8UC3);
+    if (frame)
+      std::memcpy(img.data, frame, bytes);
+    else
+      glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3], GL_RGB,
+                   GL_UNSIGNED_BYTE, img.data);
+    d_img.endEdit();
+  }
+  if (frame) glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  if (!m_pbos.empty()) glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+  glReadBuffer(GLenum(readBuffer));
+}
+
 void CalibratedCamera::handleEvent(sofa::core::objectmodel::Event *e)
 {
   if (sofa::core::objectmodel::KeyreleasedEvent::checkEventType(e))
@@ -27,6 +27,13 @@ namespace cam
  *
  * This component gets / sets OpenGL parameters from / to a linked
  * CameraSettings component, and modifies the OpenGL view in SOFA
+ *
+ * If captureFrame is set, the rendered view is read back into img_out after
+ * each draw. Read backs are asynchronous: each frame is read into the next
+ * pixel buffer object (PBO) of a ring, and the oldest one is mapped once the
+ * ring is full, so the GPU never stalls waiting for the copy. The captured
+ * frame is thus pboCount - 1 frames behind the rendered one. Without PBO
+ * support (or with pboCount = 0), frames are read synchronously.
  */
 class SOFA_IMAGEPROCESSING_API CalibratedCamera
     : public ImplicitDataEngine,
@@ -64,16 +71,31 @@ class SOFA_IMAGEPROCESSING_API CalibratedCamera
 
   void computeBBox(const sofa::core::ExecParams* params, bool) override;
 
+  /// Releases the pixel buffer objects
+  void cleanup() override;
+
   CamSettings l_cam;           ///< The linked CameraSettings component
   sofa::Data<bool> d_freeCam;  ///< locks / unlocks the modelview in OpenGL
   sofa::Data<bool>
       d_freeProj;  ///< set / unset CameraSettings intrinsic params in OpenGL
   sofa::Data<bool> d_drawGizmo;     ///< draws / hides the camera gizmo
   sofa::Data<bool> d_captureFrame;  ///< captures camera's viewport as cvMat
+  sofa::Data<int> d_pboCount;       ///< size of the capture PBO ring
   sofa::Data<cvMat> d_img;          ///< captured camera frame
 
  private:
+  /// reads the current viewport back into d_img
+  void captureFrame();
+  /// (re)allocates the PBO ring for frames of 'bytes' bytes
+  void allocatePBOs(size_t count, size_t bytes);
+  void releasePBOs();
+
   bool m_storeMatrices;
+
+  std::vector<GLuint> m_pbos;  ///< ring of pixel pack buffers
+  size_t m_pboIndex;           ///< PBO the next frame is read into
+  size_t m_pendingReads;       ///< frames read into PBOs and not yet mapped
+  cv::Size m_readSize;         ///< size of the pending frames
 };
 
 }  // namespace cam
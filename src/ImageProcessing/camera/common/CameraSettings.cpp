@@ -1,7 +1,13 @@
 #include "CameraSettings.h"
+#include "utils/ParallelFor.h"
 #include <SofaCV/SofaCV.h>
 
 #include <SofaBaseVisual/BaseCamera.h>
+
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+#include <cmath>
 #include <iomanip>
 #include <limits>
 
@@ -21,7 +27,7 @@ int CameraSettingsClass =
 sofa::defaulttype::Vector2 CameraSettings::get2DFrom3DPosition(
     const Vector3& pt)
 {
-  const Mat3x4d& M = d_M.getValue();
+  const Mat3x4d& M = getProjectionMatrix();
   double rx = M[0][0] * pt[0] + M[0][1] * pt[1] + M[0][2] * pt[2] + M[0][3];
   double ry = M[1][0] * pt[0] + M[1][1] * pt[1] + M[1][2] * pt[2] + M[1][3];
   double rz = M[2][0] * pt[0] + M[2][1] * pt[1] + M[2][2] * pt[2] + M[2][3];
@@ -33,23 +39,394 @@ sofa::defaulttype::Vector3 CameraSettings::get3DFrom2DPosition(double x,
                                                                double y,
                                                                double f)
 {
-  Matrix3 K = d_K.getValue();
-  Matrix3 R = d_R.getValue();
-  Vector3 t = -R * d_t.getValue();
+  Vector3 w;
+  unprojectPoints(&x, &y, &w[0], &w[1], &w[2], 1, f);
+  return w;
+}
+
+sofa::defaulttype::Vector3 CameraSettings::get3DFrom2DPosition(const Vector2& p,
+                                                               double f)
+{
+  return get3DFrom2DPosition(p[0], p[1], f);
+}
+
+namespace
+{
+/// points processed per task by the batch projections
+const size_t kProjectionBlock = 4096;
+
+/// (u, v) = M.(x, y, z, 1), on 2 points per SIMD register
+void projectKernel(const cv::Matx34d& M, const double* x, const double* y,
+                   const double* z, double* u, double* v, size_t n)
+{
+  size_t i = 0;
+#if CV_SIMD128_64F
+  const cv::v_float64x2 m00 = cv::v_setall_f64(M(0, 0)),
+                        m01 = cv::v_setall_f64(M(0, 1)),
+                        m02 = cv::v_setall_f64(M(0, 2)),
+                        m03 = cv::v_setall_f64(M(0, 3)),
+                        m10 = cv::v_setall_f64(M(1, 0)),
+                        m11 = cv::v_setall_f64(M(1, 1)),
+                        m12 = cv::v_setall_f64(M(1, 2)),
+                        m13 = cv::v_setall_f64(M(1, 3)),
+                        m20 = cv::v_setall_f64(M(2, 0)),
+                        m21 = cv::v_setall_f64(M(2, 1)),
+                        m22 = cv::v_setall_f64(M(2, 2)),
+                        m23 = cv::v_setall_f64(M(2, 3)),
+                        one = cv::v_setall_f64(1.0);
+  for (; i + 2 <= n; i += 2)
+  {
+    const cv::v_float64x2 X = cv::v_load(x + i);
+    const cv::v_float64x2 Y = cv::v_load(y + i);
+    const cv::v_float64x2 Z = cv::v_load(z + i);
+    const cv::v_float64x2 iz = one / (m20 * X + m21 * Y + m22 * Z + m23);
+    cv::v_store(u + i, (m00 * X + m01 * Y + m02 * Z + m03) * iz);
+    cv::v_store(v + i, (m10 * X + m11 * Y + m12 * Z + m13) * iz);
+  }
+#endif  // CV_SIMD128_64F
+  for (; i < n; ++i)
+  {
+    const double iz =
+        1.0 / (M(2, 0) * x[i] + M(2, 1) * y[i] + M(2, 2) * z[i] + M(2, 3));
+    u[i] = (M(0, 0) * x[i] + M(0, 1) * y[i] + M(0, 2) * z[i] + M(0, 3)) * iz;
+    v[i] = (M(1, 0) * x[i] + M(1, 1) * y[i] + M(1, 2) * z[i] + M(1, 3)) * iz;
+  }
+}
+
+/// (x, y, z) = C + f.A.(u, v, 1), on 2 points per SIMD register
+void unprojectKernel(const cv::Matx33d& A, const cv::Vec3d& C, double f,
+                     const double* u, const double* v, double* x, double* y,
+                     double* z, size_t n)
+{
+  // f and C are folded into the matrix: (x, y, z) = B.(u, v, 1)
+  const cv::Matx33d B = A * f;
+  const cv::Vec3d c(B(0, 2) + C[0], B(1, 2) + C[1], B(2, 2) + C[2]);
+  size_t i = 0;
+#if CV_SIMD128_64F
+  const cv::v_float64x2 b00 = cv::v_setall_f64(B(0, 0)),
+                        b01 = cv::v_setall_f64(B(0, 1)),
+                        b10 = cv::v_setall_f64(B(1, 0)),
+                        b11 = cv::v_setall_f64(B(1, 1)),
+                        b20 = cv::v_setall_f64(B(2, 0)),
+                        b21 = cv::v_setall_f64(B(2, 1)),
+                        c0 = cv::v_setall_f64(c[0]),
+                        c1 = cv::v_setall_f64(c[1]),
+                        c2 = cv::v_setall_f64(c[2]);
+  for (; i + 2 <= n; i += 2)
+  {
+    const cv::v_float64x2 U = cv::v_load(u + i);
+    const cv::v_float64x2 V = cv::v_load(v + i);
+    cv::v_store(x + i, b00 * U + b01 * V + c0);
+    cv::v_store(y + i, b10 * U + b11 * V + c1);
+    cv::v_store(z + i, b20 * U + b21 * V + c2);
+  }
+#endif  // CV_SIMD128_64F
+  for (; i < n; ++i)
+  {
+    const double U = u[i], V = v[i];
+    x[i] = B(0, 0) * U + B(0, 1) * V + c[0];
+    y[i] = B(1, 0) * U + B(1, 1) * V + c[1];
+    z[i] = B(2, 0) * U + B(2, 1) * V + c[2];
+  }
+}
+
+/// distortion of the normalized coordinates (x, y) with OpenCV's model
+/// (radial, rational, tangential and thin prism terms), mapped to pixels by K
+void distortKernel(const double* k, const cv::Matx33d& K, const double* x,
+                   const double* y, double* u, double* v, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+  {
+    const double X = x[i], Y = y[i];
+    const double r2 = X * X + Y * Y, r4 = r2 * r2, r6 = r4 * r2;
+    const double radial = (1.0 + k[0] * r2 + k[1] * r4 + k[4] * r6) /
+                          (1.0 + k[5] * r2 + k[6] * r4 + k[7] * r6);
+    const double xd = X * radial + 2.0 * k[2] * X * Y +
+                      k[3] * (r2 + 2.0 * X * X) + k[8] * r2 + k[9] * r4;
+    const double yd = Y * radial + k[2] * (r2 + 2.0 * Y * Y) +
+                      2.0 * k[3] * X * Y + k[10] * r2 + k[11] * r4;
+    u[i] = K(0, 0) * xd + K(0, 1) * yd + K(0, 2);
+    v[i] = K(1, 1) * yd + K(1, 2);
+  }
+}
+
+/// spacing, in pixels, of the nodes of the distortion grid
+const double kDistortionGridStep = 8.0;
+
+/// replaces the undistorted pixel positions (u, v) by their distorted
+/// positions, bilinearly interpolated in the grid. Positions out of the grid
+/// are distorted exactly
+template <class Grid>
+void interpolateDistortion(const Grid& grid, const double* k,
+                           const cv::Matx33d& K, double* u, double* v,
+                           size_t n)
+{
+  const double step = 1.0 / kDistortionGridStep;
+  const size_t cols = size_t(grid.cols);
+  for (size_t i = 0; i < n; ++i)
+  {
+    const double gx = (u[i] - grid.x0) * step;
+    const double gy = (v[i] - grid.y0) * step;
+    if (gx >= 0.0 && gy >= 0.0 && gx < grid.cols - 1 && gy < grid.rows - 1)
+    {
+      const size_t ix = size_t(gx), iy = size_t(gy);
+      const double ax = gx - double(ix), ay = gy - double(iy);
+      const size_t n00 = iy * cols + ix;
+      const size_t n10 = n00 + cols;
+      u[i] = (1.0 - ay) * ((1.0 - ax) * grid.u[n00] + ax * grid.u[n00 + 1]) +
+             ay * ((1.0 - ax) * grid.u[n10] + ax * grid.u[n10 + 1]);
+      v[i] = (1.0 - ay) * ((1.0 - ax) * grid.v[n00] + ax * grid.v[n00 + 1]) +
+             ay * ((1.0 - ax) * grid.v[n10] + ax * grid.v[n10 + 1]);
+    }
+    else
+    {
+      const double y = (v[i] - K(1, 2)) / K(1, 1);
+      const double x = (u[i] - K(0, 2) - K(0, 1) * y) / K(0, 0);
+      distortKernel(k, K, &x, &y, &u[i], &v[i], 1);
+    }
+  }
+}
+
+/// distorted projection of the 3D points: P and E are the projection and
+/// world to camera matrices. Distortion is interpolated in 'grid' if not null
+template <class Grid>
+void projectDistortedKernel(const cv::Matx34d& P, const cv::Matx34d& E,
+                            const cv::Matx33d& K, const double* k,
+                            const Grid* grid, const double* x, const double* y,
+                            const double* z, double* u, double* v, size_t n)
+{
+  if (grid)
+  {
+    // undistorted pixel positions, then grid lookup
+    projectKernel(P, x, y, z, u, v, n);
+    interpolateDistortion(*grid, k, K, u, v, n);
+    return;
+  }
+  // normalized coordinates, then exact distortion
+  projectKernel(E, x, y, z, u, v, n);
+  distortKernel(k, K, u, v, u, v, n);
+}
+
+/// runs f(begin, end) over [0, n) in blocks of kProjectionBlock points,
+/// concurrently if there is more than one block
+template <class Function>
+void forEachBlock(size_t n, const Function& f)
+{
+  const int nBlocks = int((n + kProjectionBlock - 1) / kProjectionBlock);
+  if (nBlocks <= 1)
+  {
+    f(size_t(0), n);
+    return;
+  }
+  utils::parallelFor(cv::Range(0, nBlocks), [&](const cv::Range& range) {
+    for (int b = range.start; b < range.end; ++b)
+      f(size_t(b) * kProjectionBlock,
+        std::min(n, size_t(b + 1) * kProjectionBlock));
+  });
+}
+
+}  // namespace
 
+const CameraSettings::ProjectionCache& CameraSettings::projectionCache()
+{
+  refresh(REP_K | REP_M);
+  const Mat3x4d& M = d_M.getValue();
+  const Matrix3& K = d_K.getValue();
+  const Matrix3& R = d_R.getValue();
+  const Vector3& t = d_t.getValue();
+  const sofa::helper::vector<double>& distCoefs = d_distCoefs.getValue();
+  if (m_projection.valid && m_projection.M == M && m_projection.K == K &&
+      m_projection.R == R && m_projection.t == t &&
+      m_projection.distCoefs == distCoefs)
+    return m_projection;
+
+  m_projection.M = M;
+  m_projection.K = K;
+  m_projection.R = R;
+  m_projection.t = t;
+  m_projection.distCoefs = distCoefs;
   Matrix3 iK;
   iK.invert(K);
+  const Matrix3 A = R.transposed() * iK;
+  const Vector3 RC = R * t;
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int j = 0; j < 4; ++j) m_projection.P(i, j) = M[i][j];
+    for (int j = 0; j < 3; ++j)
+    {
+      m_projection.A(i, j) = A[i][j];
+      m_projection.E(i, j) = R[i][j];
+      m_projection.Kc(i, j) = K[i][j];
+    }
+    m_projection.E(i, 3) = -RC[i];
+    m_projection.C[i] = t[i];
+  }
+  m_projection.distorted = false;
+  for (size_t i = 0; i < 12; ++i)
+  {
+    m_projection.dist[i] = (i < distCoefs.size()) ? (distCoefs[i]) : (0.0);
+    if (m_projection.dist[i] != 0.0) m_projection.distorted = true;
+  }
+  m_projection.valid = true;
+  return m_projection;
+}
+
+void CameraSettings::projectPoints(const double* x, const double* y,
+                                   const double* z, double* u, double* v,
+                                   size_t n)
+{
+  const cv::Matx34d& P = projectionCache().P;
+  forEachBlock(n, [&](size_t begin, size_t end) {
+    projectKernel(P, x + begin, y + begin, z + begin, u + begin, v + begin,
+                  end - begin);
+  });
+}
 
-  Vector3 point3D =
-      iK * Vector3(x, y, 1) * ((f == -1) ? (d_f.getValue()) : (f));
+void CameraSettings::projectPoints(const Vector3* pts, Vector2* out, size_t n)
+{
+  const cv::Matx34d& P = projectionCache().P;
+  forEachBlock(n, [&](size_t begin, size_t end) {
+    // the points are deinterleaved into structure of arrays chunks that
+    // stay in L1, so that the kernel can load whole SIMD registers
+    const size_t kChunk = 256;
+    double x[kChunk], y[kChunk], z[kChunk], u[kChunk], v[kChunk];
+    for (size_t c = begin; c < end; c += kChunk)
+    {
+      const size_t m = std::min(kChunk, end - c);
+      for (size_t i = 0; i < m; ++i)
+      {
+        x[i] = pts[c + i][0];
+        y[i] = pts[c + i][1];
+        z[i] = pts[c + i][2];
+      }
+      projectKernel(P, x, y, z, u, v, m);
+      for (size_t i = 0; i < m; ++i) out[c + i] = Vector2(u[i], v[i]);
+    }
+  });
+}
 
-  return R.transposed() * (point3D - t);
+const CameraSettings::DistortionGrid& CameraSettings::distortionGrid(
+    const ProjectionCache& cache)
+{
+  DistortionGrid& grid = m_distortionGrid;
+  const Vec2i& imageSize = d_imageSize.getValue();
+  if (grid.valid && grid.K == cache.K && grid.distCoefs == cache.distCoefs &&
+      grid.imageSize == imageSize)
+    return grid;
+
+  grid.K = cache.K;
+  grid.distCoefs = cache.distCoefs;
+  grid.imageSize = imageSize;
+
+  // the grid covers the image and a margin of 1/8th of its size around it
+  const double w = imageSize.x(), h = imageSize.y();
+  grid.x0 = -std::ceil(w / 8.0 / kDistortionGridStep) * kDistortionGridStep;
+  grid.y0 = -std::ceil(h / 8.0 / kDistortionGridStep) * kDistortionGridStep;
+  grid.cols = int(std::ceil((w - 2.0 * grid.x0) / kDistortionGridStep)) + 1;
+  grid.rows = int(std::ceil((h - 2.0 * grid.y0) / kDistortionGridStep)) + 1;
+
+  const size_t cols = size_t(grid.cols);
+  grid.u.resize(cols * size_t(grid.rows));
+  grid.v.resize(grid.u.size());
+  std::vector<double> x(cols), y(cols);
+  const cv::Matx33d& K = cache.Kc;
+  for (int r = 0; r < grid.rows; ++r)
+  {
+    const double ny = (grid.y0 + r * kDistortionGridStep - K(1, 2)) / K(1, 1);
+    for (size_t c = 0; c < cols; ++c)
+    {
+      y[c] = ny;
+      x[c] = (grid.x0 + double(c) * kDistortionGridStep - K(0, 2) -
+              K(0, 1) * ny) /
+             K(0, 0);
+    }
+    distortKernel(cache.dist, K, x.data(), y.data(),
+                  grid.u.data() + size_t(r) * cols,
+                  grid.v.data() + size_t(r) * cols, cols);
+  }
+  grid.valid = true;
+  return grid;
 }
 
-sofa::defaulttype::Vector3 CameraSettings::get3DFrom2DPosition(const Vector2& p,
-                                                               double f)
+void CameraSettings::projectDistortedPoints(const double* x, const double* y,
+                                            const double* z, double* u,
+                                            double* v, size_t n, bool fast)
 {
-  return get3DFrom2DPosition(p[0], p[1], f);
+  const ProjectionCache& cache = projectionCache();
+  if (!cache.distorted)
+  {
+    projectPoints(x, y, z, u, v, n);
+    return;
+  }
+  const DistortionGrid* grid = (fast) ? (&distortionGrid(cache)) : (nullptr);
+  forEachBlock(n, [&](size_t begin, size_t end) {
+    projectDistortedKernel(cache.P, cache.E, cache.Kc, cache.dist, grid,
+                           x + begin, y + begin, z + begin, u + begin,
+                           v + begin, end - begin);
+  });
+}
+
+void CameraSettings::projectDistortedPoints(const Vector3* pts, Vector2* out,
+                                            size_t n, bool fast)
+{
+  const ProjectionCache& cache = projectionCache();
+  if (!cache.distorted)
+  {
+    projectPoints(pts, out, n);
+    return;
+  }
+  const DistortionGrid* grid = (fast) ? (&distortionGrid(cache)) : (nullptr);
+  forEachBlock(n, [&](size_t begin, size_t end) {
+    const size_t kChunk = 256;
+    double x[kChunk], y[kChunk], z[kChunk], u[kChunk], v[kChunk];
+    for (size_t c = begin; c < end; c += kChunk)
+    {
+      const size_t m = std::min(kChunk, end - c);
+      for (size_t i = 0; i < m; ++i)
+      {
+        x[i] = pts[c + i][0];
+        y[i] = pts[c + i][1];
+        z[i] = pts[c + i][2];
+      }
+      projectDistortedKernel(cache.P, cache.E, cache.Kc, cache.dist, grid, x,
+                             y, z, u, v, m);
+      for (size_t i = 0; i < m; ++i) out[c + i] = Vector2(u[i], v[i]);
+    }
+  });
+}
+
+void CameraSettings::unprojectPoints(const double* u, const double* v,
+                                     double* x, double* y, double* z,
+                                     size_t n, double fz)
+{
+  const ProjectionCache& cache = projectionCache();
+  const double f = (fz == -1) ? (d_f.getValue()) : (fz);
+  forEachBlock(n, [&](size_t begin, size_t end) {
+    unprojectKernel(cache.A, cache.C, f, u + begin, v + begin, x + begin,
+                    y + begin, z + begin, end - begin);
+  });
+}
+
+void CameraSettings::unprojectPoints(const Vector2* pts, Vector3* out,
+                                     size_t n, double fz)
+{
+  const ProjectionCache& cache = projectionCache();
+  const double f = (fz == -1) ? (d_f.getValue()) : (fz);
+  forEachBlock(n, [&](size_t begin, size_t end) {
+    const size_t kChunk = 256;
+    double u[kChunk], v[kChunk], x[kChunk], y[kChunk], z[kChunk];
+    for (size_t c = begin; c < end; c += kChunk)
+    {
+      const size_t m = std::min(kChunk, end - c);
+      for (size_t i = 0; i < m; ++i)
+      {
+        u[i] = pts[c + i][0];
+        v[i] = pts[c + i][1];
+      }
+      unprojectKernel(cache.A, cache.C, f, u, v, x, y, z, m);
+      for (size_t i = 0; i < m; ++i) out[c + i] = Vector3(x[i], y[i], z[i]);
+    }
+  });
 }
 
 void CameraSettings::getCornersPosition(Vector3& p1, Vector3& p2, Vector3& p3,
@@ -74,34 +451,34 @@ void CameraSettings::getCornersPosition(Vector3& p1, Vector3& p2, Vector3& p3,
 
 const sofa::defaulttype::Mat3x4d& CameraSettings::getProjectionMatrix() const
 {
+  refresh(REP_M);
   return d_M.getValue();
 }
 void CameraSettings::setProjectionMatrix(const Mat3x4d& M)
 {
   d_M.setValue(M);
   decomposeM();
-  composeCV();
-  composeGL();
-
-  recalculate3DCorners();
+  m_dirty &= ~REP_M;
+  invalidate(REP_K | REP_GL | REP_CORNERS);
 }
 
 const sofa::defaulttype::Matrix3& CameraSettings::getIntrinsicCameraMatrix()
     const
 {
+  refresh(REP_K);
   return d_K.getValue();
 }
 void CameraSettings::setIntrinsicCameraMatrix(const Matrix3& K, bool update)
 {
   d_K.setValue(K);
+  m_dirty &= ~REP_K;
   if (update)
   {
     decomposeCV();
-    composeM();
-    composeGL();
+    invalidate(REP_M | REP_GL);
   }
 
-  recalculate3DCorners();
+  invalidate(REP_CORNERS);
 }
 
 const sofa::helper::vector<double>& CameraSettings::getDistortionCoefficients()
@@ -116,7 +493,7 @@ void CameraSettings::setDistortionCoefficients(
   // OpenGL
   d_distCoefs.setValue(distCoefs);
 
-  recalculate3DCorners();
+  invalidate(REP_CORNERS);
 }
 
 const sofa::defaulttype::Matrix3& CameraSettings::getRotationMatrix() const
@@ -126,14 +503,9 @@ const sofa::defaulttype::Matrix3& CameraSettings::getRotationMatrix() const
 void CameraSettings::setRotationMatrix(const Matrix3& R, bool update)
 {
   d_R.setValue(R);
-  if (update)
-  {
-    //    decomposeCV();
-    composeM();
-    composeGL();
-  }
+  if (update) invalidate(REP_M | REP_GL);
 
-  recalculate3DCorners();
+  invalidate(REP_CORNERS);
 }
 
 const sofa::defaulttype::Vector3& CameraSettings::getPosition() const
@@ -143,14 +515,9 @@ const sofa::defaulttype::Vector3& CameraSettings::getPosition() const
 void CameraSettings::setPosition(const Vector3& t, bool update)
 {
   d_t.setValue(t);
-  if (update)
-  {
-    //    decomposeCV();
-    composeM();
-    composeGL();
-  }
+  if (update) invalidate(REP_M | REP_GL);
 
-  recalculate3DCorners();
+  invalidate(REP_CORNERS);
 }
 
 const sofa::defaulttype::Vec2i& CameraSettings::getImageSize() const
@@ -160,37 +527,34 @@ const sofa::defaulttype::Vec2i& CameraSettings::getImageSize() const
 void CameraSettings::setImageSize(const Vec2i& imgSize, bool update)
 {
   d_imageSize.setValue(imgSize);
-  if (update)
-  {
-    composeM();
-    composeGL();
-  }
+  if (update) invalidate(REP_M | REP_GL);
 
-  recalculate3DCorners();
+  invalidate(REP_CORNERS);
 }
 const sofa::defaulttype::Matrix4& CameraSettings::getGLProjection() const
 {
+  refresh(REP_GL);
   return d_glProjection.getValue();
 }
 void CameraSettings::setGLProjection(const Matrix4& glProjection)
 {
+  // the modelview matrix is decomposed along with the new projection
+  refresh(REP_GL);
   d_glProjection.setValue(glProjection);
   decomposeGL();
-  composeM();
-
-  recalculate3DCorners();
+  invalidate(REP_K | REP_M | REP_CORNERS);
 }
 const sofa::defaulttype::Matrix4& CameraSettings::getGLModelview() const
 {
+  refresh(REP_GL);
   return d_glModelview.getValue();
 }
 void CameraSettings::setGLModelview(const Matrix4& glModelview)
 {
+  refresh(REP_GL);
   d_glModelview.setValue(glModelview);
   decomposeGL();
-  composeM();
-
-  recalculate3DCorners();
+  invalidate(REP_K | REP_M | REP_CORNERS);
 }
 
 const sofa::defaulttype::Vec<4, int>& CameraSettings::getGLViewport() const
@@ -201,7 +565,7 @@ void CameraSettings::setGLViewport(const Vector4& glViewport)
 {
   d_glViewport.setValue(glViewport);
 
-  recalculate3DCorners();
+  invalidate(REP_CORNERS);
 }
 
 const sofa::defaulttype::Vector2& CameraSettings::getGLZClip() const
@@ -211,12 +575,11 @@ const sofa::defaulttype::Vector2& CameraSettings::getGLZClip() const
 void CameraSettings::setGLZClip(const Vector2& zClip)
 {
   d_zClip.setValue(zClip);
-  composeGL();
-
-  recalculate3DCorners();
+  invalidate(REP_GL | REP_CORNERS);
 }
 const sofa::defaulttype::Quat& CameraSettings::getOrientation() const
 {
+  refresh(REP_GL);
   return d_orientation.getValue();
 }
 void CameraSettings::setOrientation(const Quat& orientation)
@@ -225,10 +588,7 @@ void CameraSettings::setOrientation(const Quat& orientation)
   Matrix3 R;
   orientation.toMatrix(R);
   d_R.setValue(R);
-  composeM();
-  composeGL();
-
-  recalculate3DCorners();
+  invalidate(REP_M | REP_GL | REP_CORNERS);
 }
 
 const sofa::defaulttype::Matrix3& CameraSettings::get2DScaleMatrix() const
@@ -238,10 +598,7 @@ const sofa::defaulttype::Matrix3& CameraSettings::get2DScaleMatrix() const
 void CameraSettings::set2DScaleMatrix(const Matrix3& scale2D)
 {
   d_scale2D.setValue(scale2D);
-  composeM();
-  composeGL();
-
-  recalculate3DCorners();
+  invalidate(REP_K | REP_M | REP_GL | REP_CORNERS);
 }
 double CameraSettings::getFocalDistance() const { return d_f.getValue(); }
 void CameraSettings::setFocalDistance(double f)
@@ -249,7 +606,7 @@ void CameraSettings::setFocalDistance(double f)
   // No need to recompose, fz only used for projection operations
   d_f.setValue(f);
 
-  recalculate3DCorners();
+  invalidate(REP_CORNERS);
 }
 
 const sofa::defaulttype::Matrix3& CameraSettings::get2DTranslationMatrix() const
@@ -259,18 +616,68 @@ const sofa::defaulttype::Matrix3& CameraSettings::get2DTranslationMatrix() const
 void CameraSettings::set2DTranslationMatrix(const Matrix3& translation2D)
 {
   d_translate2D.setValue(translation2D);
-  composeM();
-  composeGL();
-
-  recalculate3DCorners();
+  invalidate(REP_K | REP_M | REP_GL | REP_CORNERS);
 }
 
 const sofa::helper::vector<sofa::defaulttype::Vector3>&
 CameraSettings::getCorners() const
 {
+  refresh(REP_CORNERS);
   return d_3DCorners.getValue();
 }
 
+void CameraSettings::invalidate(unsigned representations)
+{
+  m_dirty |= representations;
+  // engine outputs (the corners) are pulled through doUpdate() when read, but
+  // K, M and the OpenGL matrices are inputs too: Data linked to them would
+  // read stale values, so those are recomposed right away
+  unsigned linked = 0;
+  if (!d_K.getOutputs().empty()) linked |= REP_K;
+  if (!d_M.getOutputs().empty()) linked |= REP_M;
+  if (!d_glProjection.getOutputs().empty() ||
+      !d_glModelview.getOutputs().empty() ||
+      !d_orientation.getOutputs().empty())
+    linked |= REP_GL;
+  refresh(representations & linked);
+  setDirtyOutputs();
+}
+
+void CameraSettings::refresh(unsigned representations) const
+{
+  // M is composed from K, and the corners are unprojected with K and M
+  if (representations & REP_CORNERS) representations |= REP_M;
+  if (representations & REP_M) representations |= REP_K;
+  representations &= m_dirty;
+  if (!representations) return;
+
+  // the representations are logically const: rebuilding one only brings its
+  // Data values up to date with the other ones
+  CameraSettings* self = const_cast<CameraSettings*>(this);
+  // each flag is cleared before recomposing, as the compose functions read
+  // the representations they depend on through the getters
+  if (representations & REP_K)
+  {
+    m_dirty &= ~REP_K;
+    self->composeCV();
+  }
+  if (representations & REP_M)
+  {
+    m_dirty &= ~REP_M;
+    self->composeM();
+  }
+  if (representations & REP_GL)
+  {
+    m_dirty &= ~REP_GL;
+    self->composeGL();
+  }
+  if (representations & REP_CORNERS)
+  {
+    m_dirty &= ~REP_CORNERS;
+    self->recalculate3DCorners();
+  }
+}
+
 bool CameraSettings::isXRay() const { return d_isXRay.getValue(); }
 void CameraSettings::setXRay(bool isXray) { d_isXRay.setValue(isXray); }
 
@@ -489,7 +896,6 @@ void CameraSettings::composeCV()
 // Composes the Projection matrix P
 void CameraSettings::composeM()
 {
-  composeCV();
   Vector3 t = d_t.getValue();
   const Matrix3& R = d_R.getValue();
   const Matrix3& K = d_K.getValue();
@@ -505,52 +911,6 @@ void CameraSettings::composeM()
   Mat3x4d M = K * Rt;
 
   d_M.setValue(M);
-
-  std::string path = "poses.txt";
-  std::string opath = "%03d_test.png";
-  file.open(path.c_str(), std::ios_base::app);
-  double dvalue0, dvalue1, dvalue2, dvalue3, dvalue4, dvalue5, dvalue6;
-  // for (int k = 0; k < pcd.size(); k++)
-  // if ((index0-1)%3==0)
-  {
-    char buf4[FILENAME_MAX];
-    sprintf(buf4, opath.c_str(), (index0));
-    std::string filename4(buf4);
-    dvalue0 = t[0] / 100.0;
-    dvalue1 = t[1] / 100.0;
-    dvalue2 = t[2] / 100.0;
-    dvalue3 = (this->getOrientation())[0];
-    dvalue4 = (this->getOrientation())[1];
-    dvalue5 = (this->getOrientation())[2];
-    dvalue6 = (this->getOrientation())[3];
-
-    file << filename4;
-    file << " ";
-    file << dvalue0;
-    file << " ";
-    file << dvalue1;
-    file << " ";
-    file << dvalue2;
-    file << " ";
-    file << dvalue3;
-    file << " ";
-    file << dvalue4;
-    file << " ";
-    file << dvalue5;
-    file << " ";
-    file << dvalue6;
-    file << " ";
-    file << "\n";
-  }
-  std::cout << " index " << index0 << std::endl;
-  std::cout << " camera " << getIntrinsicCameraMatrix() << std::endl;
-  std::cout << " Rt " << Rt << std::endl;
-  std::cout << " R " << getRotationMatrix() << std::endl;
-  std::cout << " t " << getPosition() << std::endl;
-  std::cout << " image size " << d_imageSize.getValue().x() << " "
-            << d_imageSize.getValue().y() << std::endl;
-  index0++;
-  file.close();
 }
 
 void CameraSettings::recalculate3DCorners()
@@ -559,7 +919,7 @@ void CameraSettings::recalculate3DCorners()
   Vector3 p1, p2, p3, p4;
   this->getCornersPosition(p1, p2, p3, p4,
                            (d_f.getValue() != -1) ? (d_f.getValue()) : (1.0f));
-  sofa::helper::vector<Vector3>& corners3D = *d_3DCorners.beginEdit();
+  sofa::helper::vector<Vector3>& corners3D = *d_3DCorners.beginWriteOnly();
   corners3D.clear();
   corners3D.push_back(p1);
   corners3D.push_back(p2);
@@ -641,9 +1001,7 @@ void CameraSettings::buildFromCamPosAndImageCorners()
       Matrix3(Vector3(1, 0, u0), Vector3(0, 1, v0), Vector3(0, 0, 1));
   d_scale2D = Matrix3(Vector3(fu, 0, 0), Vector3(0, fv, 0), Vector3(0, 0, 1));
 
-  composeCV();
-  composeM();
-  composeGL();
+  invalidate(REP_K | REP_M | REP_GL);
 }
 
 CameraSettings::CameraSettings()
@@ -682,6 +1040,10 @@ CameraSettings::CameraSettings()
                         "whether or not the camera model is an XRay model as "
                         "opposite to the standard pinhole model"))
 {
+  m_dirty = 0;
+  m_projection.valid = false;
+  m_distortionGrid.valid = false;
+
   addAlias(&d_t, "t");
   addAlias(&d_3DCorners, "corners");
   addAlias(&d_3DCorners, "corners_out");
@@ -701,8 +1063,8 @@ void CameraSettings::buildFromIntrinsicCamPosLookAtAndUpVector()
   d_R.setValue(R);
 
   decomposeCV();
-  composeM();
-  composeGL();
+  m_dirty &= ~REP_K;
+  invalidate(REP_M | REP_GL | REP_CORNERS);
 }
 
 void CameraSettings::buildFromIntrinsicCamPosUpVectorAndFwdVector()
@@ -716,29 +1078,30 @@ void CameraSettings::buildFromIntrinsicCamPosUpVectorAndFwdVector()
   d_R.setValue(R);
 
   decomposeCV();
-  composeM();
-  composeGL();
+  m_dirty &= ~REP_K;
+  invalidate(REP_M | REP_GL | REP_CORNERS);
 }
 
 void CameraSettings::buildFromM()
 {
   decomposeM();
-  composeCV();
-  composeGL();
+  m_dirty &= ~REP_M;
+  invalidate(REP_K | REP_GL | REP_CORNERS);
 }
 
 void CameraSettings::buildFromKRT()
 {
   decomposeCV();
-  composeM();
-  composeGL();
-  sofa::defaulttype::Matrix3 rot;
-  sofa::defaulttype::Quat q = getOrientation();
-  q.toMatrix(rot);
+  m_dirty &= ~REP_K;
+  invalidate(REP_M | REP_GL | REP_CORNERS);
 
+  // the camera's orientation is R with its Y and Z axes flipped: its axes
+  // are read from R rather than from the OpenGL representation, which is
+  // only rebuilt when it is used
+  const Matrix3& R = getRotationMatrix();
   Vector3 camPos = getPosition();
-  Vector3 camera_Y = rot.line(1).normalized();
-  Vector3 camera_Z = rot.line(2).normalized();
+  Vector3 camera_Y = -R.line(1).normalized();
+  Vector3 camera_Z = -R.line(2).normalized();
   d_upVector.setValue(camera_Y);
   d_fwdVector.setValue(camera_Z);
   d_lookAt.setValue(camPos - (camera_Z * d_f.getValue()));
@@ -747,7 +1110,8 @@ void CameraSettings::buildFromKRT()
 void CameraSettings::buildFromOpenGL()
 {
   decomposeGL();
-  composeM();
+  m_dirty &= ~REP_GL;
+  invalidate(REP_K | REP_M | REP_CORNERS);
 }
 
 void CameraSettings::buildFromOpenGLContext()
@@ -794,7 +1158,7 @@ void CameraSettings::reinit()
   if (m_dataTracker.hasChanged(d_f)) FocalDistanceChanged();
 }
 
-void CameraSettings::doUpdate() {}
+void CameraSettings::doUpdate() { refresh(REP_ALL); }
 
 void CameraSettings::init()
 {
@@ -850,7 +1214,9 @@ void CameraSettings::init()
   {
     buildFromOpenGLContext();
   }
-  recalculate3DCorners();
+  // every representation is up to date once initialized
+  invalidate(REP_CORNERS);
+  refresh(REP_ALL);
 }
 
 }  // namespace cam
@@ -28,12 +28,16 @@ namespace cam
  * @brief The CameraSettings class
  *
  * This component holds the monoscopic camera parameters and maintain their
- * 4 different representations up-to-date at all time:
+ * 4 different representations up-to-date:
  * - OpenGL representation (4x4 modelview + projection matrix)
  * - "Vision" representation: (3x4 projection matrix M)
  * - "OpenCV" representation: (3x3 K, R, and vector t)
  * - "Decomposed" representation: 2D scale, skew and translation matrix,
  *    camera position, orientation etc.
+ * Setters only update the decomposed representation (R, t and the 2D
+ * matrices) and mark the others as out of date: M, K, the OpenGL matrices and
+ * the image plane's corners are recomposed once, when they are next read
+ * through their getter or the component's outputs.
  */
 class SOFA_IMAGEPROCESSING_API CameraSettings : public ImplicitDataEngine
 {
@@ -103,6 +107,31 @@ class SOFA_IMAGEPROCESSING_API CameraSettings : public ImplicitDataEngine
   /// returns the 3D position of a 2D point p
   Vector3 get3DFrom2DPosition(const Vector2& p, double fz = -1);
 
+  /// returns in (u[i], v[i]) the 2D pixel position of the 3D point
+  /// (x[i], y[i], z[i]). Points are processed in SIMD lanes, and in parallel
+  /// for large batches
+  void projectPoints(const double* x, const double* y, const double* z,
+                     double* u, double* v, size_t n);
+  /// returns in out[i] the 2D pixel position of pts[i]
+  void projectPoints(const Vector3* pts, Vector2* out, size_t n);
+  /// same as projectPoints, applying the lens distortion of d_distCoefs
+  /// (OpenCV's model, without the tilted sensor coefficients). If 'fast' is
+  /// set, the distortion is interpolated in a grid precomputed over the image
+  /// instead of being evaluated for each point
+  void projectDistortedPoints(const double* x, const double* y,
+                              const double* z, double* u, double* v, size_t n,
+                              bool fast = false);
+  /// returns in out[i] the distorted 2D pixel position of pts[i]
+  void projectDistortedPoints(const Vector3* pts, Vector2* out, size_t n,
+                              bool fast = false);
+  /// returns in (x[i], y[i], z[i]) the 3D position of the 2D point
+  /// (u[i], v[i]), at distance fz from the camera (f if -1)
+  void unprojectPoints(const double* u, const double* v, double* x, double* y,
+                       double* z, size_t n, double fz = -1);
+  /// returns in out[i] the 3D position of the 2D point pts[i]
+  void unprojectPoints(const Vector2* pts, Vector3* out, size_t n,
+                       double fz = -1);
+
   /// Returns the 3D corners of the image plane
   void getCornersPosition(Vector3& p1, Vector3& p2, Vector3& p3, Vector3& p4,
                           double fz = -1);
@@ -228,10 +257,25 @@ class SOFA_IMAGEPROCESSING_API CameraSettings : public ImplicitDataEngine
   sofa::Data<bool> d_isXRay;  ///< Whether or not this camera is an XRay
                               /// source-detector model (in which case,
 
-  int index0;
-  std::ofstream file;
-
  private:
+  /// representations recomposed from the decomposed one when read
+  enum Representation
+  {
+    REP_K = 1 << 0,
+    REP_M = 1 << 1,
+    REP_GL = 1 << 2,  ///< glProjection, glModelview and orientation
+    REP_CORNERS = 1 << 3,
+    REP_ALL = REP_K | REP_M | REP_GL | REP_CORNERS
+  };
+  /// marks representations as out of date, recomposing those linked to
+  /// other Data
+  void invalidate(unsigned representations);
+  /// recomposes the given representations if they are out of date
+  void refresh(unsigned representations) const;
+
+  mutable unsigned m_dirty;  ///< out of date representations
+
+
   /// Decomposes the global projection matrix
   void decomposeM();
   /// Decomposes OpenGL modelview and projection matrix
@@ -247,6 +291,44 @@ class SOFA_IMAGEPROCESSING_API CameraSettings : public ImplicitDataEngine
   /// decomposes the Intrinsic matrix
   void decomposeK(const Matrix3& K);
 
+  /// Matrices used by the projections, rebuilt when M, K, R or t change
+  struct ProjectionCache
+  {
+    Mat3x4d M;
+    Matrix3 K, R;
+    Vector3 t;
+    cv::Matx34d P;  ///< M
+    cv::Matx33d A;  ///< R^T.K^-1, direction of the ray through a pixel
+    cv::Vec3d C;    ///< optical center
+    cv::Matx34d E;  ///< [R | -R.C], world to camera coordinates
+    cv::Matx33d Kc;
+    sofa::helper::vector<double> distCoefs;
+    double dist[12];  ///< k1 k2 p1 p2 k3 k4 k5 k6 s1 s2 s3 s4, 0 if not set
+    bool distorted;   ///< whether any coefficient is not 0
+    bool valid;
+  };
+  /// returns the projection cache, refreshed if the camera moved
+  const ProjectionCache& projectionCache();
+
+  /// distorted pixel position of the nodes of a regular grid of undistorted
+  /// pixel positions covering the image
+  struct DistortionGrid
+  {
+    Matrix3 K;
+    sofa::helper::vector<double> distCoefs;
+    Vec2i imageSize;
+    std::vector<double> u, v;  ///< rows x cols distorted node positions
+    double x0, y0;             ///< undistorted position of node (0, 0)
+    int cols, rows;
+    bool valid;
+  };
+  /// returns the distortion grid, rebuilt if K, the distortion coefficients
+  /// or the image size changed
+  const DistortionGrid& distortionGrid(const ProjectionCache& cache);
+
+  ProjectionCache m_projection;
+  DistortionGrid m_distortionGrid;
+
  public:
   void ProjectionMatrixChanged();
   void IntrinsicCameraMatrixChanged();
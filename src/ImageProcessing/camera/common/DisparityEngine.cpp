@@ -0,0 +1,331 @@
+#include "DisparityEngine.h"
+#include "utils/ParallelFor.h"
+#include "utils/ReleaseIfShared.h"
+
+#include <sofa/core/ObjectFactory.h>
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace sofacv
+{
+namespace cam
+{
+SOFA_DECL_CLASS(DisparityEngine)
+
+int DisparityEngineClass =
+    sofa::core::RegisterObject(
+        "Disparity map and point cloud of a pair of rectified stereo frames "
+        "(block matching or semi-global block matching)")
+        .add<DisparityEngine>();
+
+DisparityEngine::DisparityEngine()
+    : l_cam(initLink("cam",
+                     "link to the StereoSettings component holding the two "
+                     "cameras' parameters, used to compute Q if not set")),
+      d_img2(initData(&d_img2, "img2", "second camera's rectified frame")),
+      d_Q(initData(&d_Q, "Q",
+                   "disparity-to-depth mapping matrix (e.g. StereoRectifier's "
+                   "Q output)")),
+      d_algorithm(initData(&d_algorithm, "algorithm",
+                           "stereo matching algorithm (BM, SGBM)")),
+      d_minDisparity(initData(&d_minDisparity, 0, "minDisparity",
+                              "minimum possible disparity value")),
+      d_numDisparities(initData(&d_numDisparities, 64, "numDisparities",
+                                "disparity search range, in pixels of the "
+                                "matched level (multiple of 16)")),
+      d_blockSize(initData(&d_blockSize, 9, "blockSize",
+                           "matched block size (odd, >= 5 for BM)")),
+      d_uniquenessRatio(initData(&d_uniquenessRatio, 10, "uniquenessRatio",
+                                 "margin in percent by which the best "
+                                 "disparity must win over the second best")),
+      d_speckleWindowSize(initData(&d_speckleWindowSize, 100,
+                                   "speckleWindowSize",
+                                   "max size of the disparity regions "
+                                   "considered as noise (0 to disable)")),
+      d_speckleRange(initData(&d_speckleRange, 2, "speckleRange",
+                              "max disparity variation within a connected "
+                              "region")),
+      d_roi(initData(&d_roi, "roi",
+                     "x, y, w, h of the region of the frames to match "
+                     "(whole frames if w or h is 0)")),
+      d_level(initData(&d_level, 0, "level",
+                       "number of times the frames are downsampled by 2 "
+                       "before matching")),
+      d_bands(initData(&d_bands, 0, "bands",
+                       "number of row bands matched concurrently (0: one per "
+                       "thread, 1: single pass)")),
+      d_disparity(initData(&d_disparity, "disparity",
+                           "disparity map, in pixels of the full resolution "
+                           "frames (values below minDisparity are invalid)",
+                           false, true)),
+      d_positions(initData(&d_positions, "positions",
+                           "3D positions of the valid disparities"))
+{
+  sofa::helper::OptionsGroup* t = d_algorithm.beginEdit();
+  t->setNames(2, "BM", "SGBM");
+  t->setSelectedItem("SGBM");
+  d_algorithm.endEdit();
+
+  addAlias(&d_disparity, "disparity_out");
+  addAlias(&d_positions, "positions_out");
+}
+
+void DisparityEngine::init()
+{
+  registerData(&d_algorithm);
+  registerData(&d_minDisparity, -128, 128, 1);
+  registerData(&d_numDisparities, 16, 512, 16);
+  registerData(&d_blockSize, 1, 51, 2);
+  registerData(&d_uniquenessRatio, 0, 100, 1);
+  registerData(&d_speckleWindowSize, 0, 500, 10);
+  registerData(&d_speckleRange, 0, 16, 1);
+  registerData(&d_level, 0, 4, 1);
+
+  addInput(&d_img2);
+  addInput(&d_Q);
+  addOutput(&d_disparity);
+  addOutput(&d_positions);
+  ImageFilter::init();
+}
+
+void DisparityEngine::updateMatchers(size_t nBands, bool sgbm, int channels)
+{
+  // speckles are filtered once on the whole map (see applyFilter)
+  const int numDisparities =
+      std::max(16, (d_numDisparities.getValue() + 15) / 16 * 16);
+  int blockSize = d_blockSize.getValue() | 1;
+
+  if (sgbm)
+  {
+    blockSize = std::max(1, blockSize);
+    while (m_sgbm.size() < nBands) m_sgbm.push_back(cv::StereoSGBM::create());
+    for (cv::Ptr<cv::StereoSGBM>& m : m_sgbm)
+    {
+      m->setMinDisparity(d_minDisparity.getValue());
+      m->setNumDisparities(numDisparities);
+      m->setBlockSize(blockSize);
+      m->setP1(8 * channels * blockSize * blockSize);
+      m->setP2(32 * channels * blockSize * blockSize);
+      m->setUniquenessRatio(d_uniquenessRatio.getValue());
+      m->setSpeckleWindowSize(0);
+      m->setMode(cv::StereoSGBM::MODE_SGBM_3WAY);
+    }
+  }
+  else
+  {
+    blockSize = std::max(5, blockSize);
+    while (m_bm.size() < nBands) m_bm.push_back(cv::StereoBM::create());
+    for (cv::Ptr<cv::StereoBM>& m : m_bm)
+    {
+      m->setMinDisparity(d_minDisparity.getValue());
+      m->setNumDisparities(numDisparities);
+      m->setBlockSize(blockSize);
+      m->setUniquenessRatio(d_uniquenessRatio.getValue());
+      m->setSpeckleWindowSize(0);
+    }
+  }
+}
+
+bool DisparityEngine::updateQ(const cv::Size& size)
+{
+  if (d_Q.isSet())
+  {
+    const Matrix4& Q = d_Q.getValue();
+    for (int i = 0; i < 4; ++i)
+      for (int j = 0; j < 4; ++j) m_Q(i, j) = Q[i][j];
+    return true;
+  }
+  if (!l_cam.get()) return false;
+
+  // same rectification as a StereoRectifier with default parameters,
+  // recomputed only when the cameras or the frame size change
+  CameraSettings& cam1 = l_cam->getCamera1();
+  CameraSettings& cam2 = l_cam->getCamera2();
+  if (size == m_QSize && cam1.getProjectionMatrix() == m_M1 &&
+      cam2.getProjectionMatrix() == m_M2 &&
+      cam1.getDistortionCoefficients() == m_distCoefs1 &&
+      cam2.getDistortionCoefficients() == m_distCoefs2)
+    return true;
+
+  m_M1 = cam1.getProjectionMatrix();
+  m_M2 = cam2.getProjectionMatrix();
+  m_distCoefs1 = cam1.getDistortionCoefficients();
+  m_distCoefs2 = cam2.getDistortionCoefficients();
+  m_QSize = size;
+
+  cv::Mat R1, R2, P1, P2, Q;
+  l_cam->stereoRectify(size, -1.0, true, R1, R2, P1, P2, Q);
+  m_Q = cv::Matx44d(Q);
+  return true;
+}
+
+void DisparityEngine::applyFilter(const cv::Mat& in, cv::Mat& out, bool)
+{
+  // the previous step's outputs are dropped first: nothing stale is
+  // published if these frames can't be matched, and the disparity buffer is
+  // then only shared with downstream holders
+  d_disparity.beginWriteOnly()->release();
+  d_disparity.endEdit();
+  for (std::vector<Vector3>& p : m_bandPoints) p.clear();
+
+  const cv::Mat& in2 = d_img2.getValue();
+  if (in.empty() || in2.empty()) return;
+  if (in.size() != in2.size() || in.type() != in2.type())
+  {
+    msg_error(getName() + "::update()")
+        << "Error: both frames must have the same size and type";
+    return;
+  }
+
+  const cv::Rect frame(0, 0, in.cols, in.rows);
+  cv::Rect roi = frame;
+  const sofa::defaulttype::Vec4i& r = d_roi.getValue();
+  if (r[2] > 0 && r[3] > 0) roi = cv::Rect(r[0], r[1], r[2], r[3]) & frame;
+  if (roi.area() == 0) return;
+
+  const bool sgbm = d_algorithm.getValue().getSelectedId() == 1;
+  const int level = std::max(0, std::min(d_level.getValue(), 4));
+
+  m_left = in(roi);
+  m_right = in2(roi);
+  for (int l = 0; l < level; ++l)
+  {
+    cv::pyrDown(m_left, m_left);
+    cv::pyrDown(m_right, m_right);
+  }
+  // BM only matches grayscale frames
+  if (!sgbm && m_left.channels() != 1)
+  {
+    cv::cvtColor(m_left, m_left, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(m_right, m_right, cv::COLOR_BGR2GRAY);
+  }
+  const int rows = m_left.rows;
+
+  // Each band is padded with 'margin' rows on both sides, so that the
+  // matching windows of its border rows are the same as in a single pass.
+  // BM's prefilter reads a few more rows around them: 1 for its default
+  // x-Sobel filter, preFilterSize / 2 for NORMALIZED_RESPONSE
+  const int blockSize = std::max(sgbm ? 1 : 5, d_blockSize.getValue() | 1);
+  int margin = std::max(2 * blockSize, 16);
+  if (!sgbm)
+  {
+    if (m_bm.empty()) m_bm.push_back(cv::StereoBM::create());
+    const cv::Ptr<cv::StereoBM>& bm = m_bm.front();
+    margin = blockSize / 2 +
+             ((bm->getPreFilterType() == cv::StereoBM::PREFILTER_XSOBEL)
+                  ? (1)
+                  : (bm->getPreFilterSize() / 2));
+  }
+  int nBands = (d_bands.getValue() > 0) ? (d_bands.getValue())
+                                        : (cv::getNumThreads());
+  nBands = std::max(1, std::min(nBands, rows / std::max(2 * margin, 16)));
+
+  updateMatchers(size_t(nBands), sgbm, m_left.channels());
+  m_bandDisparity.resize(size_t(nBands));
+  m_disparity16.create(m_left.size(), CV_16S);
+
+  utils::parallelFor(
+      cv::Range(0, nBands),
+      [&](const cv::Range& range) {
+        for (int b = range.start; b < range.end; ++b)
+        {
+          const int y0 = rows * b / nBands;
+          const int y1 = rows * (b + 1) / nBands;
+          const int a0 = std::max(0, y0 - margin);
+          const int a1 = std::min(rows, y1 + margin);
+          cv::Mat& disp = m_bandDisparity[size_t(b)];
+          if (sgbm)
+            m_sgbm[size_t(b)]->compute(m_left.rowRange(a0, a1),
+                                       m_right.rowRange(a0, a1), disp);
+          else
+            m_bm[size_t(b)]->compute(m_left.rowRange(a0, a1),
+                                     m_right.rowRange(a0, a1), disp);
+          disp.rowRange(y0 - a0, y1 - a0)
+              .copyTo(m_disparity16.rowRange(y0, y1));
+        }
+      },
+      nBands);
+
+  // Speckle regions may span several bands: they are only measured once the
+  // bands are assembled. Same parameters as the matchers' own filtering
+  // (SGBM's speckleRange is in disparity units, BM's in 1/16 pixels)
+  const int minDisparity = d_minDisparity.getValue();
+  if (d_speckleWindowSize.getValue() > 0)
+    cv::filterSpeckles(m_disparity16, (minDisparity - 1) * 16,
+                       d_speckleWindowSize.getValue(),
+                       sgbm ? (16 * d_speckleRange.getValue())
+                            : (d_speckleRange.getValue()),
+                       m_speckleBuffer);
+
+  // disparities are expressed in pixels of the full resolution frames
+  const double scale = double(1 << level);
+  utils::releaseIfShared(m_disparity);
+  m_disparity16.convertTo(m_disparity, CV_32F, scale / 16.0);
+  d_disparity.setValue(m_disparity);
+
+  const int numDisparities =
+      std::max(16, (d_numDisparities.getValue() + 15) / 16 * 16);
+  m_disparity16.convertTo(out, CV_8U, 255.0 / (numDisparities * 16),
+                          -255.0 * minDisparity / numDisparities);
+
+  m_bandPoints.resize(size_t(nBands));
+  if (!updateQ(in.size()))
+  {
+    for (std::vector<Vector3>& p : m_bandPoints) p.clear();
+    return;
+  }
+
+  // Reprojection of the valid disparities, band by band: Q maps the full
+  // resolution pixel (u, v) of disparity d to (X, Y, Z, W)
+  const cv::Matx44d& Q = m_Q;
+  const short minRaw = short(minDisparity * 16);
+  utils::parallelFor(
+      cv::Range(0, nBands),
+      [&](const cv::Range& range) {
+        for (int b = range.start; b < range.end; ++b)
+        {
+          std::vector<Vector3>& points = m_bandPoints[size_t(b)];
+          points.clear();
+          for (int y = rows * b / nBands; y < rows * (b + 1) / nBands; ++y)
+          {
+            const short* raw = m_disparity16.ptr<short>(y);
+            const float* d = m_disparity.ptr<float>(y);
+            const double v = roi.y + y * scale;
+            for (int x = 0; x < m_disparity16.cols; ++x)
+            {
+              if (raw[x] < minRaw) continue;
+              const double u = roi.x + x * scale;
+              const double W = Q(3, 0) * u + Q(3, 1) * v + Q(3, 2) * d[x] +
+                               Q(3, 3);
+              if (std::abs(W) < 1e-12) continue;
+              points.push_back(Vector3(
+                  (Q(0, 0) * u + Q(0, 1) * v + Q(0, 2) * d[x] + Q(0, 3)) / W,
+                  (Q(1, 0) * u + Q(1, 1) * v + Q(1, 2) * d[x] + Q(1, 3)) / W,
+                  (Q(2, 0) * u + Q(2, 1) * v + Q(2, 2) * d[x] + Q(2, 3)) /
+                      W));
+            }
+          }
+        }
+      },
+      nBands);
+}
+
+void DisparityEngine::doUpdate()
+{
+  ImageFilter::doUpdate();
+
+  size_t n = 0;
+  for (const std::vector<Vector3>& p : m_bandPoints) n += p.size();
+  sofa::helper::vector<Vector3>& positions = *d_positions.beginWriteOnly();
+  positions.clear();
+  positions.reserve(n);
+  for (const std::vector<Vector3>& p : m_bandPoints)
+    positions.insert(positions.end(), p.begin(), p.end());
+  d_positions.endEdit();
+}
+
+}  // namespace cam
+}  // namespace sofacv
@@ -0,0 +1,98 @@
+#ifndef SOFACV_CAM_DISPARITYENGINE_H
+#define SOFACV_CAM_DISPARITYENGINE_H
+
+#include "ImageProcessingPlugin.h"
+#include "StereoSettings.h"
+
+#include <SofaCV/SofaCV.h>
+
+#include <opencv2/calib3d.hpp>
+
+namespace sofacv
+{
+namespace cam
+{
+/**
+ * @brief The DisparityEngine class
+ *
+ * Computes the disparity map of a pair of rectified stereo frames (e.g. the
+ * outputs of a StereoRectifier) with OpenCV's block matching (BM) or
+ * semi-global block matching (SGBM), and reprojects it into a point cloud.
+ * The input image is the reference camera's frame, img2 the second one's.
+ *
+ * Matching can be restricted to a region of interest, and run on a
+ * downsampled level of the frames. The frames are split in horizontal bands
+ * matched concurrently, each padded with the rows of its neighbours that
+ * BM's prefilter and matching windows read, and speckles are filtered once
+ * the bands are assembled: BM results are identical to a single pass, SGBM
+ * ones only differ slightly near band borders, as its vertical aggregation
+ * paths are cut there.
+ *
+ * The disparity-to-depth matrix Q is taken from the 'Q' input if set
+ * (StereoRectifier's output), or else computed from the linked
+ * StereoSettings.
+ */
+class SOFA_IMAGEPROCESSING_API DisparityEngine : public ImageFilter
+{
+  typedef sofa::core::objectmodel::SingleLink<
+      DisparityEngine, StereoSettings,
+      sofa::BaseLink::FLAG_STOREPATH | sofa::BaseLink::FLAG_STRONGLINK>
+      StereoCamSettings;
+  typedef sofa::defaulttype::Matrix4 Matrix4;
+  typedef sofa::defaulttype::Mat3x4d Mat3x4d;
+  typedef sofa::defaulttype::Vector3 Vector3;
+
+ public:
+  SOFA_CLASS(DisparityEngine, ImageFilter);
+
+  DisparityEngine();
+
+  void init() override;
+  void doUpdate() override;
+  void applyFilter(const cv::Mat& in, cv::Mat& out, bool) override;
+
+  // INPUTS
+  StereoCamSettings l_cam;  ///< StereoSettings holding the two cameras
+  sofa::Data<cvMat> d_img2;  ///< [INPUT] second camera's rectified frame
+  sofa::Data<Matrix4> d_Q;   ///< [INPUT] disparity-to-depth matrix
+  sofa::Data<sofa::helper::OptionsGroup> d_algorithm;  ///< BM or SGBM
+  sofa::Data<int> d_minDisparity;
+  sofa::Data<int> d_numDisparities;  ///< rounded up to a multiple of 16
+  sofa::Data<int> d_blockSize;       ///< odd matching window size
+  sofa::Data<int> d_uniquenessRatio;
+  sofa::Data<int> d_speckleWindowSize;
+  sofa::Data<int> d_speckleRange;
+  sofa::Data<sofa::defaulttype::Vec4i> d_roi;  ///< x, y, w, h (0: whole frame)
+  sofa::Data<int> d_level;  ///< number of times the frames are halved
+  sofa::Data<int> d_bands;  ///< row bands matched concurrently (0: auto)
+
+  // OUTPUTS
+  sofa::Data<cvMat> d_disparity;  ///< [OUTPUT] CV_32F disparity map
+  sofa::Data<sofa::helper::vector<Vector3> > d_positions;  ///< [OUTPUT]
+
+ private:
+  /// sets up one matcher per band with the current parameters
+  void updateMatchers(size_t nBands, bool sgbm, int channels);
+  /// fetches or recomputes Q. Returns false if none is available
+  bool updateQ(const cv::Size& size);
+
+  std::vector<cv::Ptr<cv::StereoBM> > m_bm;
+  std::vector<cv::Ptr<cv::StereoSGBM> > m_sgbm;
+  std::vector<cv::Mat> m_bandDisparity;  ///< padded disparity of each band
+  std::vector<std::vector<Vector3> > m_bandPoints;  ///< points of each band
+
+  cv::Mat m_left, m_right;  ///< matched (cropped, downsampled) frames
+  cv::Mat m_disparity16;    ///< fixed-point disparity (1/16 pixel)
+  cv::Mat m_speckleBuffer;  ///< cv::filterSpeckles work buffer
+  cv::Mat m_disparity;
+  cv::Matx44d m_Q;
+
+  // Q cache key, when computed from the StereoSettings
+  Mat3x4d m_M1, m_M2;
+  sofa::helper::vector<double> m_distCoefs1, m_distCoefs2;
+  cv::Size m_QSize;
+};
+
+}  // namespace cam
+}  // namespace sofacv
+#endif  // SOFACV_CAM_DISPARITYENGINE_H
@@ -3,6 +3,8 @@
 
 #include <sofa/core/ObjectFactory.h>
 
+#include <algorithm>
+
 namespace sofacv
 {
 namespace cam
@@ -27,21 +29,44 @@ FeatureTriangulator::FeatureTriangulator()
           &d_matches, "matches",
           "input array of matches (optional if keypoints are already sorted).",
           true, true)),
+      d_matchSet(initData(&d_matchSet, "matchSet",
+                          "input matches, stored contiguously (usually from "
+                          "DescriptorMatcher). Used instead of matches if set",
+                          true, true)),
+      d_parallel(initData(&d_parallel, false, "parallel",
+                          "if true, points are triangulated concurrently")),
       d_pointCloud(
-          initData(&d_pointCloud, "positions", "output vector of 3D points"))
+          initData(&d_pointCloud, "positions", "output vector of 3D points")),
+      d_reprojectionErrors(initData(&d_reprojectionErrors,
+                                    "reprojectionErrors",
+                                    "mean reprojection error of each point in "
+                                    "both images, in pixels")),
+      d_parallax(initData(&d_parallax, "parallax",
+                          "angle between the 2 viewing rays of each point, in "
+                          "degrees (small angles give inaccurate depths)")),
+      d_valid(initData(&d_valid, "valid",
+                       "false for the points behind either camera"))
 {
   f_listening.setValue(true);
   addAlias(&d_pointCloud, "positions_out");
+  addAlias(&d_reprojectionErrors, "reprojectionErrors_out");
+  addAlias(&d_parallax, "parallax_out");
+  addAlias(&d_valid, "valid_out");
 }
 
 FeatureTriangulator::~FeatureTriangulator() {}
 void FeatureTriangulator::init()
 {
   addInput(&d_matches);
+  addInput(&d_matchSet);
   addInput(&d_keypointsL);
   addInput(&d_keypointsR);
+  addInput(&d_parallel);
 
   addOutput(&d_pointCloud);
+  addOutput(&d_reprojectionErrors);
+  addOutput(&d_parallax);
+  addOutput(&d_valid);
 
   if (!l_cam.get())
     msg_error(getName() + "::init()") << "Error: No stereo camera link set. "
@@ -53,36 +78,58 @@ void FeatureTriangulator::init()
 
 void FeatureTriangulator::doUpdate()
 {
-  //	common::matrix::sofaMat2cvMat(l_cam->getRotationMatrix(), R);
-  //	common::matrix::sofaVector2cvMat(l_cam->getTranslationVector(), T);
-  matrix::sofaMat2cvMat(l_cam->getCamera1().getProjectionMatrix(), cmL);
-  matrix::sofaMat2cvMat(l_cam->getCamera2().getProjectionMatrix(), cmR);
-  matrix::sofaVector2cvMat(l_cam->getCamera1().getDistortionCoefficients(),
-                           dvL);
-  matrix::sofaVector2cvMat(l_cam->getCamera2().getDistortionCoefficients(),
-                           dvR);
-
-  PL = cmL;
-  PR = cmR;
-
-  sofa::helper::vector<Vec3d>& pts = *(d_pointCloud.beginWriteOnly());
-
   const sofa::helper::vector<cvKeypoint>& kL = d_keypointsL.getValue();
   const sofa::helper::vector<cvKeypoint>& kR = d_keypointsR.getValue();
-  pts.resize(kL.size());
-  size_t sizePts = 0;
-  (kL.size() > kR.size()) ? (sizePts = kR.size()) : (sizePts = kL.size());
 
-  if (d_matches.isSet())
+  // gather the pairs of matching points, triangulated in a single batch
+  m_ptsL.clear();
+  m_ptsR.clear();
+  if (d_matchSet.isSet())
+  {
+    const features::MatchSet& m = d_matchSet.getValue();
+    for (size_t i = 0; i < m.size(); ++i)
+      if (m.count(i))
+      {
+        m_ptsL.push_back(kL[size_t(m.begin(i)->queryIdx)].pt);
+        m_ptsR.push_back(kR[size_t(m.begin(i)->trainIdx)].pt);
+      }
+  }
+  else if (d_matches.isSet())
   {
     const sofa::helper::vector<cvDMatch>& m = d_matches.getValue();
     for (size_t i = 0; i < m.size(); ++i)
-      pts[i] = l_cam->triangulate(kL[m[i].queryIdx].pt, kR[m[i].trainIdx].pt);
+    {
+      m_ptsL.push_back(kL[size_t(m[i].queryIdx)].pt);
+      m_ptsR.push_back(kR[size_t(m[i].trainIdx)].pt);
+    }
   }
   else
-    for (size_t i = 0; i < sizePts; ++i)
-      pts[i] = l_cam->triangulate(kL[i].pt, kR[i].pt);
+    for (size_t i = 0; i < std::min(kL.size(), kR.size()); ++i)
+    {
+      m_ptsL.push_back(kL[i].pt);
+      m_ptsR.push_back(kR[i].pt);
+    }
+
+  // outputs are written in place, their buffers being reused from frame to
+  // frame
+  const size_t n = m_ptsL.size();
+  sofa::helper::vector<Vec3d>& pts = *(d_pointCloud.beginWriteOnly());
+  sofa::helper::vector<double>& errors = *d_reprojectionErrors.beginWriteOnly();
+  sofa::helper::vector<double>& parallax = *d_parallax.beginWriteOnly();
+  pts.resize(n);
+  errors.resize(n);
+  parallax.resize(n);
+  m_valid.resize(n);
+  l_cam->triangulate(m_ptsL.data(), m_ptsR.data(), pts.data(), n,
+                     errors.data(), parallax.data(), m_valid.data(),
+                     d_parallel.getValue());
   d_pointCloud.endEdit();
+  d_reprojectionErrors.endEdit();
+  d_parallax.endEdit();
+
+  sofa::helper::vector<bool>& valid = *d_valid.beginWriteOnly();
+  valid.assign(m_valid.begin(), m_valid.end());
+  d_valid.endEdit();
 }
 
 }  // namespace cam
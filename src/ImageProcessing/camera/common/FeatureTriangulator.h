@@ -2,6 +2,7 @@
 #define SOFACV_CAM_FEATURETRIANGULATOR_H
 
 #include "StereoSettings.h"
+#include "features/MatchSet.h"
 
 #include <SofaCV/SofaCV.h>
 
@@ -47,19 +48,26 @@ class SOFA_IMAGEPROCESSING_API FeatureTriangulator : public ImplicitDataEngine
       d_keypointsR;  ///< [INPUT] second camera's keypoints
   sofa::Data<sofa::helper::vector<cvDMatch> >
       d_matches;  ///< [INPUT] matches between the keypoints, if not ordered
+  sofa::Data<features::MatchSet>
+      d_matchSet;  ///< [INPUT] matches between the keypoints, the best match
+                   /// of each left keypoint being triangulated
+  sofa::Data<bool> d_parallel;  ///< triangulate points concurrently
 
   sofa::Data<sofa::helper::vector<Vec3d> >
       d_pointCloud;  ///< [OUTPUT] triangulated 3D point cloud
+  sofa::Data<sofa::helper::vector<double> >
+      d_reprojectionErrors;  ///< [OUTPUT] per point mean reprojection error
+                             /// in both images, in pixels
+  sofa::Data<sofa::helper::vector<double> >
+      d_parallax;  ///< [OUTPUT] per point angle between its 2 viewing rays,
+                   /// in degrees
+  sofa::Data<sofa::helper::vector<bool> >
+      d_valid;  ///< [OUTPUT] per point, false if behind either camera
 
  private:
-  cv::Mat_<double> R;
-  cv::Mat_<double> T;
-  cv::Mat_<double> cmL;
-  cv::Mat_<double> cmR;
-  cv::Mat_<double> dvL;
-  cv::Mat_<double> dvR;
-  cv::Matx34d PL;
-  cv::Matx34d PR;
+  std::vector<cv::Point2f> m_ptsL;  ///< left points of the pairs to triangulate
+  std::vector<cv::Point2f> m_ptsR;  ///< their matching right points
+  std::vector<unsigned char> m_valid;
 };
 
 }  // namespace cam
@@ -1,9 +1,16 @@
 #include "ImageRectifier.h"
 
+#include <sofa/core/ObjectFactory.h>
+
 namespace sofacv
 {
 namespace cam
 {
+SOFA_DECL_CLASS(ImageRectifier)
+
+int ImageRectifierClass =
+    sofa::core::RegisterObject("Image undistortion").add<ImageRectifier>();
+
 ImageRectifier::ImageRectifier()
     : l_cam(initLink("cam",
                      "link to CameraSettings component containing and "
@@ -20,12 +27,30 @@ void ImageRectifier::init()
   ImageFilter::init();
 }
 
+void ImageRectifier::updateMaps(const cv::Size &size)
+{
+  const CameraSettings::Matrix3 &K = l_cam->getIntrinsicCameraMatrix();
+  const sofa::helper::vector<double> &distCoefs =
+      l_cam->getDistortionCoefficients();
+  if (!m_map1.empty() && size == m_mapSize && K == m_K &&
+      distCoefs == m_distCoefs)
+    return;
+
+  m_K = K;
+  m_distCoefs = distCoefs;
+  m_mapSize = size;
+  cv::Mat_<double> cam;
+  matrix::sofaMat2cvMat(K, cam);
+  // same maps as the ones cv::undistort() computes on each call
+  cv::initUndistortRectifyMap(cam, distCoefs, cv::Mat(), cam, size, CV_16SC2,
+                              m_map1, m_map2);
+}
+
 void ImageRectifier::applyFilter(const cv::Mat &in, cv::Mat &out, bool)
 {
   if (in.empty() || l_cam->getDistortionCoefficients().empty()) return;
-  cv::Mat_<double> cam;
-  matrix::sofaMat2cvMat(l_cam->getIntrinsicCameraMatrix(), cam);
-  cv::undistort(in, out, cam, l_cam->getDistortionCoefficients());
+  updateMaps(in.size());
+  cv::remap(in, out, m_map1, m_map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
 }
 }  // namespace cam
 }  // namespace sofacv
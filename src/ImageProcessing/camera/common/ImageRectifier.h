@@ -13,7 +13,9 @@ namespace cam
 /**
  * @brief The ImageRectifier class
  *
- * Rectifies a given image frame using the linked CameraSettings parameters
+ * Rectifies a given image frame using the linked CameraSettings parameters.
+ * The undistortion maps are computed once, and only recomputed when the
+ * camera's intrinsics, distortion coefficients or the frame size change.
  */
 class SOFA_IMAGEPROCESSING_API ImageRectifier : public ImageFilter
 {
@@ -31,12 +33,17 @@ class SOFA_IMAGEPROCESSING_API ImageRectifier : public ImageFilter
   void applyFilter(const cv::Mat& in, cv::Mat& out, bool);
 
   CamSettings l_cam;  ///< linked CameraSettings component
-};
 
-SOFA_DECL_CLASS(ImageRectifier)
+ private:
+  /// recomputes the undistortion maps if the camera or frame size changed
+  void updateMaps(const cv::Size& size);
 
-int ImageRectifierClass =
-    sofa::core::RegisterObject("Image undistortion").add<ImageRectifier>();
+  cv::Mat m_map1;  ///< fixed-point (CV_16SC2) undistortion map
+  cv::Mat m_map2;  ///< its interpolation table indices (CV_16UC1)
+  CameraSettings::Matrix3 m_K;  ///< K the maps were computed for
+  sofa::helper::vector<double> m_distCoefs;  ///< their distortion
+  cv::Size m_mapSize;
+};
 
 }  // namespace cam
 }  // namespace sofacv
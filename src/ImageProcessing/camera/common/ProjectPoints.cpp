@@ -19,9 +19,18 @@ ProjectPoints::ProjectPoints()
       d_depth(
           initData(&d_depth, -1.0, "depth",
                    "default is -1 (retrieves depth from fz in camSettings)")),
+      d_distortion(initData(&d_distortion, "distortion",
+                            "lens distortion applied in 3D to 2D projections "
+                            "(NONE, EXACT, or GRID: interpolated in a lookup "
+                            "grid), and removed before 2D to 3D ones (EXACT "
+                            "or GRID, both with cv::undistortPoints)")),
       d_Pts3D(initData(&d_Pts3D, "points3D", "3D points")),
       d_Pts2D(initData(&d_Pts2D, "points2D", "2D points"))
 {
+  sofa::helper::OptionsGroup* t = d_distortion.beginEdit();
+  t->setNames(3, "NONE", "EXACT", "GRID");
+  t->setSelectedItem("EXACT");
+  d_distortion.endEdit();
 }
 
 void ProjectPoints::init()
@@ -33,11 +42,13 @@ void ProjectPoints::init()
   if (d_2Dto3D.getValue())
   {
     addInput(&d_Pts2D);
+    addInput(&d_distortion);
     addOutput(&d_Pts3D);
   }
   else
   {
     addInput(&d_Pts3D);
+    addInput(&d_distortion);
     addOutput(&d_Pts2D);
   }
   update();
@@ -45,19 +56,45 @@ void ProjectPoints::init()
 
 void ProjectPoints::doUpdate()
 {
+  // the whole point set is projected in one batch
   if (d_2Dto3D.getValue())
   {
-    sofa::helper::vector<Vector3>& pts3d = *d_Pts3D.beginEdit();
-    pts3d.clear();
-    for (auto pt : d_Pts2D.getValue())
-      pts3d.push_back(l_cam->get3DFrom2DPosition(pt, d_depth.getValue()));
+    const sofa::helper::vector<Vector2>& pts2d = d_Pts2D.getValue();
+    const Vector2* pts = pts2d.data();
+    const sofa::helper::vector<double>& distCoefs =
+        l_cam->getDistortionCoefficients();
+    if (d_distortion.getValue().getSelectedId() != 0 && !distCoefs.empty() &&
+        !pts2d.empty())
+    {
+      // undistorted pixel positions: cv::Mat headers over the Vec2d arrays
+      const Matrix3& K = l_cam->getIntrinsicCameraMatrix();
+      const cv::Matx33d Kc(K[0][0], K[0][1], K[0][2], K[1][0], K[1][1],
+                           K[1][2], K[2][0], K[2][1], K[2][2]);
+      m_undistorted.resize(pts2d.size());
+      cv::Mat src(int(pts2d.size()), 1, CV_64FC2,
+                  const_cast<Vector2*>(pts2d.data()));
+      cv::Mat dst(int(pts2d.size()), 1, CV_64FC2, m_undistorted.data());
+      cv::undistortPoints(src, dst, Kc, distCoefs, cv::noArray(), Kc);
+      pts = m_undistorted.data();
+    }
+    sofa::helper::vector<Vector3>& pts3d = *d_Pts3D.beginWriteOnly();
+    pts3d.resize(pts2d.size());
+    l_cam->unprojectPoints(pts, pts3d.data(), pts2d.size(),
+                           d_depth.getValue());
+    d_Pts3D.endEdit();
   }
   else
   {
-    sofa::helper::vector<Vector2>& pts2d = *d_Pts2D.beginEdit();
-    pts2d.clear();
-    for (auto pt : d_Pts3D.getValue())
-      pts2d.push_back(l_cam->get2DFrom3DPosition(pt));
+    const sofa::helper::vector<Vector3>& pts3d = d_Pts3D.getValue();
+    sofa::helper::vector<Vector2>& pts2d = *d_Pts2D.beginWriteOnly();
+    pts2d.resize(pts3d.size());
+    const unsigned distortion = d_distortion.getValue().getSelectedId();
+    if (distortion == 0)
+      l_cam->projectPoints(pts3d.data(), pts2d.data(), pts3d.size());
+    else
+      l_cam->projectDistortedPoints(pts3d.data(), pts2d.data(), pts3d.size(),
+                                    distortion == 2);
+    d_Pts2D.endEdit();
   }
 }
 
@@ -16,7 +16,10 @@ namespace cam
  * @brief The ProjectPoints class
  *
  * Projects a 2D point cloud in 3D or vice-versa using a linked CameraSettings
- * component
+ * component. 3D to 2D projections apply the camera's lens distortion, either
+ * exactly or interpolated in a precomputed grid (GRID), which is faster for
+ * large point sets. 2D to 3D projections first undistort the points (unless
+ * distortion is NONE), so that both directions are each other's inverse
  */
 class SOFA_IMAGEPROCESSING_API ProjectPoints : public ImplicitDataEngine
 {
@@ -27,6 +30,7 @@ class SOFA_IMAGEPROCESSING_API ProjectPoints : public ImplicitDataEngine
 
   typedef typename sofa::defaulttype::Vector3 Vector3;
   typedef typename sofa::defaulttype::Vector2 Vector2;
+  typedef typename sofa::defaulttype::Matrix3 Matrix3;
 
  public:
   SOFA_CLASS(ProjectPoints, ImplicitDataEngine);
@@ -42,10 +46,15 @@ class SOFA_IMAGEPROCESSING_API ProjectPoints : public ImplicitDataEngine
   sofa::Data<bool> d_2Dto3D;   ///< projection direction (2Dto3D or 3Dto2D)
   sofa::Data<double> d_depth;  ///< focal distance for 2Dto3D projection (-1 to
                                /// take CameraSettings focal distance)
+  sofa::Data<sofa::helper::OptionsGroup>
+      d_distortion;  ///< lens distortion (NONE, EXACT, GRID)
   sofa::Data<sofa::helper::vector<Vector3> >
       d_Pts3D;  ///< [INPUT / OUTPUT] set of 3D points
   sofa::Data<sofa::helper::vector<Vector2> >
       d_Pts2D;  ///< [INPUT / OUTPUT] set of 2D points
+
+ private:
+  sofa::helper::vector<Vector2> m_undistorted;  ///< 2D to 3D buffer
 };
 
 }  // namespace cam
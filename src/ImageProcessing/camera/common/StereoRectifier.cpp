@@ -0,0 +1,163 @@
+#include "StereoRectifier.h"
+#include "utils/ParallelFor.h"
+#include "utils/ReleaseIfShared.h"
+
+#include <sofa/core/ObjectFactory.h>
+
+namespace sofacv
+{
+namespace cam
+{
+SOFA_DECL_CLASS(StereoRectifier)
+
+int StereoRectifierClass =
+    sofa::core::RegisterObject(
+        "Stereo rectification of a pair of frames, aligning epipolar lines "
+        "with image rows")
+        .add<StereoRectifier>();
+
+namespace
+{
+template <int L, int C>
+void cvMat2sofaMat(const cv::Mat& m, sofa::defaulttype::Mat<L, C, double>& M)
+{
+  for (int i = 0; i < L; ++i)
+    for (int j = 0; j < C; ++j) M[i][j] = m.at<double>(i, j);
+}
+
+}  // namespace
+
+StereoRectifier::StereoRectifier()
+    : l_cam(initLink("cam",
+                     "link to the StereoSettings component holding the two "
+                     "cameras' parameters")),
+      d_img2(initData(&d_img2, "img2", "second camera's frame")),
+      d_alpha(initData(&d_alpha, -1.0, "alpha",
+                       "free scaling parameter: 0 crops the rectified images "
+                       "to their valid pixels, 1 keeps all source pixels, -1 "
+                       "lets OpenCV choose")),
+      d_zeroDisparity(initData(&d_zeroDisparity, true, "zeroDisparity",
+                               "if true, both rectified views share the same "
+                               "principal point")),
+      d_img2_out(initData(&d_img2_out, "img2_out",
+                          "rectified second camera's frame", false, true)),
+      d_R1(initData(&d_R1, "R1", "rectification rotation of camera 1")),
+      d_R2(initData(&d_R2, "R2", "rectification rotation of camera 2")),
+      d_P1(initData(&d_P1, "P1",
+                    "projection matrix of camera 1 in the rectified frame")),
+      d_P2(initData(&d_P2, "P2",
+                    "projection matrix of camera 2 in the rectified frame")),
+      d_Q(initData(&d_Q, "Q",
+                   "disparity-to-depth mapping matrix (see "
+                   "cv::reprojectImageTo3D)")),
+      m_rebuilt(false),
+      m_builtAlpha(0.0),
+      m_builtZeroDisparity(false)
+{
+  addAlias(&d_R1, "R1_out");
+  addAlias(&d_R2, "R2_out");
+  addAlias(&d_P1, "P1_out");
+  addAlias(&d_P2, "P2_out");
+  addAlias(&d_Q, "Q_out");
+}
+
+void StereoRectifier::init()
+{
+  if (!l_cam.get())
+    msg_error(getName() + "::init()") << "Error: No stereo camera link set. "
+                                         "Please use attribute 'cam' "
+                                         "to define one";
+
+  registerData(&d_alpha, -1.0, 1.0, 0.01);
+  registerData(&d_zeroDisparity);
+
+  addInput(&d_img2);
+  addOutput(&d_img2_out);
+  addOutput(&d_R1);
+  addOutput(&d_R2);
+  addOutput(&d_P1);
+  addOutput(&d_P2);
+  addOutput(&d_Q);
+  ImageFilter::init();
+}
+
+bool StereoRectifier::updateMaps(const cv::Size& size)
+{
+  CameraSettings& cam1 = l_cam->getCamera1();
+  CameraSettings& cam2 = l_cam->getCamera2();
+  if (!m_map1[0].empty() && size == m_mapSize &&
+      cam1.getProjectionMatrix() == m_M1 &&
+      cam2.getProjectionMatrix() == m_M2 &&
+      cam1.getDistortionCoefficients() == m_distCoefs1 &&
+      cam2.getDistortionCoefficients() == m_distCoefs2 &&
+      d_alpha.getValue() == m_builtAlpha &&
+      d_zeroDisparity.getValue() == m_builtZeroDisparity)
+    return false;
+
+  m_M1 = cam1.getProjectionMatrix();
+  m_M2 = cam2.getProjectionMatrix();
+  m_distCoefs1 = cam1.getDistortionCoefficients();
+  m_distCoefs2 = cam2.getDistortionCoefficients();
+  m_mapSize = size;
+  m_builtAlpha = d_alpha.getValue();
+  m_builtZeroDisparity = d_zeroDisparity.getValue();
+
+  l_cam->stereoRectify(size, m_builtAlpha, m_builtZeroDisparity, m_R1, m_R2,
+                       m_P1, m_P2, m_Q);
+
+  cv::Mat_<double> K1, K2;
+  matrix::sofaMat2cvMat(cam1.getIntrinsicCameraMatrix(), K1);
+  matrix::sofaMat2cvMat(cam2.getIntrinsicCameraMatrix(), K2);
+  cv::initUndistortRectifyMap(K1, m_distCoefs1, m_R1, m_P1, size, CV_16SC2,
+                              m_map1[0], m_map2[0]);
+  cv::initUndistortRectifyMap(K2, m_distCoefs2, m_R2, m_P2, size, CV_16SC2,
+                              m_map1[1], m_map2[1]);
+  return true;
+}
+
+void StereoRectifier::applyFilter(const cv::Mat& in, cv::Mat& out, bool)
+{
+  const cv::Mat& in2 = d_img2.getValue();
+  if (in.empty() || in2.empty() || !l_cam.get()) return;
+  if (in.size() != in2.size())
+  {
+    msg_error(getName() + "::update()")
+        << "Error: both frames must have the same size";
+    return;
+  }
+  if (updateMaps(in.size())) m_rebuilt = true;
+
+  // the second frame is remapped straight into its output
+  cvMat& out2 = *d_img2_out.beginWriteOnly();
+  utils::releaseIfShared(out2);
+  // both frames are remapped concurrently
+  const cv::Mat* src[2] = {&in, &in2};
+  cv::Mat* dst[2] = {&out, &out2};
+  utils::parallelFor(cv::Range(0, 2), [&](const cv::Range& range) {
+    for (int i = range.start; i < range.end; ++i)
+      cv::remap(*src[i], *dst[i], m_map1[i], m_map2[i], cv::INTER_LINEAR,
+                cv::BORDER_CONSTANT);
+  });
+  d_img2_out.endEdit();
+}
+
+void StereoRectifier::doUpdate()
+{
+  ImageFilter::doUpdate();
+  if (!m_rebuilt) return;
+
+  cvMat2sofaMat(m_R1, *d_R1.beginWriteOnly());
+  d_R1.endEdit();
+  cvMat2sofaMat(m_R2, *d_R2.beginWriteOnly());
+  d_R2.endEdit();
+  cvMat2sofaMat(m_P1, *d_P1.beginWriteOnly());
+  d_P1.endEdit();
+  cvMat2sofaMat(m_P2, *d_P2.beginWriteOnly());
+  d_P2.endEdit();
+  cvMat2sofaMat(m_Q, *d_Q.beginWriteOnly());
+  d_Q.endEdit();
+  m_rebuilt = false;
+}
+
+}  // namespace cam
+}  // namespace sofacv
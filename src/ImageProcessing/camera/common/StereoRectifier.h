@@ -0,0 +1,78 @@
+#ifndef SOFACV_CAM_STEREORECTIFIER_H
+#define SOFACV_CAM_STEREORECTIFIER_H
+
+#include "ImageProcessingPlugin.h"
+#include "StereoSettings.h"
+
+#include <SofaCV/SofaCV.h>
+
+#include <opencv2/imgproc.hpp>
+
+namespace sofacv
+{
+namespace cam
+{
+/**
+ * @brief The StereoRectifier class
+ *
+ * Rectifies a pair of stereo frames using the linked StereoSettings: both
+ * frames are undistorted and reprojected so that their epipolar lines are
+ * aligned with image rows (a match of a left pixel lies on the same row in
+ * the right image). The rectification maps are computed once and only
+ * recomputed when either camera, the frame size or the parameters change.
+ * The input image is the reference camera's frame, img2 the second one's.
+ */
+class SOFA_IMAGEPROCESSING_API StereoRectifier : public ImageFilter
+{
+  typedef sofa::core::objectmodel::SingleLink<
+      StereoRectifier, StereoSettings,
+      sofa::BaseLink::FLAG_STOREPATH | sofa::BaseLink::FLAG_STRONGLINK>
+      StereoCamSettings;
+  typedef sofa::defaulttype::Matrix3 Matrix3;
+  typedef sofa::defaulttype::Matrix4 Matrix4;
+  typedef sofa::defaulttype::Mat3x4d Mat3x4d;
+
+ public:
+  SOFA_CLASS(StereoRectifier, ImageFilter);
+
+  StereoRectifier();
+
+  void init() override;
+  void doUpdate() override;
+  void applyFilter(const cv::Mat& in, cv::Mat& out, bool) override;
+
+  // INPUTS
+  StereoCamSettings l_cam;  ///< StereoSettings holding the two cameras
+  sofa::Data<cvMat> d_img2;  ///< [INPUT] second camera's frame
+  sofa::Data<double> d_alpha;  ///< free scaling parameter of stereoRectify
+  sofa::Data<bool> d_zeroDisparity;  ///< same principal point in both views
+
+  // OUTPUTS
+  sofa::Data<cvMat> d_img2_out;  ///< [OUTPUT] rectified second frame
+  sofa::Data<Matrix3> d_R1;  ///< [OUTPUT] rectification rotation, camera 1
+  sofa::Data<Matrix3> d_R2;  ///< [OUTPUT] rectification rotation, camera 2
+  sofa::Data<Mat3x4d> d_P1;  ///< [OUTPUT] rectified projection, camera 1
+  sofa::Data<Mat3x4d> d_P2;  ///< [OUTPUT] rectified projection, camera 2
+  sofa::Data<Matrix4> d_Q;   ///< [OUTPUT] disparity-to-depth matrix
+
+ private:
+  /// recomputes the rectification maps if the cameras, the frame size or the
+  /// parameters changed. Returns true if they were recomputed
+  bool updateMaps(const cv::Size& size);
+
+  cv::Mat m_map1[2];  ///< fixed-point (CV_16SC2) rectification maps
+  cv::Mat m_map2[2];  ///< their interpolation table indices
+  cv::Mat m_R1, m_R2, m_P1, m_P2, m_Q;
+  bool m_rebuilt;
+
+  // cache key
+  Mat3x4d m_M1, m_M2;
+  sofa::helper::vector<double> m_distCoefs1, m_distCoefs2;
+  cv::Size m_mapSize;
+  double m_builtAlpha;
+  bool m_builtZeroDisparity;
+};
+
+}  // namespace cam
+}  // namespace sofacv
+#endif  // SOFACV_CAM_STEREORECTIFIER_H
@@ -1,6 +1,12 @@
 #include "StereoSettings.h"
+#include "utils/ParallelFor.h"
+
 #include <SofaCV/SofaCV.h>
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
 namespace sofacv
 {
 namespace cam
@@ -13,83 +19,195 @@ int StereoSettingsClass =
         "stereoscopic camera parameters up to date")
         .add<StereoSettings>();
 
-cv::Mat_<double> StereoSettings::iterativeLinearLSTriangulation(cv::Point3d u,
-                                                                cv::Point3d u1)
+namespace
 {
-  double wi = 1, wi1 = 1;
-  cv::Mat_<double> X(4, 1);
+/// least squares solution of the 4x3 system A.X = B, by Householder QR (no
+/// heap allocation). Unlike the normal equations, it does not square A's
+/// condition number, which is large for low parallax points. Returns false,
+/// leaving X unchanged, if A is rank deficient (e.g. identical rays)
+inline bool solveLS(cv::Matx43d A, cv::Vec4d B, cv::Vec3d& X)
+{
+  double scale = 0;
+  for (int i = 0; i < 12; ++i) scale = std::max(scale, std::fabs(A.val[i]));
+  for (int k = 0; k < 3; ++k)
+  {
+    double norm = 0;
+    for (int i = k; i < 4; ++i) norm += A(i, k) * A(i, k);
+    norm = std::sqrt(norm);
+    if (norm <= 1e-10 * scale) return false;
+
+    // reflection v of column k onto alpha.e_k, applied to the next columns
+    // and to B
+    const double alpha = (A(k, k) > 0) ? (-norm) : (norm);
+    double v[4] = {0, 0, 0, 0};
+    double vv = 0;
+    for (int i = k; i < 4; ++i) v[i] = A(i, k);
+    v[k] -= alpha;
+    for (int i = k; i < 4; ++i) vv += v[i] * v[i];
+    for (int j = k + 1; j < 3; ++j)
+    {
+      double d = 0;
+      for (int i = k; i < 4; ++i) d += v[i] * A(i, j);
+      d *= 2.0 / vv;
+      for (int i = k; i < 4; ++i) A(i, j) -= d * v[i];
+    }
+    double d = 0;
+    for (int i = k; i < 4; ++i) d += v[i] * B[i];
+    d *= 2.0 / vv;
+    for (int i = k; i < 4; ++i) B[i] -= d * v[i];
+    A(k, k) = alpha;
+  }
 
-  cv::Mat_<double> X_ = linearLSTriangulation(u, u1);
-  X(0) = X_(0);
-  X(1) = X_(1);
-  X(2) = X_(2);
-  X(3) = 1.0;
+  // back substitution in the upper triangle
+  for (int k = 2; k >= 0; --k)
+  {
+    double s = B[k];
+    for (int j = k + 1; j < 3; ++j) s -= A(k, j) * X[j];
+    X[k] = s / A(k, k);
+  }
+  return true;
+}
 
-  for (int i = 0; i < 10; i++)
+/**
+From "Triangulation", Hartley, R.I. and Sturm, P., Computer vision and image
+understanding, 1997: linear least squares triangulation, iteratively
+reweighted by the depth of the point in each camera. Returns false if the
+rays do not determine a point
+*/
+inline bool triangulatePoint(const cv::Matx34d& P1, const cv::Matx34d& P2,
+                             double ux, double uy, double u1x, double u1y,
+                             cv::Vec3d& X)
+{
+  double wi = 1, wi1 = 1;
+  X = cv::Vec3d(0, 0, 0);
+  for (int i = 0; i <= 10; i++)
   {  // Hartley suggests 10 iterations at most
+    // reweight equations and solve
+    const cv::Matx43d A(
+        (ux * P1(2, 0) - P1(0, 0)) / wi, (ux * P1(2, 1) - P1(0, 1)) / wi,
+        (ux * P1(2, 2) - P1(0, 2)) / wi, (uy * P1(2, 0) - P1(1, 0)) / wi,
+        (uy * P1(2, 1) - P1(1, 1)) / wi, (uy * P1(2, 2) - P1(1, 2)) / wi,
+        (u1x * P2(2, 0) - P2(0, 0)) / wi1, (u1x * P2(2, 1) - P2(0, 1)) / wi1,
+        (u1x * P2(2, 2) - P2(0, 2)) / wi1, (u1y * P2(2, 0) - P2(1, 0)) / wi1,
+        (u1y * P2(2, 1) - P2(1, 1)) / wi1, (u1y * P2(2, 2) - P2(1, 2)) / wi1);
+    const cv::Vec4d B(-(ux * P1(2, 3) - P1(0, 3)) / wi,
+                      -(uy * P1(2, 3) - P1(1, 3)) / wi,
+                      -(u1x * P2(2, 3) - P2(0, 3)) / wi1,
+                      -(u1y * P2(2, 3) - P2(1, 3)) / wi1);
+    if (!solveLS(A, B, X))
+      return i > 0;  // later iterations only refine the first solution
+
     // recalculate weights
-    double p2x = cv::Mat_<double>(cv::Mat_<double>(P1).row(2) * X)(0);
-    double p2x1 = cv::Mat_<double>(cv::Mat_<double>(P2).row(2) * X)(0);
+    const double p2x =
+        P1(2, 0) * X[0] + P1(2, 1) * X[1] + P1(2, 2) * X[2] + P1(2, 3);
+    const double p2x1 =
+        P2(2, 0) * X[0] + P2(2, 1) * X[1] + P2(2, 2) * X[2] + P2(2, 3);
 
     // breaking point
-    // if(fabsf(wi - p2x) <= EPSILON && fabsf(wi1 - p2x1) <= EPSILON) break;
+    if (std::fabs(wi - p2x) <= 1e-9 * std::fabs(wi) &&
+        std::fabs(wi1 - p2x1) <= 1e-9 * std::fabs(wi1))
+      break;
+    if (std::fabs(p2x) < DBL_EPSILON || std::fabs(p2x1) < DBL_EPSILON) break;
 
     wi = p2x;
     wi1 = p2x1;
-
-    // reweight equations and solve
-    cv::Matx43d A(
-        (u.x * P1(2, 0) - P1(0, 0)) / wi, (u.x * P1(2, 1) - P1(0, 1)) / wi,
-        (u.x * P1(2, 2) - P1(0, 2)) / wi, (u.y * P1(2, 0) - P1(1, 0)) / wi,
-        (u.y * P1(2, 1) - P1(1, 1)) / wi, (u.y * P1(2, 2) - P1(1, 2)) / wi,
-        (u1.x * P2(2, 0) - P2(0, 0)) / wi1, (u1.x * P2(2, 1) - P2(0, 1)) / wi1,
-        (u1.x * P2(2, 2) - P2(0, 2)) / wi1, (u1.y * P2(2, 0) - P2(1, 0)) / wi1,
-        (u1.y * P2(2, 1) - P2(1, 1)) / wi1, (u1.y * P2(2, 2) - P2(1, 2)) / wi1);
-
-    cv::Mat_<double> B =
-        (cv::Mat_<double>(4, 1) << -(u.x * P1(2, 3) - P1(0, 3)) / wi,
-         -(u.y * P1(2, 3) - P1(1, 3)) / wi, -(u1.x * P2(2, 3) - P2(0, 3)) / wi1,
-         -(u1.y * P2(2, 3) - P2(1, 3)) / wi1);
-
-    cv::solve(A, B, X_, cv::DECOMP_SVD);
-    X(0) = X_(0);
-    X(1) = X_(1);
-    X(2) = X_(2);
-    X(3) = 1.0;
   }
+  return true;
+}
+
+inline double px(const sofa::defaulttype::Vector2& p) { return p.x(); }
+inline double py(const sofa::defaulttype::Vector2& p) { return p.y(); }
+inline double px(const cv::Point2f& p) { return double(p.x); }
+inline double py(const cv::Point2f& p) { return double(p.y); }
 
-  return X;
+/// projection matrix P = [M | p4] of a camera, and its center -M^-1.p4
+void cameraCenter(const cv::Matx34d& P, cv::Vec3d& C, double& depthSign)
+{
+  const cv::Matx33d M = P.get_minor<3, 3>(0, 0);
+  C = -(M.inv() * cv::Vec3d(P(0, 3), P(1, 3), P(2, 3)));
+  // points in front of the camera have a depth of the sign of det(M)
+  depthSign = (cv::determinant(M) < 0) ? (-1.0) : (1.0);
 }
 
-cv::Mat_<double> StereoSettings::linearLSTriangulation(cv::Point3d u,
-                                                       cv::Point3d u1)
+/// the 2 cameras, and the optional per-point quality outputs
+struct Rig
+{
+  const cv::Matx34d& P1;
+  const cv::Matx34d& P2;
+  const cv::Vec3d& C1;
+  const cv::Vec3d& C2;
+  double depthSign1;
+  double depthSign2;
+  double* reprojectionErrors;
+  double* parallax;
+  unsigned char* valid;
+};
+
+inline double reprojectionError(const cv::Vec3d& p, double x, double y)
 {
-  /**
-  From "Triangulation", Hartley, R.I. and Sturm, P., Computer vision and image
-  understanding, 1997
-  */
-  cv::Matx43d A(u.x * P1(2, 0) - P1(0, 0), u.x * P1(2, 1) - P1(0, 1),
-                u.x * P1(2, 2) - P1(0, 2), u.y * P1(2, 0) - P1(1, 0),
-                u.y * P1(2, 1) - P1(1, 1), u.y * P1(2, 2) - P1(1, 2),
-                u1.x * P2(2, 0) - P2(0, 0), u1.x * P2(2, 1) - P2(0, 1),
-                u1.x * P2(2, 2) - P2(0, 2), u1.y * P2(2, 0) - P2(1, 0),
-                u1.y * P2(2, 1) - P2(1, 1), u1.y * P2(2, 2) - P2(1, 2));
-
-  cv::Matx41d B(-(u.x * P1(2, 3) - P1(0, 3)), -(u.y * P1(2, 3) - P1(1, 3)),
-                -(u1.x * P2(2, 3) - P2(0, 3)), -(u1.y * P2(2, 3) - P2(1, 3)));
-
-  cv::Mat_<double> X;
-  cv::solve(A, B, X, cv::DECOMP_SVD);
-
-  return X;
+  return std::sqrt((p[0] / p[2] - x) * (p[0] / p[2] - x) +
+                   (p[1] / p[2] - y) * (p[1] / p[2] - y));
 }
 
+template <class Point>
+void triangulateBatch(const Rig& rig, const Point* x1, const Point* x2,
+                      sofa::defaulttype::Vector3* w, size_t n, bool parallel)
+{
+  const bool quality = rig.reprojectionErrors || rig.parallax || rig.valid;
+  auto triangulateRange = [&](const cv::Range& range) {
+    for (int i = range.start; i < range.end; ++i)
+    {
+      cv::Vec3d X;
+      const bool solved = triangulatePoint(rig.P1, rig.P2, px(x1[i]),
+                                           py(x1[i]), px(x2[i]), py(x2[i]), X);
+      w[i] = sofa::defaulttype::Vector3(X[0], X[1], X[2]);
+      if (!quality) continue;
+      if (!solved)
+      {
+        if (rig.reprojectionErrors) rig.reprojectionErrors[i] = DBL_MAX;
+        if (rig.parallax) rig.parallax[i] = 0.0;
+        if (rig.valid) rig.valid[i] = 0;
+        continue;
+      }
+
+      const cv::Vec4d Xh(X[0], X[1], X[2], 1.0);
+      const cv::Vec3d p1 = rig.P1 * Xh;
+      const cv::Vec3d p2 = rig.P2 * Xh;
+      if (rig.reprojectionErrors)
+        rig.reprojectionErrors[i] =
+            0.5 * (reprojectionError(p1, px(x1[i]), py(x1[i])) +
+                   reprojectionError(p2, px(x2[i]), py(x2[i])));
+      if (rig.parallax)
+      {
+        const cv::Vec3d r1 = X - rig.C1;
+        const cv::Vec3d r2 = X - rig.C2;
+        const double c = r1.dot(r2) / std::sqrt(r1.dot(r1) * r2.dot(r2));
+        rig.parallax[i] =
+            std::acos(std::min(1.0, std::max(-1.0, c))) * 180.0 / CV_PI;
+      }
+      if (rig.valid)
+        rig.valid[i] =
+            (rig.depthSign1 * p1[2] > 0.0 && rig.depthSign2 * p2[2] > 0.0)
+                ? (1)
+                : (0);
+    }
+  };
+  if (parallel)
+    utils::parallelFor(cv::Range(0, int(n)), triangulateRange);
+  else
+    triangulateRange(cv::Range(0, int(n)));
+}
+
+}  // namespace
+
 StereoSettings::StereoSettings()
     : l_cam1(
           initLink("cam1", "link to the reference CameraSettings component")),
       l_cam2(initLink("cam2", "link to the second CameraSettings component")),
       d_F(initData(&d_F, "F", "Fundamental matrix")),
-      d_E(initData(&d_E, "E", "Essential matrix"))
+      d_E(initData(&d_E, "E", "Essential matrix")),
+      depthSign1(1.0),
+      depthSign2(1.0)
 {
 }
 
@@ -99,41 +217,67 @@ void StereoSettings::init()
     recomputeFromCameras();
 }
 
+void StereoSettings::updateProjectionMatrices()
+{
+  const CameraSettings::Mat3x4d& M1 = l_cam1->getProjectionMatrix();
+  const CameraSettings::Mat3x4d& M2 = l_cam2->getProjectionMatrix();
+  if (M1 != m_M1)
+  {
+    m_M1 = M1;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 4; ++j) P1(i, j) = M1[i][j];
+    cameraCenter(P1, C1, depthSign1);
+  }
+  if (M2 != m_M2)
+  {
+    m_M2 = M2;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 4; ++j) P2(i, j) = M2[i][j];
+    cameraCenter(P2, C2, depthSign2);
+  }
+}
+
 // returns the 3D position of a pair of 2D matches 'X, Y'
 sofa::defaulttype::Vector3 StereoSettings::triangulate(const Vector2& x1,
                                                        const Vector2& x2)
 {
-  matrix::sofaMat2cvMat(l_cam1->getProjectionMatrix(), P1);
-  matrix::sofaMat2cvMat(l_cam2->getProjectionMatrix(), P2);
-
-  cv::Point3d u(x1.x(), x2.y(), 1.0);
-  cv::Point3d u1(x2.x(), x2.y(), 1.0);
-
-  //	// multiply the point by the inverse of the K matrix
-  //	cv::Mat_<double> um = cm1.inv() * cv::Mat_<double>(u);
-  //	cv::Mat_<double> um1 = cm2.inv() * cv::Mat_<double>(u1);
+  Vector3 w;
+  triangulate(&x1, &x2, &w, 1);
+  return w;
+}
 
-  //	u.x = um(0);
-  //	u.y = um(1);
-  //	u1.x = um1(0);
-  //	u1.y = um1(1);
-  //	u.z = um(2);
-  //	u1.z = um1(2);
+sofa::defaulttype::Vector3 StereoSettings::triangulate(const cv::Point2d& x1,
+                                                       const cv::Point2d& x2)
+{
+  updateProjectionMatrices();
+  cv::Vec3d X;
+  triangulatePoint(P1, P2, x1.x, x1.y, x2.x, x2.y, X);
+  return Vector3(X[0], X[1], X[2]);
+}
 
-  cv::Mat_<double> X = iterativeLinearLSTriangulation(u, u1);
+void StereoSettings::triangulate(const Vector2* x1, const Vector2* x2,
+                                 Vector3* w, size_t n, bool parallel)
+{
+  updateProjectionMatrices();
+  Rig rig = {P1, P2, C1, C2, depthSign1, depthSign2, nullptr, nullptr, nullptr};
+  triangulateBatch(rig, x1, x2, w, n, parallel);
+}
 
-  return Vector3(X(0), X(1), X(2));
+void StereoSettings::triangulate(const cv::Point2f* x1, const cv::Point2f* x2,
+                                 Vector3* w, size_t n, bool parallel)
+{
+  triangulate(x1, x2, w, n, nullptr, nullptr, nullptr, parallel);
 }
 
-sofa::defaulttype::Vector3 StereoSettings::triangulate(const cv::Point2d& x1,
-                                                       const cv::Point2d& x2)
+void StereoSettings::triangulate(const cv::Point2f* x1, const cv::Point2f* x2,
+                                 Vector3* w, size_t n,
+                                 double* reprojectionErrors, double* parallax,
+                                 unsigned char* valid, bool parallel)
 {
-  matrix::sofaMat2cvMat(l_cam1->getProjectionMatrix(), P1);
-  matrix::sofaMat2cvMat(l_cam2->getProjectionMatrix(), P2);
-  cv::Point3d u(x1.x, x2.y, 1.0);
-  cv::Point3d u1(x2.x, x2.y, 1.0);
-  cv::Mat_<double> X = iterativeLinearLSTriangulation(u, u1);
-  return Vector3(X(0), X(1), X(2));
+  updateProjectionMatrices();
+  Rig rig = {P1, P2, C1, C2, depthSign1, depthSign2,
+             reprojectionErrors, parallax, valid};
+  triangulateBatch(rig, x1, x2, w, n, parallel);
 }
 
 // returns the 3D position of a pair of 2D matches 'X, Y'
@@ -245,6 +389,31 @@ void StereoSettings::recomputeFromCameras()
   this->setEssentialMatrix(E);
 }
 
+void StereoSettings::stereoRectify(const cv::Size& size, double alpha,
+                                   bool zeroDisparity, cv::Mat& R1,
+                                   cv::Mat& R2, cv::Mat& P1, cv::Mat& P2,
+                                   cv::Mat& Q)
+{
+  // Pose of camera 2 relative to camera 1. CameraSettings' R maps world to
+  // camera coordinates, and t is the camera's optical center in the world
+  const Matrix3& Rw1 = l_cam1->getRotationMatrix();
+  const Matrix3& Rw2 = l_cam2->getRotationMatrix();
+  Matrix3 R = Rw2 * Rw1.transposed();
+  Vector3 t = Rw2 * (l_cam1->getPosition() - l_cam2->getPosition());
+
+  cv::Mat_<double> K1, K2, Rrel;
+  matrix::sofaMat2cvMat(l_cam1->getIntrinsicCameraMatrix(), K1);
+  matrix::sofaMat2cvMat(l_cam2->getIntrinsicCameraMatrix(), K2);
+  matrix::sofaMat2cvMat(R, Rrel);
+  cv::Vec3d T(t[0], t[1], t[2]);
+
+  cv::stereoRectify(K1, l_cam1->getDistortionCoefficients(), K2,
+                    l_cam2->getDistortionCoefficients(), size, Rrel, T, R1,
+                    R2, P1, P2, Q,
+                    (zeroDisparity) ? (cv::CALIB_ZERO_DISPARITY) : (0), alpha,
+                    size);
+}
+
 void StereoSettings::FundamentalMatrixChanged()
 {
   setFundamentalMatrix(d_F.getValue());
@@ -48,6 +48,23 @@ class SOFA_IMAGEPROCESSING_API StereoSettings : public ImplicitDataEngine
   void triangulate(const Vector2& x1, const Vector2& x2, Vector3& w);
   /// returns the 3D position of a pair of 2D matches 'X, Y'
   void triangulate(const cv::Point2d& x1, const cv::Point2d& x2, Vector3& w);
+  /// returns in w[i] the 3D position of each pair of 2D matches x1[i], x2[i].
+  /// The projection matrices are fetched once for the whole batch, and the
+  /// points are triangulated concurrently if 'parallel' is set
+  void triangulate(const Vector2* x1, const Vector2* x2, Vector3* w, size_t n,
+                   bool parallel = false);
+  /// returns in w[i] the 3D position of each pair of 2D matches x1[i], x2[i]
+  void triangulate(const cv::Point2f* x1, const cv::Point2f* x2, Vector3* w,
+                   size_t n, bool parallel = false);
+  /// same as above, also returning for each point, in the arrays not null:
+  /// - reprojectionErrors: mean distance between the 2D points and the
+  ///   projections of their 3D point, in pixels
+  /// - parallax: angle between the 2 viewing rays, in degrees
+  /// - valid: 0 for points behind either camera, or whose rays do not
+  ///   determine a point (their error is then DBL_MAX), 1 otherwise
+  void triangulate(const cv::Point2f* x1, const cv::Point2f* x2, Vector3* w,
+                   size_t n, double* reprojectionErrors, double* parallax,
+                   unsigned char* valid, bool parallel = false);
 
   /// Returns the Fundamental Matrix F
   const Matrix3& getFundamentalMatrix();
@@ -67,6 +84,12 @@ class SOFA_IMAGEPROCESSING_API StereoSettings : public ImplicitDataEngine
   /// Recomputes F and E from the two CameraSettings
   void recomputeFromCameras();
 
+  /// computes the stereo rectification transforms of the two cameras for
+  /// frames of the given size (see cv::stereoRectify)
+  void stereoRectify(const cv::Size& size, double alpha, bool zeroDisparity,
+                     cv::Mat& R1, cv::Mat& R2, cv::Mat& P1, cv::Mat& P2,
+                     cv::Mat& Q);
+
  private:
   CamSettings l_cam1;       ///< Reference Cam
   CamSettings l_cam2;       ///< Second cam
@@ -74,7 +97,10 @@ class SOFA_IMAGEPROCESSING_API StereoSettings : public ImplicitDataEngine
   sofa::Data<Matrix3> d_E;  ///< Essential Mat
 
   //	cv::Mat_<double> K1, K2;
-  cv::Mat_<double> P1, P2;
+  cv::Matx34d P1, P2;
+  CameraSettings::Mat3x4d m_M1, m_M2;  ///< cameras' matrices P1, P2 match
+  cv::Vec3d C1, C2;                    ///< camera centers
+  double depthSign1, depthSign2;  ///< sign of the depth of points in front
 
  public:
   // Data callbacks for GUI
@@ -82,9 +108,8 @@ class SOFA_IMAGEPROCESSING_API StereoSettings : public ImplicitDataEngine
   void EssentialMatrixChanged();
 
  private:
-  cv::Mat_<double> iterativeLinearLSTriangulation(cv::Point3d u,
-                                                  cv::Point3d u1);
-  cv::Mat_<double> linearLSTriangulation(cv::Point3d u, cv::Point3d u1);
+  /// copies the cameras' projection matrices into P1, P2 if they changed
+  void updateProjectionMatrices();
   void updateRt();
 };
 
@@ -0,0 +1,235 @@
+#include "DenseOpticalFlow.h"
+#include "utils/ReleaseIfShared.h"
+
+#include <sofa/core/ObjectFactory.h>
+
+#include <opencv2/imgproc.hpp>
+
+/// DIS moved from opencv_contrib's optflow module to video in OpenCV 4
+#if CV_VERSION_MAJOR >= 4 || defined(SOFACV_OPENCV_CONTRIB_ENABLED)
+#define SOFACV_DIS_ENABLED
+#endif
+#if CV_VERSION_MAJOR < 4 && defined(SOFACV_DIS_ENABLED)
+#include <opencv2/optflow.hpp>
+#endif
+
+#include <algorithm>
+
+namespace sofacv
+{
+namespace features
+{
+SOFA_DECL_CLASS(DenseOpticalFlow)
+
+int DenseOpticalFlowClass =
+    sofa::core::RegisterObject(
+        "Dense optical flow between 2 frames (DIS or Farneback)")
+        .add<DenseOpticalFlow>();
+
+namespace
+{
+enum Method
+{
+  DIS_ULTRAFAST = 0,
+  DIS_FAST = 1,
+  DIS_MEDIUM = 2,
+  FARNEBACK = 3
+};
+
+#ifdef SOFACV_DIS_ENABLED
+cv::Ptr<cv::DenseOpticalFlow> createDIS(int preset)
+{
+#if CV_VERSION_MAJOR < 4
+  return cv::optflow::createOptFlow_DIS(preset);
+#else
+  return cv::DISOpticalFlow::create(preset);
+#endif
+}
+#endif  // SOFACV_DIS_ENABLED
+
+/// grayscale 'roi' of 'in', shrunk to 'size'. 'tmp' is a conversion buffer
+void toWorkingFrame(const cv::Mat& in, const cv::Rect& roi,
+                    const cv::Size& size, cv::Mat& tmp, cv::Mat& gray)
+{
+  const bool shrink = size != roi.size();
+  if (in.channels() == 1)
+    tmp = in(roi);
+  else
+    cv::cvtColor(in(roi), shrink ? tmp : gray, CV_BGRA2GRAY);
+
+  if (shrink)
+    cv::resize(tmp, gray, size, 0, 0, cv::INTER_AREA);
+  else if (in.channels() == 1)
+    tmp.copyTo(gray);  // the input buffer may be reused upstream
+}
+
+}  // namespace
+
+DenseOpticalFlow::DenseOpticalFlow()
+    : d_img2(initData(&d_img2, "img2",
+                      "previous frame to compute the flow from (do not set "
+                      "to compute the flow between 2 simulation steps)")),
+      d_method(initData(&d_method, "method",
+                        "flow algorithm (DIS_ULTRAFAST, DIS_FAST, DIS_MEDIUM, "
+                        "FARNEBACK). DIS needs OpenCV 4 or opencv_contrib")),
+      d_roi(initData(&d_roi, "roi",
+                     "x, y, w, h of the region of the frames where the flow "
+                     "is computed (whole frames if w or h is 0)")),
+      d_mask(initData(&d_mask, "mask",
+                      "(optional) 8 bit mask of the input frame's size: the "
+                      "flow is set to 0 where it is 0")),
+      d_downscale(initData(&d_downscale, 1.0, "downscale",
+                           "factor by which the frames are shrunk before "
+                           "computing the flow (>= 1)")),
+      d_warmStart(initData(&d_warmStart, true, "warm_start",
+                           "start each computation from the previous flow "
+                           "field")),
+      d_flow(initData(&d_flow, "flow",
+                      "CV_32FC2 displacement of each pixel of the previous "
+                      "frame, in full resolution pixels",
+                      false, true)),
+      m_method(-1)
+{
+  sofa::helper::OptionsGroup* t = d_method.beginEdit();
+#ifdef SOFACV_DIS_ENABLED
+  t->setNames(4, "DIS_ULTRAFAST", "DIS_FAST", "DIS_MEDIUM", "FARNEBACK");
+  t->setSelectedItem("DIS_FAST");
+#else
+  t->setNames(1, "FARNEBACK");
+  t->setSelectedItem("FARNEBACK");
+#endif
+  d_method.endEdit();
+
+  addAlias(&d_flow, "flow_out");
+}
+
+void DenseOpticalFlow::init()
+{
+  registerData(&d_method);
+  registerData(&d_downscale, 1.0, 8.0, 0.5);
+  registerData(&d_warmStart);
+
+  addInput(&d_img2);
+  addInput(&d_mask, true);
+  addOutput(&d_flow);
+  ImageFilter::init();
+}
+
+void DenseOpticalFlow::updateAlgorithm()
+{
+#ifdef SOFACV_DIS_ENABLED
+  const int method = int(d_method.getValue().getSelectedId());
+#else
+  const int method = FARNEBACK;  // the only method listed
+#endif
+  if (method != m_method || !m_algorithm)
+  {
+    m_method = method;
+#ifdef SOFACV_DIS_ENABLED
+    if (method != FARNEBACK)
+      m_algorithm = createDIS(method);
+    else
+#endif
+      m_algorithm = cv::FarnebackOpticalFlow::create();
+    m_flow.release();
+  }
+}
+
+void DenseOpticalFlow::applyFilter(const cv::Mat& in, cv::Mat& out, bool)
+{
+  if (in.empty()) return;
+
+  const cv::Rect frame(0, 0, in.cols, in.rows);
+  cv::Rect roi = frame;
+  const sofa::defaulttype::Vec4i& r = d_roi.getValue();
+  if (r[2] > 0 && r[3] > 0) roi = cv::Rect(r[0], r[1], r[2], r[3]) & frame;
+  if (roi.area() == 0) return;
+
+  const double downscale = std::max(1.0, d_downscale.getValue());
+  const cv::Size size(std::max(1, cvRound(roi.width / downscale)),
+                      std::max(1, cvRound(roi.height / downscale)));
+  if (roi != m_roi || size != m_size)
+  {
+    // the previous frame and flow do not cover the same area anymore
+    m_prev.release();
+    m_flow.release();
+    m_roi = roi;
+    m_size = size;
+  }
+
+  // grayscale conversion first, so that only one channel is resized
+  toWorkingFrame(in, roi, size, m_tmp, m_gray);
+
+  if (d_img2.isSet() && !d_img2.getValue().empty())
+  {
+    const cv::Mat& in2 = d_img2.getValue();
+    if (in2.size() != in.size())
+    {
+      msg_error(getName() + "::update()")
+          << "Error: img2 must have the same size as the input frame";
+      return;
+    }
+    toWorkingFrame(in2, roi, size, m_tmp, m_prev);
+  }
+
+  // the flow field is written straight into its output
+  cvMat& flowOut = *d_flow.beginWriteOnly();
+  utils::releaseIfShared(flowOut);
+  flowOut.create(in.size(), CV_32FC2);
+  flowOut.setTo(cv::Scalar::all(0));
+
+  if (!m_prev.empty())
+  {
+    updateAlgorithm();
+    if (!d_warmStart.getValue() || m_flow.size() != size) m_flow.release();
+    // DIS starts from the flow field whenever it holds one of the frames'
+    // size, Farneback only when told to
+    if (m_method == FARNEBACK)
+      m_algorithm.dynamicCast<cv::FarnebackOpticalFlow>()->setFlags(
+          m_flow.empty() ? 0 : cv::OPTFLOW_USE_INITIAL_FLOW);
+    m_algorithm->calc(m_prev, m_gray, m_flow);
+
+    // the roi header is filled in place, with vectors in full resolution
+    // pixels
+    cv::Mat flow = flowOut(roi);
+    if (size != roi.size())
+    {
+      cv::resize(m_flow, flow, roi.size(), 0, 0, cv::INTER_LINEAR);
+      cv::multiply(flow,
+                   cv::Scalar(double(roi.width) / size.width,
+                              double(roi.height) / size.height),
+                   flow);
+    }
+    else
+      m_flow.copyTo(flow);
+
+    const cv::Mat& mask = d_mask.getValue();
+    if (!mask.empty() && mask.size() == in.size())
+    {
+      cv::compare(mask, 0, m_invalid, cv::CMP_EQ);
+      flowOut.setTo(cv::Scalar::all(0), m_invalid);
+    }
+  }
+  d_flow.endEdit();
+  cv::swap(m_prev, m_gray);
+
+  if (!d_outputImage.getValue())
+  {
+    in.copyTo(out);
+    return;
+  }
+  // flow direction as hue, magnitude as value
+  std::vector<cv::Mat> xy, hsv(3);
+  cv::split(flowOut, xy);
+  cv::Mat magnitude, angle;
+  cv::cartToPolar(xy[0], xy[1], magnitude, angle, true);
+  angle.convertTo(hsv[0], CV_8U, 0.5);
+  hsv[1] = cv::Mat(in.size(), CV_8U, cv::Scalar(255));
+  cv::normalize(magnitude, magnitude, 0, 255, cv::NORM_MINMAX);
+  magnitude.convertTo(hsv[2], CV_8U);
+  cv::merge(hsv, out);
+  cv::cvtColor(out, out, cv::COLOR_HSV2BGR);
+}
+
+}  // namespace features
+}  // namespace sofacv
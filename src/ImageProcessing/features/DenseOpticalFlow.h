@@ -0,0 +1,73 @@
+#ifndef SOFACV_FEATURES_DENSEOPTICALFLOW_H
+#define SOFACV_FEATURES_DENSEOPTICALFLOW_H
+
+#include "ImageProcessingPlugin.h"
+
+#include <SofaCV/SofaCV.h>
+
+#include <sofa/defaulttype/Vec.h>
+#include <sofa/helper/OptionsGroup.h>
+
+#include <opencv2/video.hpp>
+
+namespace sofacv
+{
+namespace features
+{
+/**
+ * @brief The DenseOpticalFlow class
+ *
+ * Computes the motion of every pixel between the previous step's frame (or
+ * img2, if set) and the input frame, with DIS (dense inverse search, in one
+ * of its ultrafast / fast / medium presets) or Farnebäck's algorithm. DIS is
+ * only available with OpenCV 4, or OpenCV 3 built with opencv_contrib.
+ *
+ * The flow can be restricted to a region of interest and computed on
+ * downscaled frames. It is output as a CV_32FC2 map the size of the input
+ * frame, holding for each pixel of the previous frame its (dx, dy)
+ * displacement in full resolution pixels, and 0 outside of the roi or mask.
+ * Unless warm_start is off, each computation starts from the previous flow
+ * field, which converges faster for smooth motions.
+ */
+class SOFA_IMAGEPROCESSING_API DenseOpticalFlow : public ImageFilter
+{
+ public:
+  SOFA_CLASS(DenseOpticalFlow, ImageFilter);
+
+  DenseOpticalFlow();
+
+  void init() override;
+  void applyFilter(const cv::Mat& in, cv::Mat& out, bool) override;
+
+  // INPUTS
+  sofa::Data<cvMat> d_img2;  ///< [INPUT] previous frame (default: last step's)
+  sofa::Data<sofa::helper::OptionsGroup> d_method;  ///< DIS preset, FARNEBACK
+  sofa::Data<sofa::defaulttype::Vec4i> d_roi;  ///< x, y, w, h (0: whole frame)
+  sofa::Data<cvMat> d_mask;   ///< [INPUT] 8 bit mask of the flow to keep
+  sofa::Data<double> d_downscale;  ///< frames are shrunk by this factor
+  sofa::Data<bool> d_warmStart;    ///< start from the previous flow field
+
+  // OUTPUTS
+  sofa::Data<cvMat> d_flow;  ///< [OUTPUT] CV_32FC2 flow field
+
+ private:
+  /// (re)creates the flow algorithm if the method changed
+  void updateAlgorithm();
+
+  cv::Ptr<cv::DenseOpticalFlow> m_algorithm;
+  int m_method;
+
+  cv::Mat m_prev;  ///< previous grayscale frame, at the working resolution
+  cv::Mat m_gray;  ///< current grayscale frame, at the working resolution
+  cv::Mat m_tmp;   ///< grayscale conversion buffer
+  cv::Mat m_flow;  ///< flow field at the working resolution
+  cv::Mat m_invalid;  ///< pixels outside of the mask
+
+  // working area of m_prev and m_flow: they are dropped when it changes
+  cv::Rect m_roi;
+  cv::Size m_size;
+};
+
+}  // namespace features
+}  // namespace sofacv
+#endif  // SOFACV_FEATURES_DENSEOPTICALFLOW_H
@@ -16,7 +16,8 @@ int DescriptorMatcherClass =
 
 DescriptorMatcher::DescriptorMatcher()
     : d_matcherType(initData(&d_matcherType, "matcher",
-                             "type of matcher to use (BRUTEFORCE or FLANN).")),
+                             "type of matcher to use (BRUTEFORCE, FLANN, or "
+                             "HAMMING for binary descriptors).")),
       d_matchingAlgo(initData(&d_matchingAlgo, "algo",
                               "matching algorithm to use (STANDARD, KNN_MATCH"
                               ", RADIUS_MATCH).")),
@@ -34,6 +35,19 @@ DescriptorMatcher::DescriptorMatcher()
       d_mask(initData(&d_mask, cvMat(), "mask",
                       "Mask specifying permissible matches between an input "
                       "query and train matrices of descriptors.")),
+      d_staticTrainSet(
+          initData(&d_staticTrainSet, false, "staticTrainSet",
+                   "if true, the matcher is trained once on descriptors2 "
+                   "(e.g. a reference model) and only serves queries until "
+                   "descriptors2 changes, instead of building its index on "
+                   "every frame")),
+      d_parallel(initData(&d_parallel, false, "parallel",
+                          "if true, query descriptors are split in chunks "
+                          "matched concurrently. Matches are output in the "
+                          "same order as in single-threaded mode")),
+      d_chunkSize(initData(&d_chunkSize, 512, "chunkSize",
+                           "number of query descriptors per chunk in parallel "
+                           "mode")),
       d_queryDescriptors(initData(&d_queryDescriptors, "descriptors1",
                                   "Query set of descriptors", false)),
       d_trainDescriptors(initData(&d_trainDescriptors, "descriptors2",
@@ -43,12 +57,18 @@ DescriptorMatcher::DescriptorMatcher()
                        "left image's keypoints, for debug", false)),
       d_kptsR(initData(&d_kptsR, "keypoints2",
                        "right image's keypoints, for debug", false)),
-      d_matches(initData(&d_matches, "matches", "output array of matches", true,
-                         true))
+      d_matches(initData(&d_matches, "matches",
+                         "output array of matches, as one vector per query "
+                         "descriptor. Prefer matchSet",
+                         true, true)),
+      d_matchSet(initData(&d_matchSet, "matchSet",
+                          "output matches, stored contiguously", true, true)),
+      m_trainCounter(-1)
 {
   addAlias(&d_matches, "matches_out");
+  addAlias(&d_matchSet, "matchSet_out");
   sofa::helper::OptionsGroup* t = d_matcherType.beginEdit();
-  t->setNames(MatcherType_COUNT, "FLANN", "BRUTEFORCE");
+  t->setNames(MatcherType_COUNT, "FLANN", "BRUTEFORCE", "HAMMING");
   t->setSelectedItem(0);
   d_matcherType.endEdit();
 
@@ -59,6 +79,7 @@ DescriptorMatcher::DescriptorMatcher()
 
   m_matchers[FLANN] = new FlannMatcher(this);
   m_matchers[BRUTEFORCE] = new BFMatcher(this);
+  m_matchers[HAMMING] = new HammingMatcher(this);
 }
 
 DescriptorMatcher::~DescriptorMatcher() {}
@@ -78,9 +99,13 @@ void DescriptorMatcher::init()
   addInput(&d_kptsL, true);
   addInput(&d_kptsR, true);
   addInput(&d_mask, true);
+  addInput(&d_staticTrainSet);
+  addInput(&d_parallel);
+  addInput(&d_chunkSize);
 
   addOutput(&d_img_out);
   addOutput(&d_matches);
+  addOutput(&d_matchSet);
   ImageFilter::init();
 }
 
@@ -94,6 +119,11 @@ void DescriptorMatcher::doUpdate()
       << "Error: Empty descriptor matrix!";
   ImageFilter::doUpdate();
 
+  d_matchSet.beginWriteOnly()->assign(m_matches);
+  d_matchSet.endEdit();
+
+  // one vector per query descriptor, as before matchSet was added: it is
+  // filled on every update, as it may be read without any link to it
   sofa::helper::SVector<sofa::helper::SVector<cvDMatch> >* vec =
       d_matches.beginWriteOnly();
   vec->clear();
@@ -102,7 +132,8 @@ void DescriptorMatcher::doUpdate()
     for (std::vector<cv::DMatch>& matchVec : m_matches)
     {
       vec->push_back(sofa::helper::SVector<cvDMatch>());
-      for (cv::DMatch& match : matchVec) vec->back().push_back(cvDMatch(match));
+      for (cv::DMatch& match : matchVec)
+        vec->back().push_back(cvDMatch(match));
     }
   }
   d_matches.endEdit();
@@ -133,11 +164,23 @@ void DescriptorMatcher::applyFilter(const cv::Mat& in, cv::Mat& out, bool)
     return;
   }
 
+  m_matchers[m]->setChunkSize(
+      (d_parallel.getValue()) ? (std::max(1, d_chunkSize.getValue())) : (0));
+
+  bool staticTrainSet = d_staticTrainSet.getValue();
+  if (staticTrainSet) updateTrainSet(m_matchers[m]);
+
   m_matches.clear();
   if (d_matchingAlgo.getValue().getSelectedId() == STANDARD_MATCH)
-    m_matchers[m]->knnMatch(d_queryDescriptors.getValue(),
-                            d_trainDescriptors.getValue(), m_matches, 1,
-                            d_mask.getValue());
+  {
+    if (staticTrainSet)
+      m_matchers[m]->knnMatch(d_queryDescriptors.getValue(), m_matches, 1,
+                              d_mask.getValue());
+    else
+      m_matchers[m]->knnMatch(d_queryDescriptors.getValue(),
+                              d_trainDescriptors.getValue(), m_matches, 1,
+                              d_mask.getValue());
+  }
   else if (d_matchingAlgo.getValue().getSelectedId() == KNN_MATCH)
   {
     int k = d_k.getValue();
@@ -145,14 +188,24 @@ void DescriptorMatcher::applyFilter(const cv::Mat& in, cv::Mat& out, bool)
                      d_trainDescriptors.getValue().size[0]);
     if (k > n || k == -1) k = n;
 
-    m_matchers[m]->knnMatch(d_queryDescriptors.getValue(),
-                            d_trainDescriptors.getValue(), m_matches, k,
-                            d_mask.getValue());
+    if (staticTrainSet)
+      m_matchers[m]->knnMatch(d_queryDescriptors.getValue(), m_matches, k,
+                              d_mask.getValue());
+    else
+      m_matchers[m]->knnMatch(d_queryDescriptors.getValue(),
+                              d_trainDescriptors.getValue(), m_matches, k,
+                              d_mask.getValue());
   }
   else if (d_matchingAlgo.getValue().getSelectedId() == RADIUS_MATCH)
-    m_matchers[m]->radiusMatch(d_queryDescriptors.getValue(),
-                               d_trainDescriptors.getValue(), m_matches,
-                               d_maxDistance.getValue(), d_mask.getValue());
+  {
+    if (staticTrainSet)
+      m_matchers[m]->radiusMatch(d_queryDescriptors.getValue(), m_matches,
+                                 d_maxDistance.getValue(), d_mask.getValue());
+    else
+      m_matchers[m]->radiusMatch(d_queryDescriptors.getValue(),
+                                 d_trainDescriptors.getValue(), m_matches,
+                                 d_maxDistance.getValue(), d_mask.getValue());
+  }
 
   if (d_outputImage.getValue())
   {
@@ -171,6 +224,26 @@ void DescriptorMatcher::applyFilter(const cv::Mat& in, cv::Mat& out, bool)
   }
 }
 
+void DescriptorMatcher::updateTrainSet(BaseMatcher* matcher)
+{
+  if (matcher->isTrained() &&
+      d_trainDescriptors.getCounter() == m_trainCounter)
+    return;
+  m_trainCounter = d_trainDescriptors.getCounter();
+
+  // The Data may be set again with the very same descriptors (e.g. a static
+  // reference image re-processed every step): the index is only rebuilt when
+  // its content actually differs
+  const cvMat& train = d_trainDescriptors.getValue();
+  if (matcher->isTrained() && train.size() == m_trainSet.size() &&
+      train.type() == m_trainSet.type() &&
+      cv::norm(train, m_trainSet, cv::NORM_INF) == 0.0)
+    return;
+
+  m_trainSet = train.clone();
+  matcher->train(m_trainSet);
+}
+
 void DescriptorMatcher::matcherTypeChanged()
 {
   for (size_t i = 0; i < MatcherType_COUNT; ++i)
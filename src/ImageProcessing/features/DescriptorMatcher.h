@@ -2,6 +2,7 @@
 #define SOFA_OR_PROCESSOR_DESCRIPTORMATCHER_H
 
 #include "ImageProcessingPlugin.h"
+#include "MatchSet.h"
 #include "Matchers.h"
 
 #include <SofaCV/SofaCV.h>
@@ -21,6 +22,7 @@ class SOFA_IMAGEPROCESSING_API DescriptorMatcher : public ImageFilter
   {
     FLANN = 0,
     BRUTEFORCE = 1,
+    HAMMING = 2,
     MatcherType_COUNT
   };
 
@@ -47,6 +49,9 @@ class SOFA_IMAGEPROCESSING_API DescriptorMatcher : public ImageFilter
   sofa::Data<int> d_k;
   sofa::Data<float> d_maxDistance;
   sofa::Data<cvMat> d_mask;
+  sofa::Data<bool> d_staticTrainSet;
+  sofa::Data<bool> d_parallel;
+  sofa::Data<int> d_chunkSize;
 
   sofa::Data<cvMat> d_queryDescriptors;
   sofa::Data<cvMat> d_trainDescriptors;
@@ -57,6 +62,7 @@ class SOFA_IMAGEPROCESSING_API DescriptorMatcher : public ImageFilter
 
   sofa::Data<sofa::helper::SVector<sofa::helper::SVector<cvDMatch> > >
       d_matches;
+  sofa::Data<MatchSet> d_matchSet;
 
   void match(const cvMat& queryDescriptors, std::vector<cv::DMatch>& matches);
   void knnMatch(const cvMat& queryDescriptors,
@@ -67,10 +73,16 @@ class SOFA_IMAGEPROCESSING_API DescriptorMatcher : public ImageFilter
 
  protected:
   void matcherTypeChanged();
+  /// (re)trains the matcher when the train descriptors changed, in static
+  /// train set mode
+  void updateTrainSet(BaseMatcher* matcher);
 
  private:
   BaseMatcher* m_matchers[MatcherType_COUNT];
   std::vector<std::vector<cv::DMatch> > m_matches;
+
+  cvMat m_trainSet;  ///< copy of the descriptors the matcher was trained on
+  int m_trainCounter;
 };
 
 }  // namespace features
@@ -5,6 +5,21 @@ namespace sofacv
 namespace features
 {
 BaseDetector::~BaseDetector() {}
+
+void BaseDetector::update()
+{
+  if (!m_detector)
+    create();
+  else if (m_tracker.isDirty())
+  {
+    if (needsRebuild())
+      create();
+    else
+      applyParams();
+  }
+  m_tracker.clean();
+}
+
 void BaseDetector::detect(const cvMat &img, const cvMat &mask,
                           std::vector<cv::KeyPoint> &keypoints)
 {
@@ -98,7 +113,23 @@ void SimpleBlobDetector::enable(bool show)
   minInertiaRatio.setDisplayed(show);
 }
 
-void SimpleBlobDetector::init() {}
+void SimpleBlobDetector::init()
+{
+  m_tracker.trackData(thresholdStep);
+  m_tracker.trackData(minThreshold);
+  m_tracker.trackData(maxThreshold);
+  m_tracker.trackData(minDistBetweenBlobs);
+  m_tracker.trackData(filterByColor);
+  m_tracker.trackData(blobColor);
+  m_tracker.trackData(filterByArea);
+  m_tracker.trackData(minArea);
+  m_tracker.trackData(filterByCircularity);
+  m_tracker.trackData(minCircularity);
+  m_tracker.trackData(filterByConvexity);
+  m_tracker.trackData(minConvexity);
+  m_tracker.trackData(filterByInertia);
+  m_tracker.trackData(minInertiaRatio);
+}
 
 void SimpleBlobDetector::registerData(ImageFilter *parent)
 {
@@ -119,8 +150,7 @@ void SimpleBlobDetector::registerData(ImageFilter *parent)
   parent->registerData(&minInertiaRatio, 0.0, 1.0, 0.01);
 }
 
-void SimpleBlobDetector::detect(const cvMat &img, const cvMat &mask,
-                                std::vector<cv::KeyPoint> &keypoints)
+void SimpleBlobDetector::create()
 {
   // Setup SimpleBlobDetector parameters.
   cv::SimpleBlobDetector::Params params;
@@ -153,25 +183,8 @@ void SimpleBlobDetector::detect(const cvMat &img, const cvMat &mask,
   params.filterByInertia = filterByInertia.getValue();
   params.minInertiaRatio = minInertiaRatio.getValue();
 
-#if CV_MAJOR_VERSION < 3  // If you are using OpenCV 2
-
-  // Set up detector with params
-  cv::SimpleBlobDetector detector(params);
-
-  // You can use the detector this way
-  detector.detect(img, keypoints);
-
-#else
-
-  // Set up detector with params
-  cv::Ptr<cv::SimpleBlobDetector> detector =
-      cv::SimpleBlobDetector::create(params);
-
-  // SimpleBlobDetector::create creates a smart pointer.
-  // So you need to use arrow ( ->) instead of dot ( . )
-  detector->detect(img, keypoints, mask);
-
-#endif
+  // cv::SimpleBlobDetector has no setters: any parameter change rebuilds it
+  m_detector = cv::SimpleBlobDetector::create(params);
 }
 
 void SimpleBlobDetector::compute(const cvMat &, std::vector<cv::KeyPoint> &,
@@ -273,7 +286,30 @@ FASTDetector::FASTDetector(sofa::core::DataEngine *c)
   type.endEdit();
 }
 
-void FASTDetector::init() {}
+void FASTDetector::init()
+{
+  m_tracker.trackData(threshold);
+  m_tracker.trackData(nonmaxsuppression);
+  m_tracker.trackData(type);
+}
+
+void FASTDetector::create()
+{
+  m_detector = cv::FastFeatureDetector::create(
+      threshold.getValue(), nonmaxsuppression.getValue(),
+      int(type.getValue().getSelectedId()));
+}
+
+bool FASTDetector::needsRebuild() { return false; }
+
+void FASTDetector::applyParams()
+{
+  cv::Ptr<cv::FastFeatureDetector> fast =
+      m_detector.dynamicCast<cv::FastFeatureDetector>();
+  fast->setThreshold(threshold.getValue());
+  fast->setNonmaxSuppression(nonmaxsuppression.getValue());
+  fast->setType(int(type.getValue().getSelectedId()));
+}
 
 void FASTDetector::registerData(ImageFilter *parent)
 {
@@ -300,9 +336,6 @@ void FASTDetector::enable(bool show)
 {
   if (show)
   {
-    m_detector = cv::FastFeatureDetector::create(
-        threshold.getValue(), nonmaxsuppression.getValue(),
-        int(type.getValue().getSelectedId()));
     m_obj->addInput(&threshold);
     m_obj->addInput(&nonmaxsuppression);
     m_obj->addInput(&type);
@@ -349,11 +382,6 @@ void MSERDetector::enable(bool show)
 {
   if (show)
   {
-    m_detector = cv::MSER::create(
-        delta.getValue(), minArea.getValue(), maxArea.getValue(),
-        double(maxVariation.getValue()), double(minDiversity.getValue()),
-        maxEvolution.getValue(), areaThreshold.getValue(), minMargin.getValue(),
-        edgeBlurSize.getValue());
     m_obj->addInput(&delta);
     m_obj->addInput(&minArea);
     m_obj->addInput(&maxArea);
@@ -387,7 +415,45 @@ void MSERDetector::enable(bool show)
   edgeBlurSize.setDisplayed(show);
 }
 
-void MSERDetector::init() {}
+void MSERDetector::init()
+{
+  m_tracker.trackData(delta);
+  m_tracker.trackData(minArea);
+  m_tracker.trackData(maxArea);
+  m_tracker.trackData(maxVariation);
+  m_tracker.trackData(minDiversity);
+  m_tracker.trackData(maxEvolution);
+  m_tracker.trackData(areaThreshold);
+  m_tracker.trackData(minMargin);
+  m_tracker.trackData(edgeBlurSize);
+}
+
+void MSERDetector::create()
+{
+  m_detector = cv::MSER::create(
+      delta.getValue(), minArea.getValue(), maxArea.getValue(),
+      double(maxVariation.getValue()), double(minDiversity.getValue()),
+      maxEvolution.getValue(), areaThreshold.getValue(), minMargin.getValue(),
+      edgeBlurSize.getValue());
+}
+
+bool MSERDetector::needsRebuild()
+{
+  // only delta and the area bounds can be set on an existing cv::MSER
+  return m_tracker.hasChanged(maxVariation) ||
+         m_tracker.hasChanged(minDiversity) ||
+         m_tracker.hasChanged(maxEvolution) ||
+         m_tracker.hasChanged(areaThreshold) ||
+         m_tracker.hasChanged(minMargin) || m_tracker.hasChanged(edgeBlurSize);
+}
+
+void MSERDetector::applyParams()
+{
+  cv::Ptr<cv::MSER> mser = m_detector.dynamicCast<cv::MSER>();
+  mser->setDelta(delta.getValue());
+  mser->setMinArea(minArea.getValue());
+  mser->setMaxArea(maxArea.getValue());
+}
 
 void MSERDetector::registerData(ImageFilter *parent)
 {
@@ -449,7 +515,44 @@ ORBDetector::ORBDetector(sofa::core::DataEngine *c)
   scoreType.endEdit();
 }
 
-void ORBDetector::init() {}
+void ORBDetector::init()
+{
+  m_tracker.trackData(nFeatures);
+  m_tracker.trackData(scaleFactor);
+  m_tracker.trackData(nLevels);
+  m_tracker.trackData(edgeThreshold);
+  m_tracker.trackData(firstLevel);
+  m_tracker.trackData(WTA_K);
+  m_tracker.trackData(scoreType);
+  m_tracker.trackData(patchSize);
+  m_tracker.trackData(fastThreshold);
+}
+
+void ORBDetector::create()
+{
+  m_detector = cv::ORB::create(
+      nFeatures.getValue(), scaleFactor.getValue(), nLevels.getValue(),
+      edgeThreshold.getValue(), firstLevel.getValue(), WTA_K.getValue(),
+      int(scoreType.getValue().getSelectedId()), patchSize.getValue(),
+      fastThreshold.getValue());
+}
+
+bool ORBDetector::needsRebuild()
+{
+  // the pyramid layout and the descriptor's pattern are structural
+  return m_tracker.hasChanged(nLevels) || m_tracker.hasChanged(firstLevel) ||
+         m_tracker.hasChanged(WTA_K) || m_tracker.hasChanged(patchSize);
+}
+
+void ORBDetector::applyParams()
+{
+  cv::Ptr<cv::ORB> orb = m_detector.dynamicCast<cv::ORB>();
+  orb->setMaxFeatures(nFeatures.getValue());
+  orb->setScaleFactor(double(scaleFactor.getValue()));
+  orb->setEdgeThreshold(edgeThreshold.getValue());
+  orb->setScoreType(int(scoreType.getValue().getSelectedId()));
+  orb->setFastThreshold(fastThreshold.getValue());
+}
 
 void ORBDetector::registerData(ImageFilter *)
 {
@@ -460,11 +563,6 @@ void ORBDetector::enable(bool show)
 {
   if (show)
   {
-    m_detector = cv::ORB::create(
-        nFeatures.getValue(), scaleFactor.getValue(), nLevels.getValue(),
-        edgeThreshold.getValue(), firstLevel.getValue(), WTA_K.getValue(),
-        int(scoreType.getValue().getSelectedId()), patchSize.getValue(),
-        fastThreshold.getValue());
     m_obj->addInput(&nFeatures);
     m_obj->addInput(&scaleFactor);
     m_obj->addInput(&nLevels);
@@ -509,7 +607,18 @@ BRISKDetector::BRISKDetector(sofa::core::DataEngine *c)
                                 "sampling the neighbourhood of a keypoint."))
 {
 }
-void BRISKDetector::init() {}
+void BRISKDetector::init()
+{
+  m_tracker.trackData(threshold);
+  m_tracker.trackData(octaves);
+  m_tracker.trackData(npatternScale);
+}
+
+void BRISKDetector::create()
+{
+  m_detector = cv::BRISK::create(threshold.getValue(), octaves.getValue(),
+                                 npatternScale.getValue());
+}
 
 void BRISKDetector::registerData(ImageFilter *)
 {
@@ -520,8 +629,6 @@ void BRISKDetector::enable(bool show)
 {
   if (show)
   {
-    m_detector = cv::BRISK::create(threshold.getValue(), octaves.getValue(),
-                                   npatternScale.getValue());
     m_obj->addInput(&threshold);
     m_obj->addInput(&octaves);
     m_obj->addInput(&npatternScale);
@@ -562,7 +669,37 @@ KAZEDetector::KAZEDetector(sofa::core::DataEngine *c)
   diffusivity.endEdit();
 }
 
-void KAZEDetector::init() {}
+void KAZEDetector::init()
+{
+  m_tracker.trackData(extended);
+  m_tracker.trackData(upright);
+  m_tracker.trackData(threshold);
+  m_tracker.trackData(octaves);
+  m_tracker.trackData(sublevels);
+  m_tracker.trackData(diffusivity);
+}
+
+void KAZEDetector::create()
+{
+  m_detector = cv::KAZE::create(extended.getValue(), upright.getValue(),
+                                threshold.getValue(), octaves.getValue(),
+                                sublevels.getValue(),
+                                int(diffusivity.getValue().getSelectedId()));
+}
+
+bool KAZEDetector::needsRebuild()
+{
+  return m_tracker.hasChanged(octaves) || m_tracker.hasChanged(sublevels);
+}
+
+void KAZEDetector::applyParams()
+{
+  cv::Ptr<cv::KAZE> kaze = m_detector.dynamicCast<cv::KAZE>();
+  kaze->setExtended(extended.getValue());
+  kaze->setUpright(upright.getValue());
+  kaze->setThreshold(double(threshold.getValue()));
+  kaze->setDiffusivity(int(diffusivity.getValue().getSelectedId()));
+}
 
 void KAZEDetector::registerData(ImageFilter *)
 {
@@ -572,10 +709,6 @@ void KAZEDetector::enable(bool show)
 {
   if (show)
   {
-    m_detector = cv::KAZE::create(extended.getValue(), upright.getValue(),
-                                  threshold.getValue(), octaves.getValue(),
-                                  sublevels.getValue(),
-                                  int(diffusivity.getValue().getSelectedId()));
     m_obj->addInput(&extended);
     m_obj->addInput(&upright);
     m_obj->addInput(&threshold);
@@ -637,7 +770,42 @@ AKAZEDetector::AKAZEDetector(sofa::core::DataEngine *c)
   diffusivity.endEdit();
 }
 
-void AKAZEDetector::init() {}
+void AKAZEDetector::init()
+{
+  m_tracker.trackData(descriptorType);
+  m_tracker.trackData(descriptorSize);
+  m_tracker.trackData(descriptorChannels);
+  m_tracker.trackData(threshold);
+  m_tracker.trackData(octaves);
+  m_tracker.trackData(sublevels);
+  m_tracker.trackData(diffusivity);
+}
+
+void AKAZEDetector::create()
+{
+  m_detector = cv::AKAZE::create(
+      int(descriptorType.getValue().getSelectedId()),
+      descriptorSize.getValue(), descriptorChannels.getValue(),
+      threshold.getValue(), octaves.getValue(), sublevels.getValue(),
+      int(diffusivity.getValue().getSelectedId()));
+}
+
+bool AKAZEDetector::needsRebuild()
+{
+  // everything but the detector's threshold and diffusivity changes either
+  // the scale space or the descriptor's layout
+  return m_tracker.hasChanged(descriptorType) ||
+         m_tracker.hasChanged(descriptorSize) ||
+         m_tracker.hasChanged(descriptorChannels) ||
+         m_tracker.hasChanged(octaves) || m_tracker.hasChanged(sublevels);
+}
+
+void AKAZEDetector::applyParams()
+{
+  cv::Ptr<cv::AKAZE> akaze = m_detector.dynamicCast<cv::AKAZE>();
+  akaze->setThreshold(double(threshold.getValue()));
+  akaze->setDiffusivity(int(diffusivity.getValue().getSelectedId()));
+}
 
 void AKAZEDetector::registerData(ImageFilter *)
 {
@@ -647,11 +815,6 @@ void AKAZEDetector::enable(bool show)
 {
   if (show)
   {
-    m_detector = cv::AKAZE::create(
-        int(descriptorType.getValue().getSelectedId()),
-        descriptorSize.getValue(), descriptorChannels.getValue(),
-        threshold.getValue(), octaves.getValue(), sublevels.getValue(),
-        int(diffusivity.getValue().getSelectedId()));
     m_obj->addInput(&descriptorType);
     m_obj->addInput(&descriptorSize);
     m_obj->addInput(&descriptorChannels);
@@ -693,7 +856,17 @@ BRIEFDetector::BRIEFDetector(sofa::core::DataEngine *c)
 {
 }
 
-void BRIEFDetector::init() {}
+void BRIEFDetector::init()
+{
+  m_tracker.trackData(bytes);
+  m_tracker.trackData(use_orientation);
+}
+
+void BRIEFDetector::create()
+{
+  m_detector = cv::xfeatures2d::BriefDescriptorExtractor::create(
+      bytes.getValue(), use_orientation.getValue());
+}
 
 void BRIEFDetector::registerData(ImageFilter *)
 {
@@ -718,8 +891,6 @@ void BRIEFDetector::enable(bool show)
 {
   if (show)
   {
-    m_detector = cv::xfeatures2d::BriefDescriptorExtractor::create(
-        bytes.getValue(), use_orientation.getValue());
     m_obj->addInput(&bytes);
     m_obj->addInput(&use_orientation);
   }
@@ -764,7 +935,22 @@ SIFTDetector::SIFTDetector(sofa::core::DataEngine *c)
 {
 }
 
-void SIFTDetector::init() {}
+void SIFTDetector::init()
+{
+  m_tracker.trackData(nFeatures);
+  m_tracker.trackData(nOctaveLayers);
+  m_tracker.trackData(contrastThreshold);
+  m_tracker.trackData(edgeThreshold);
+  m_tracker.trackData(sigma);
+}
+
+void SIFTDetector::create()
+{
+  m_detector = cv::xfeatures2d::SIFT::create(
+      nFeatures.getValue(), nOctaveLayers.getValue(),
+      contrastThreshold.getValue(), edgeThreshold.getValue(),
+      sigma.getValue());
+}
 
 void SIFTDetector::registerData(ImageFilter *)
 {
@@ -774,10 +960,6 @@ void SIFTDetector::enable(bool show)
 {
   if (show)
   {
-    m_detector = cv::xfeatures2d::SIFT::create(
-        nFeatures.getValue(), nOctaveLayers.getValue(),
-        contrastThreshold.getValue(), edgeThreshold.getValue(),
-        sigma.getValue());
     m_obj->addInput(&nFeatures);
     m_obj->addInput(&nOctaveLayers);
     m_obj->addInput(&contrastThreshold);
@@ -835,7 +1017,35 @@ SURFDetector::SURFDetector(sofa::core::DataEngine *c)
 {
 }
 
-void SURFDetector::init() {}
+void SURFDetector::init()
+{
+  m_tracker.trackData(threshold);
+  m_tracker.trackData(nOctaves);
+  m_tracker.trackData(nOctaveLayers);
+  m_tracker.trackData(extended);
+  m_tracker.trackData(upright);
+}
+
+void SURFDetector::create()
+{
+  m_detector = cv::xfeatures2d::SURF::create(
+      threshold.getValue(), nOctaves.getValue(), nOctaveLayers.getValue(),
+      extended.getValue(), upright.getValue());
+}
+
+bool SURFDetector::needsRebuild()
+{
+  return m_tracker.hasChanged(nOctaves) || m_tracker.hasChanged(nOctaveLayers);
+}
+
+void SURFDetector::applyParams()
+{
+  cv::Ptr<cv::xfeatures2d::SURF> surf =
+      m_detector.dynamicCast<cv::xfeatures2d::SURF>();
+  surf->setHessianThreshold(threshold.getValue());
+  surf->setExtended(extended.getValue());
+  surf->setUpright(upright.getValue());
+}
 
 void SURFDetector::registerData(ImageFilter *)
 {
@@ -845,9 +1055,6 @@ void SURFDetector::enable(bool show)
 {
   if (show)
   {
-    m_detector = cv::xfeatures2d::SURF::create(
-        threshold.getValue(), nOctaves.getValue(), nOctaveLayers.getValue(),
-        extended.getValue(), upright.getValue());
     m_obj->addInput(&threshold);
     m_obj->addInput(&nOctaves);
     m_obj->addInput(&nOctaveLayers);
@@ -906,7 +1113,25 @@ DAISYDetector::DAISYDetector(sofa::core::DataEngine *c)
   norm.endEdit();
 }
 
-void DAISYDetector::init() {}
+void DAISYDetector::init()
+{
+  m_tracker.trackData(radius);
+  m_tracker.trackData(q_radius);
+  m_tracker.trackData(q_theta);
+  m_tracker.trackData(q_hist);
+  m_tracker.trackData(norm);
+  m_tracker.trackData(H);
+  m_tracker.trackData(interpolation);
+  m_tracker.trackData(use_orientation);
+}
+
+void DAISYDetector::create()
+{
+  m_detector = cv::xfeatures2d::DAISY::create(
+      radius.getValue(), q_radius.getValue(), q_theta.getValue(),
+      q_hist.getValue(), int(norm.getValue().getSelectedId()), H.getValue(),
+      interpolation.getValue(), use_orientation.getValue());
+}
 
 void DAISYDetector::registerData(ImageFilter *)
 {
@@ -932,10 +1157,6 @@ void DAISYDetector::enable(bool show)
 {
   if (show)
   {
-    m_detector = cv::xfeatures2d::DAISY::create(
-        radius.getValue(), q_radius.getValue(), q_theta.getValue(),
-        q_hist.getValue(), int(norm.getValue().getSelectedId()), H.getValue(),
-        interpolation.getValue(), use_orientation.getValue());
     m_obj->addInput(&radius);
     m_obj->addInput(&q_radius);
     m_obj->addInput(&q_theta);
@@ -3,6 +3,7 @@
 
 #include <SofaCV/SofaCV.h>
 
+#include <sofa/core/DataTracker.h>
 #include <sofa/helper/OptionsGroup.h>
 #include <sofa/helper/vector.h>
 
@@ -28,14 +29,34 @@ struct BaseDetector
 
   virtual void registerData(ImageFilter* parent) = 0;
 
+  /// creates m_detector from the current parameter values
+  virtual void create() {}
+
+  /// brings m_detector up to date with its parameters before a frame is
+  /// processed: the detector is only rebuilt when a structural parameter
+  /// changed, and updated in place through its setters otherwise
+  void update();
+
+  /// whether the parameters changed since the last update() require
+  /// rebuilding the detector (all of them by default)
+  virtual bool needsRebuild() { return true; }
+
+  /// forwards the non-structural parameters to m_detector's setters
+  virtual void applyParams() {}
+
   virtual void detect(const cvMat&, const cvMat&, std::vector<cv::KeyPoint>&);
   virtual void compute(const cvMat&, std::vector<cv::KeyPoint>&, cvMat&);
   virtual void detectAndCompute(const cvMat&, const cvMat&,
                                 std::vector<cv::KeyPoint>&, cvMat&);
 
+  /// whether detect() can be called concurrently from several threads (used
+  /// by FeatureDetector's tiled mode)
+  virtual bool isReentrant() const { return true; }
+
  protected:
   cv::Ptr<cv::Feature2D> m_detector;
   sofa::core::DataEngine* m_obj;
+  sofa::core::DataTracker m_tracker;  ///< tracks the detector's parameters
 };
 
 struct SimpleBlobDetector : BaseDetector
@@ -45,9 +66,7 @@ struct SimpleBlobDetector : BaseDetector
   void init();
 
   virtual void registerData(ImageFilter* parent);
-
-  virtual void detect(const cvMat& img, const cvMat& mask,
-                      std::vector<cv::KeyPoint>& keypoints);
+  virtual void create();
 
   virtual void compute(const cvMat&, std::vector<cv::KeyPoint>&, cvMat&);
   virtual void detectAndCompute(const cvMat& img, const cvMat& mask,
@@ -94,6 +113,9 @@ struct FASTDetector : BaseDetector
   void enable(bool);
   void init();
   virtual void registerData(ImageFilter* parent);
+  virtual void create();
+  virtual bool needsRebuild();
+  virtual void applyParams();
   virtual void compute(const cvMat&, std::vector<cv::KeyPoint>&, cvMat&);
   virtual void detectAndCompute(const cvMat& img, const cvMat& mask,
                                 std::vector<cv::KeyPoint>& kpts, cvMat&);
@@ -108,11 +130,17 @@ struct MSERDetector : BaseDetector
   void enable(bool);
   void init();
   virtual void registerData(ImageFilter* parent);
+  virtual void create();
+  virtual bool needsRebuild();
+  virtual void applyParams();
 
   virtual void compute(const cvMat&, std::vector<cv::KeyPoint>&, cvMat&);
   virtual void detectAndCompute(const cvMat& img, const cvMat& mask,
                                 std::vector<cv::KeyPoint>& kpts, cvMat&);
 
+  /// cv::MSER keeps its work buffers as members
+  virtual bool isReentrant() const { return false; }
+
   sofa::Data<int> delta;
   sofa::Data<int> minArea;
   sofa::Data<int> maxArea;
@@ -130,6 +158,9 @@ struct ORBDetector : BaseDetector
   void init();
 
   virtual void registerData(ImageFilter*);
+  virtual void create();
+  virtual bool needsRebuild();
+  virtual void applyParams();
 
   sofa::Data<int> nFeatures;
   sofa::Data<float> scaleFactor;
@@ -147,6 +178,7 @@ struct BRISKDetector : BaseDetector
   void enable(bool);
   void init();
   virtual void registerData(ImageFilter*);
+  virtual void create();
 
   sofa::Data<int> threshold;
   sofa::Data<int> octaves;
@@ -158,6 +190,9 @@ struct KAZEDetector : BaseDetector
   void enable(bool);
   void init();
   virtual void registerData(ImageFilter*);
+  virtual void create();
+  virtual bool needsRebuild();
+  virtual void applyParams();
 
   sofa::Data<bool> extended;
   sofa::Data<bool> upright;
@@ -172,6 +207,9 @@ struct AKAZEDetector : BaseDetector
   void enable(bool);
   void init();
   virtual void registerData(ImageFilter*);
+  virtual void create();
+  virtual bool needsRebuild();
+  virtual void applyParams();
 
   sofa::Data<sofa::helper::OptionsGroup> descriptorType;
   sofa::Data<int> descriptorSize;
@@ -190,6 +228,7 @@ struct BRIEFDetector : BaseDetector
   void enable(bool);
   void init();
   virtual void registerData(ImageFilter*);
+  virtual void create();
 
   void detect(const cvMat&, const cvMat&, std::vector<cv::KeyPoint>&);
   virtual void detectAndCompute(const cvMat&, const cvMat&,
@@ -205,6 +244,7 @@ struct SIFTDetector : BaseDetector
   void enable(bool);
   void init();
   virtual void registerData(ImageFilter*);
+  virtual void create();
 
   sofa::Data<int> nFeatures;
   sofa::Data<int> nOctaveLayers;
@@ -219,6 +259,9 @@ struct SURFDetector : BaseDetector
   void enable(bool);
   void init();
   virtual void registerData(ImageFilter*);
+  virtual void create();
+  virtual bool needsRebuild();
+  virtual void applyParams();
 
   sofa::Data<double> threshold;
   sofa::Data<int> nOctaves;
@@ -233,6 +276,7 @@ struct DAISYDetector : BaseDetector
   void enable(bool);
   void init();
   virtual void registerData(ImageFilter*);
+  virtual void create();
 
   void detect(const cvMat&, const cvMat&, std::vector<cv::KeyPoint>&);
   virtual void detectAndCompute(const cvMat&, const cvMat&,
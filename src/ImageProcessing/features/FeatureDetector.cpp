@@ -1,4 +1,5 @@
 #include "FeatureDetector.h"
+#include "utils/ParallelFor.h"
 #include <SofaCV/SofaCV.h>
 
 #include <sofa/core/ObjectFactory.h>
@@ -34,7 +35,27 @@ FeatureDetector::FeatureDetector()
                            "output array of cvKeypoints", false)),
       d_descriptors(initData(&d_descriptors, "descriptors",
                              "output cvMat of feature descriptors", false,
-                             true))
+                             true)),
+      d_tiled(initData(&d_tiled, false, "tiled",
+                       "if true, the frame is split in tiles on which the "
+                       "detector runs concurrently")),
+      d_tiles(initData(&d_tiles, sofa::defaulttype::Vec2i(4, 4), "tiles",
+                       "number of tiles along x and y in tiled mode")),
+      d_tileOverlap(initData(&d_tileOverlap, 32, "tileOverlap",
+                             "in px, margin added around each tile so that the "
+                             "detector sees the neighborhood of keypoints "
+                             "close to the tile's border")),
+      d_maxPerTile(initData(&d_maxPerTile, 0, "maxPerTile",
+                            "in tiled mode, maximum number of keypoints kept "
+                            "per tile (strongest responses first). 0 keeps "
+                            "them all")),
+      d_pyramid(initData(&d_pyramid, "pyramid",
+                         "(optional) pyramid of the input image, as built by "
+                         "an ImagePyramid component")),
+      d_pyramidLevel(initData(&d_pyramidLevel, 0, "pyramidLevel",
+                              "pyramid level to run the detector on. "
+                              "Keypoints are output in the input image's "
+                              "coordinates. 0 runs on the input image"))
 {
   addAlias(&d_keypoints, "keypoints_out");
   addAlias(&d_descriptors, "descriptors_out");
@@ -76,6 +97,12 @@ void FeatureDetector::init()
   addInput(&d_detectMode);
   addInput(&d_detectorType);
   addInput(&d_mask, true);
+  addInput(&d_tiled);
+  addInput(&d_tiles);
+  addInput(&d_tileOverlap);
+  addInput(&d_maxPerTile);
+  addInput(&d_pyramid);
+  addInput(&d_pyramidLevel);
 
   for (auto detector : m_detectors) detector->init();
 
@@ -102,10 +129,7 @@ void FeatureDetector::doUpdate()
   {
     case DETECT_ONLY:
     {
-      sofa::helper::vector<cvKeypoint>* vec = d_keypoints.beginEdit();
-      vec->clear();
-      for (cv::KeyPoint& kp : _v) vec->push_back(cvKeypoint(kp));
-      d_keypoints.endEdit();
+      writeKeypoints();
       break;
     }
     case COMPUTE_ONLY:
@@ -115,10 +139,7 @@ void FeatureDetector::doUpdate()
     }
     case DETECT_AND_COMPUTE:
     {
-      sofa::helper::vector<cvKeypoint>* vec = d_keypoints.beginWriteOnly();
-      vec->clear();
-      for (cv::KeyPoint& kp : _v) vec->push_back(cvKeypoint(kp));
-      d_keypoints.endEdit();
+      writeKeypoints();
       d_descriptors.setValue(_d);
       break;
     }
@@ -126,40 +147,150 @@ void FeatureDetector::doUpdate()
   sofa::helper::AdvancedTimer::stepEnd("FeatureDetection");
 }
 
-void FeatureDetector::applyFilter(const cv::Mat& in, cv::Mat& out, bool debug)
+void FeatureDetector::readKeypoints()
 {
-  if (in.empty()) return;
-  int detect = int(d_detectMode.getValue().getSelectedId());
-  if (detect == DETECT_ONLY)
-  {
-    _v.clear();
-    if (!d_keypoints.getValue().empty() && !debug)
+  // cvKeypoint only adds (de)serialization on top of cv::KeyPoint, so the
+  // input can be sliced in a single pass. _v keeps its capacity from one frame
+  // to the next
+  const sofa::helper::vector<cvKeypoint>& kps = d_keypoints.getValue();
+  _v.assign(kps.begin(), kps.end());
+}
+
+void FeatureDetector::writeKeypoints()
+{
+  // Hands the detected keypoints over to the Data's storage: the output vector
+  // is resized (which only reallocates when the keypoint count grows past its
+  // capacity) and overwritten in place, instead of being cleared and refilled
+  // one push_back at a time
+  sofa::helper::vector<cvKeypoint>& vec = *d_keypoints.beginWriteOnly();
+  vec.resize(_v.size());
+  for (size_t i = 0; i < _v.size(); ++i) vec[i] = cvKeypoint(_v[i]);
+  d_keypoints.endEdit();
+}
+
+void FeatureDetector::detect(const cv::Mat& in, const cv::Mat& mask)
+{
+  if (d_tiled.getValue())
+    detectTiled(in, mask);
+  else
+    m_detectors[d_detectorType.getValue().getSelectedId()]->detect(in, mask,
+                                                                   _v);
+}
+
+void FeatureDetector::detectTiled(const cv::Mat& in, const cv::Mat& mask)
+{
+  BaseDetector* detector =
+      m_detectors[d_detectorType.getValue().getSelectedId()];
+  int nx = std::max(1, d_tiles.getValue().x());
+  int ny = std::max(1, d_tiles.getValue().y());
+  int overlap = std::max(0, d_tileOverlap.getValue());
+  int maxPerTile = d_maxPerTile.getValue();
+  const cv::Rect frame(0, 0, in.cols, in.rows);
+
+  m_tileKeypoints.resize(size_t(nx * ny));
+
+  auto detectTiles = [&](const cv::Range& range) {
+    for (int t = range.start; t < range.end; ++t)
     {
-      const cv::KeyPoint* arr =
-          dynamic_cast<const cv::KeyPoint*>(d_keypoints.getValue().data());
+      int tx = t % nx;
+      int ty = t / nx;
+      int x0 = tx * in.cols / nx, x1 = (tx + 1) * in.cols / nx;
+      int y0 = ty * in.rows / ny, y1 = (ty + 1) * in.rows / ny;
+      cv::Rect roi(x0 - overlap, y0 - overlap, x1 - x0 + 2 * overlap,
+                   y1 - y0 + 2 * overlap);
+      roi &= frame;
 
-      _v.assign(arr, arr + d_keypoints.getValue().size());
+      std::vector<cv::KeyPoint>& kps = m_tileKeypoints[size_t(t)];
+      kps.clear();
+      if (roi.area() == 0) continue;
+      detector->detect(in(roi), (mask.empty()) ? (cv::Mat()) : (mask(roi)),
+                       kps);
+
+      // The overlap only provides context to the detector: a tile keeps the
+      // keypoints lying in its own [x0, x1[ x [y0, y1[ area, so that a
+      // keypoint detected by two neighboring tiles is only output once
+      size_t n = 0;
+      for (cv::KeyPoint kp : kps)
+      {
+        kp.pt.x += roi.x;
+        kp.pt.y += roi.y;
+        if (kp.pt.x >= x0 && kp.pt.x < x1 && kp.pt.y >= y0 && kp.pt.y < y1)
+          kps[n++] = kp;
+      }
+      kps.resize(n);
+      if (maxPerTile > 0) cv::KeyPointsFilter::retainBest(kps, maxPerTile);
     }
-    cv::Mat m = d_mask.getValue();
-    if (d_mask.getValue().channels() != 1)
-      cv::cvtColor(d_mask.getValue(), m, cv::COLOR_BGR2GRAY);
+  };
+
+  if (detector->isReentrant())
+    utils::parallelFor(cv::Range(0, nx * ny), detectTiles);
+  else
+    detectTiles(cv::Range(0, nx * ny));
+
+  // merging in tile order keeps the output deterministic
+  _v.clear();
+  for (const std::vector<cv::KeyPoint>& kps : m_tileKeypoints)
+    _v.insert(_v.end(), kps.begin(), kps.end());
+}
 
-    m_detectors[d_detectorType.getValue().getSelectedId()]->detect(in, m, _v);
+void FeatureDetector::scaleKeypoints(float s)
+{
+  for (cv::KeyPoint& kp : _v)
+  {
+    kp.pt *= s;
+    kp.size *= s;
+  }
+}
+
+void FeatureDetector::applyFilter(const cv::Mat& frame, cv::Mat& out,
+                                  bool debug)
+{
+  if (frame.empty()) return;
+
+  // applies the parameters changed since the last frame to the detector
+  m_detectors[d_detectorType.getValue().getSelectedId()]->update();
+
+  // When a pyramid level is selected, the detector runs on that level of the
+  // shared pyramid, and the keypoints are brought back to the input image's
+  // coordinates once described
+  cv::Mat in = frame;
+  cv::Mat mask = d_mask.getValue();
+  const sofa::helper::vector<cvMat>& pyramid = d_pyramid.getValue();
+  int level = std::min(d_pyramidLevel.getValue(), int(pyramid.size()) - 1);
+  if (d_pyramidLevel.getValue() > 0 && pyramid.empty())
+    msg_warning("FeatureDetector::applyFilter()")
+        << "No pyramid linked: running on the full resolution image instead "
+           "of level "
+        << d_pyramidLevel.getValue();
+  float scale = 1.0f;
+  if (level > 0)
+  {
+    in = pyramid[size_t(level)];
+    scale = float(1 << level);
+    if (!mask.empty())
+      cv::resize(mask, mask, in.size(), 0, 0, cv::INTER_NEAREST);
+  }
+
+  int mode = int(d_detectMode.getValue().getSelectedId());
+  if (mode == DETECT_ONLY)
+  {
+    // keypoints are an output in this mode: detect() overwrites _v, there is
+    // no need to read back the previous frame's keypoints
+    _v.clear();
+    cv::Mat m = mask;
+    if (mask.channels() != 1) cv::cvtColor(mask, m, cv::COLOR_BGR2GRAY);
+
+    detect(in, m);
     msg_warning_when(_v.empty(), "FeatureDetector::update()")
         << "No Features detected";
   }
-  else if (detect == COMPUTE_ONLY)
+  else if (mode == COMPUTE_ONLY)
   {
     _v.clear();
-    if (!d_keypoints.getValue().empty() && !debug)
-    {
-      const cv::KeyPoint* arr =
-          dynamic_cast<const cv::KeyPoint*>(d_keypoints.getValue().data());
-
-      _v.assign(arr, arr + d_keypoints.getValue().size());
-    }
+    if (!debug) readKeypoints();
     msg_warning_when(_v.empty(), "FeatureDetector::update()")
         << "No Features to describe";
+    if (level > 0) scaleKeypoints(1.0f / scale);
     _d = cv::Mat();
     m_detectors[d_detectorType.getValue().getSelectedId()]->compute(in, _v, _d);
     msg_warning_when(!_d.rows, "FeatureDetector::update()")
@@ -167,27 +298,30 @@ void FeatureDetector::applyFilter(const cv::Mat& in, cv::Mat& out, bool debug)
   }
   else
   {
-    if (in.empty()) return;
     _v.clear();
-    if (!d_keypoints.getValue().empty() && !debug)
+    _d = cv::Mat();
+    if (d_tiled.getValue())
     {
-      const cv::KeyPoint* arr =
-          dynamic_cast<const cv::KeyPoint*>(d_keypoints.getValue().data());
-
-      _v.assign(arr, arr + d_keypoints.getValue().size());
+      // descriptors are computed once on the whole frame from the merged
+      // keypoints
+      detectTiled(in, mask);
+      m_detectors[d_detectorType.getValue().getSelectedId()]->compute(in, _v,
+                                                                      _d);
     }
-    _d = cv::Mat();
-    m_detectors[d_detectorType.getValue().getSelectedId()]->detectAndCompute(
-        in, d_mask.getValue(), _v, _d);
+    else
+      m_detectors[d_detectorType.getValue().getSelectedId()]->detectAndCompute(
+          in, mask, _v, _d);
     msg_warning_when(_v.empty(), "FeatureDetector::update()")
         << "Didn't detect any feature...";
     msg_warning_when(!_d.rows, "FeatureDetector::update()")
         << "Couldn't describe features...";
   }
+  if (level > 0) scaleKeypoints(scale);
+
   if (d_outputImage.getValue())
   {
     cv::Mat _in;
-    in.copyTo(_in);
+    frame.copyTo(_in);
     if (_in.depth() == CV_32F)
     {
       _in.convertTo(_in, 0, 255.0);
@@ -200,7 +334,7 @@ void FeatureDetector::applyFilter(const cv::Mat& in, cv::Mat& out, bool debug)
     out = _in.clone();
   }
   else
-    in.copyTo(out);
+    frame.copyTo(out);
 }
 
 void FeatureDetector::detectModeChanged()
@@ -6,6 +6,7 @@
 #include "ImageProcessingPlugin.h"
 
 #include <sofa/core/DataTracker.h>
+#include <sofa/defaulttype/Vec.h>
 #include <sofa/helper/OptionsGroup.h>
 
 #include <opencv2/opencv.hpp>
@@ -60,15 +61,39 @@ class SOFA_IMAGEPROCESSING_API FeatureDetector : public ImageFilter
   sofa::Data<sofa::helper::vector<cvKeypoint> > d_keypoints;
   sofa::Data<cvMat> d_descriptors;
 
+  sofa::Data<bool> d_tiled;
+  sofa::Data<sofa::defaulttype::Vec2i> d_tiles;
+  sofa::Data<int> d_tileOverlap;
+  sofa::Data<int> d_maxPerTile;
+
+  sofa::Data<sofa::helper::vector<cvMat> > d_pyramid;
+  sofa::Data<int> d_pyramidLevel;
+
  protected:
   void detectTypeChanged();
   void detectModeChanged();
 
+  /// copies the input keypoints into _v (COMPUTE_ONLY)
+  void readKeypoints();
+  /// hands _v over to the keypoints Data without per-element reallocation
+  void writeKeypoints();
+
+  /// detects keypoints in _v, on the whole frame or tile by tile
+  void detect(const cv::Mat& in, const cv::Mat& mask);
+  /// splits the frame in overlapping tiles and runs the detector on each of
+  /// them concurrently
+  void detectTiled(const cv::Mat& in, const cv::Mat& mask);
+
+  /// scales the keypoints' positions and sizes in _v by s
+  void scaleKeypoints(float s);
+
  private:
   BaseDetector* m_detectors[DetectorType_COUNT];
 
   std::vector<cv::KeyPoint> _v;
   cvMat _d;
+
+  std::vector<std::vector<cv::KeyPoint> > m_tileKeypoints;
 };
 
 }  // namespace features
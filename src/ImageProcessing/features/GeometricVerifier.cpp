@@ -0,0 +1,182 @@
+#include "GeometricVerifier.h"
+
+#include <sofa/core/ObjectFactory.h>
+
+#include <algorithm>
+#include <numeric>
+
+namespace sofacv
+{
+namespace features
+{
+SOFA_DECL_CLASS(GeometricVerifier)
+
+int GeometricVerifierClass =
+    sofa::core::RegisterObject(
+        "component rejecting the matches inconsistent with the fundamental "
+        "matrix or homography robustly estimated from them")
+        .add<GeometricVerifier>();
+
+GeometricVerifier::GeometricVerifier()
+    : d_keypointsL(initData(&d_keypointsL, "keypoints1",
+                            "input left keypoints (usually from "
+                            "MatchingConstraints)")),
+      d_keypointsR(initData(&d_keypointsR, "keypoints2",
+                            "input right keypoints, paired with keypoints1")),
+      d_matches(initData(&d_matches, "matches",
+                         "optional matches of the keypoint pairs: pairs with "
+                         "the smallest descriptor distances are sampled "
+                         "first")),
+      d_modelType(initData(&d_modelType, "modelType",
+                           "model relating the keypoints (FUNDAMENTAL for a "
+                           "stereo pair, HOMOGRAPHY for a planar scene or a "
+                           "pure rotation)")),
+      d_threshold(initData(&d_threshold, 1.0, "threshold",
+                           "maximum distance of inliers to the model, in "
+                           "pixels (Sampson distance for FUNDAMENTAL, "
+                           "transfer distance for HOMOGRAPHY)")),
+      d_confidence(initData(&d_confidence, 0.999, "confidence",
+                            "sampling stops once a model with this "
+                            "probability to be correct was found")),
+      d_maxIterations(initData(&d_maxIterations, 10000, "maxIterations",
+                               "maximum number of hypotheses")),
+      d_batchSize(initData(&d_batchSize, 64, "batchSize",
+                           "number of hypotheses generated and verified "
+                           "together")),
+      d_localOptimization(initData(&d_localOptimization, true,
+                                   "localOptimization",
+                                   "if true, each new best model is refined "
+                                   "by least squares fits on its inliers")),
+      d_parallel(initData(&d_parallel, false, "parallel",
+                          "if true, the hypotheses of a batch are verified "
+                          "concurrently")),
+      d_model(initData(&d_model, "model",
+                       "estimated fundamental matrix or homography")),
+      d_mask(initData(&d_mask, "mask", "true for each inlier pair")),
+      d_inliers(initData(&d_inliers, "inliers",
+                         "indices of the inlier pairs")),
+      d_keypointsL_out(initData(&d_keypointsL_out, "keypoints1_out",
+                                "left keypoints of the inlier pairs")),
+      d_keypointsR_out(initData(&d_keypointsR_out, "keypoints2_out",
+                                "right keypoints of the inlier pairs")),
+      d_matches_out(initData(&d_matches_out, "matches_out",
+                             "matches of the inlier pairs, if matches is set"))
+{
+  addAlias(&d_model, "model_out");
+  addAlias(&d_mask, "mask_out");
+  addAlias(&d_inliers, "inliers_out");
+
+  sofa::helper::OptionsGroup* t = d_modelType.beginEdit();
+  t->setNames(RobustEstimator::Model_COUNT, "FUNDAMENTAL", "HOMOGRAPHY");
+  t->setSelectedItem(0);
+  d_modelType.endEdit();
+}
+
+void GeometricVerifier::init()
+{
+  addInput(&d_keypointsL);
+  addInput(&d_keypointsR);
+  addInput(&d_matches);
+  addInput(&d_modelType);
+  addInput(&d_threshold);
+  addInput(&d_confidence);
+  addInput(&d_maxIterations);
+  addInput(&d_batchSize);
+  addInput(&d_localOptimization);
+  addInput(&d_parallel);
+
+  addOutput(&d_model);
+  addOutput(&d_mask);
+  addOutput(&d_inliers);
+  addOutput(&d_keypointsL_out);
+  addOutput(&d_keypointsR_out);
+  addOutput(&d_matches_out);
+}
+
+void GeometricVerifier::doUpdate()
+{
+  const sofa::helper::vector<cvKeypoint>& kL = d_keypointsL.getValue();
+  const sofa::helper::vector<cvKeypoint>& kR = d_keypointsR.getValue();
+  const sofa::helper::vector<cvDMatch>& matches = d_matches.getValue();
+  if (kL.size() != kR.size())
+  {
+    msg_error(getName() + "::update()")
+        << "Error: number of left and right keypoints differ!";
+    return;
+  }
+  const size_t n = kL.size();
+  bool ranked = !matches.empty();
+  if (ranked && matches.size() != n)
+  {
+    msg_warning(getName() + "::update()")
+        << "number of matches and keypoint pairs differ: matches ignored";
+    ranked = false;
+  }
+
+  // PROSAC draws its first samples among the best ranked pairs
+  m_order.resize(n);
+  std::iota(m_order.begin(), m_order.end(), 0);
+  if (ranked)
+    std::stable_sort(m_order.begin(), m_order.end(), [&](size_t a, size_t b) {
+      return matches[a].distance < matches[b].distance;
+    });
+  m_ptsL.resize(n);
+  m_ptsR.resize(n);
+  for (size_t i = 0; i < n; ++i)
+  {
+    m_ptsL[i] = kL[m_order[i]].pt;
+    m_ptsR[i] = kR[m_order[i]].pt;
+  }
+
+  m_estimator.model =
+      RobustEstimator::Model(d_modelType.getValue().getSelectedId());
+  m_estimator.threshold = d_threshold.getValue();
+  m_estimator.confidence = d_confidence.getValue();
+  m_estimator.maxIterations = d_maxIterations.getValue();
+  m_estimator.batchSize = d_batchSize.getValue();
+  m_estimator.localOptimization = d_localOptimization.getValue();
+  m_estimator.parallel = d_parallel.getValue();
+
+  // without a model, the output is zeroed like the mask and inliers, rather
+  // than left to the previous step's one
+  cv::Matx33d M;
+  if (!m_estimator.estimate(m_ptsL, m_ptsR, M, m_mask))
+  {
+    M = cv::Matx33d::zeros();
+    msg_warning(getName() + "::update()")
+        << "No model found from " << n << " keypoint pairs";
+  }
+  Matrix3& model = *d_model.beginWriteOnly();
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 3; ++j) model[i][j] = M(i, j);
+  d_model.endEdit();
+
+  sofa::helper::vector<bool>& mask = *d_mask.beginWriteOnly();
+  mask.assign(n, false);
+  for (size_t i = 0; i < n; ++i) mask[m_order[i]] = (m_mask[i] != 0);
+  d_mask.endEdit();
+
+  sofa::helper::vector<size_t>& inliers = *d_inliers.beginWriteOnly();
+  sofa::helper::vector<cvKeypoint>& kLOut = *d_keypointsL_out.beginWriteOnly();
+  sofa::helper::vector<cvKeypoint>& kROut = *d_keypointsR_out.beginWriteOnly();
+  sofa::helper::vector<cvDMatch>& matchesOut = *d_matches_out.beginWriteOnly();
+  inliers.clear();
+  kLOut.clear();
+  kROut.clear();
+  matchesOut.clear();
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (!mask[i]) continue;
+    inliers.push_back(i);
+    kLOut.push_back(kL[i]);
+    kROut.push_back(kR[i]);
+    if (ranked) matchesOut.push_back(matches[i]);
+  }
+  d_inliers.endEdit();
+  d_keypointsL_out.endEdit();
+  d_keypointsR_out.endEdit();
+  d_matches_out.endEdit();
+}
+
+}  // namespace features
+}  // namespace sofacv
@@ -0,0 +1,80 @@
+#ifndef SOFACV_FEATURES_GEOMETRICVERIFIER_H
+#define SOFACV_FEATURES_GEOMETRICVERIFIER_H
+
+#include "ImageProcessingPlugin.h"
+#include "RobustEstimator.h"
+
+#include <SofaCV/SofaCV.h>
+
+#include <sofa/defaulttype/Mat.h>
+#include <sofa/helper/OptionsGroup.h>
+#include <sofa/helper/vector.h>
+
+#include <opencv2/opencv.hpp>
+
+namespace sofacv
+{
+namespace features
+{
+/**
+ * @brief The GeometricVerifier class
+ *
+ * Estimates the fundamental matrix (or homography) relating paired keypoints,
+ * usually the output of MatchingConstraints, and keeps the matches consistent
+ * with it. Unlike MatchingConstraints' epipolar filter, the model is
+ * estimated from the matches themselves, thus outliers are still rejected
+ * when the stereo calibration drifts. See RobustEstimator.
+ */
+class SOFA_IMAGEPROCESSING_API GeometricVerifier : public ImplicitDataEngine
+{
+  typedef sofa::defaulttype::Matrix3 Matrix3;
+
+ public:
+  SOFA_CLASS(GeometricVerifier, ImplicitDataEngine);
+
+  GeometricVerifier();
+  virtual ~GeometricVerifier() override {}
+
+  void init() override;
+  void doUpdate() override;
+
+  // INPUTS
+  sofa::Data<sofa::helper::vector<cvKeypoint> >
+      d_keypointsL;  ///< [INPUT] reference camera's keypoints
+  sofa::Data<sofa::helper::vector<cvKeypoint> >
+      d_keypointsR;  ///< [INPUT] second camera's keypoints, paired with
+                     /// keypointsL
+  sofa::Data<sofa::helper::vector<cvDMatch> >
+      d_matches;  ///< [INPUT] matches of the keypoint pairs, whose distances
+                  /// rank the pairs for PROSAC (optional)
+  sofa::Data<sofa::helper::OptionsGroup> d_modelType;  ///< F or H
+  sofa::Data<double> d_threshold;   ///< max error of inliers, in pixels
+  sofa::Data<double> d_confidence;  ///< confidence in the estimated model
+  sofa::Data<int> d_maxIterations;  ///< max number of hypotheses
+  sofa::Data<int> d_batchSize;  ///< hypotheses generated and verified together
+  sofa::Data<bool> d_localOptimization;  ///< refine each new best model
+  sofa::Data<bool> d_parallel;  ///< verify hypothesis batches concurrently
+
+  // OUTPUTS
+  sofa::Data<Matrix3> d_model;  ///< [OUTPUT] estimated F or H (0 if none)
+  sofa::Data<sofa::helper::vector<bool> >
+      d_mask;  ///< [OUTPUT] true for each inlier pair
+  sofa::Data<sofa::helper::vector<size_t> >
+      d_inliers;  ///< [OUTPUT] indices of the inlier pairs
+  sofa::Data<sofa::helper::vector<cvKeypoint> >
+      d_keypointsL_out;  ///< [OUTPUT] inliers' left keypoints
+  sofa::Data<sofa::helper::vector<cvKeypoint> >
+      d_keypointsR_out;  ///< [OUTPUT] inliers' right keypoints
+  sofa::Data<sofa::helper::vector<cvDMatch> >
+      d_matches_out;  ///< [OUTPUT] inliers' matches, if matches is set
+
+ private:
+  RobustEstimator m_estimator;
+  std::vector<size_t> m_order;  ///< pairs by increasing match distance
+  std::vector<cv::Point2f> m_ptsL, m_ptsR;
+  std::vector<unsigned char> m_mask;
+};
+
+}  // namespace features
+}  // namespace sofacv
+#endif  // SOFACV_FEATURES_GEOMETRICVERIFIER_H
@@ -0,0 +1,67 @@
+// Built with -mavx2 -mpopcnt, only called on CPUs supporting both
+#include "HammingKernels.inl"
+
+#include <immintrin.h>
+#include <stdint.h>
+
+namespace sofacv
+{
+namespace features
+{
+namespace hamming
+{
+namespace
+{
+/// per-byte popcount through a nibble lookup table, summed in 4 x 64 bits
+inline __m256i popcount256(__m256i v)
+{
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2,
+                                       3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2,
+                                       2, 3, 2, 3, 3, 4);
+  const __m256i lowMask = _mm256_set1_epi8(0x0f);
+  __m256i lo = _mm256_and_si256(v, lowMask);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask);
+  __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+                                _mm256_shuffle_epi8(lut, hi));
+  return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+
+struct AVX2Distance
+{
+  static inline int compute(const unsigned char* a, const unsigned char* b,
+                            int words)
+  {
+    __m256i acc = _mm256_setzero_si256();
+    int w = 0;
+    for (; w + 4 <= words; w += 4)
+    {
+      __m256i x = _mm256_xor_si256(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + 8 * w)),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 8 * w)));
+      acc = _mm256_add_epi64(acc, popcount256(x));
+    }
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(acc),
+                              _mm256_extracti128_si256(acc, 1));
+    int64_t d = _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+    for (; w < words; ++w)
+    {
+      uint64_t x, y;
+      __builtin_memcpy(&x, a + 8 * w, 8);
+      __builtin_memcpy(&y, b + 8 * w, 8);
+      d += int64_t(_mm_popcnt_u64(x ^ y));
+    }
+    return int(d);
+  }
+};
+
+}  // namespace
+
+void knnAVX2(const DescriptorSet& query, int q0, int q1,
+             const DescriptorSet& train, Top2* best)
+{
+  knnBlocked<AVX2Distance>(query, q0, q1, train, best);
+}
+
+}  // namespace hamming
+}  // namespace features
+}  // namespace sofacv
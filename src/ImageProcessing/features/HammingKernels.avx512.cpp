@@ -0,0 +1,45 @@
+// Built with -mavx512f -mavx512vpopcntdq, only called on CPUs supporting both
+#include "HammingKernels.inl"
+
+#include <immintrin.h>
+
+namespace sofacv
+{
+namespace features
+{
+namespace hamming
+{
+namespace
+{
+struct AVX512Distance
+{
+  static inline int compute(const unsigned char* a, const unsigned char* b,
+                            int words)
+  {
+    // a 32-byte ORB descriptor is a single masked load, a 64-byte BRISK one
+    // a full register
+    __m512i acc = _mm512_setzero_si512();
+    for (int w = 0; w < words; w += 8)
+    {
+      const int n = words - w;
+      const __mmask8 m =
+          (n >= 8) ? (__mmask8(0xff)) : (__mmask8((1u << n) - 1));
+      __m512i x = _mm512_xor_si512(_mm512_maskz_loadu_epi64(m, a + 8 * w),
+                                   _mm512_maskz_loadu_epi64(m, b + 8 * w));
+      acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+    }
+    return int(_mm512_reduce_add_epi64(acc));
+  }
+};
+
+}  // namespace
+
+void knnAVX512(const DescriptorSet& query, int q0, int q1,
+               const DescriptorSet& train, Top2* best)
+{
+  knnBlocked<AVX512Distance>(query, q0, q1, train, best);
+}
+
+}  // namespace hamming
+}  // namespace features
+}  // namespace sofacv
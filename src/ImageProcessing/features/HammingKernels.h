@@ -0,0 +1,55 @@
+#ifndef SOFACV_FEATURES_HAMMINGKERNELS_H
+#define SOFACV_FEATURES_HAMMINGKERNELS_H
+
+#include <cstddef>
+
+// Internal header of HammingMatch: it is included by translation units built
+// with instruction sets that the host CPU may not support, and thus must not
+// pull in any header defining inline functions (OpenCV, STL...), which the
+// linker could otherwise pick from these units for the whole library.
+
+namespace sofacv
+{
+namespace features
+{
+namespace hamming
+{
+/// binary descriptors, one per row, zero-padded to a whole number of 64-bit
+/// words
+struct DescriptorSet
+{
+  const unsigned char* data;
+  size_t step;
+  int rows;
+  int words;
+};
+
+/// the 2 nearest train descriptors found so far for a query (-1 if none)
+struct Top2
+{
+  int d1;
+  int t1;
+  int d2;
+  int t2;
+};
+
+/// fills best[q] for each query q in [q0, q1[
+typedef void (*KnnKernel)(const DescriptorSet& query, int q0, int q1,
+                          const DescriptorSet& train, Top2* best);
+
+void knnScalar(const DescriptorSet& query, int q0, int q1,
+               const DescriptorSet& train, Top2* best);
+#ifdef SOFACV_HAMMING_AVX2
+void knnAVX2(const DescriptorSet& query, int q0, int q1,
+             const DescriptorSet& train, Top2* best);
+#endif  // SOFACV_HAMMING_AVX2
+#ifdef SOFACV_HAMMING_AVX512
+void knnAVX512(const DescriptorSet& query, int q0, int q1,
+               const DescriptorSet& train, Top2* best);
+#endif  // SOFACV_HAMMING_AVX512
+
+}  // namespace hamming
+}  // namespace features
+}  // namespace sofacv
+
+#endif  // SOFACV_FEATURES_HAMMINGKERNELS_H
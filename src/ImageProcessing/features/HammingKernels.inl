@@ -0,0 +1,84 @@
+#ifndef SOFACV_FEATURES_HAMMINGKERNELS_INL
+#define SOFACV_FEATURES_HAMMINGKERNELS_INL
+
+#include "HammingKernels.h"
+
+namespace sofacv
+{
+namespace features
+{
+namespace hamming
+{
+// Everything here is compiled once per instruction set: the anonymous
+// namespace keeps each copy local to its translation unit
+namespace
+{
+/// train descriptors scanned by a block of queries at once: sized to stay in
+/// L1 while the queries' rows are reused across the whole block
+const int kTrainBlockBytes = 16 * 1024;
+const int kQueryBlock = 32;
+
+inline const unsigned char* row(const DescriptorSet& set, int i)
+{
+  return set.data + set.step * size_t(i);
+}
+
+/// cache-blocked query x train scan, keeping the 2 nearest train descriptors
+/// of each query (for the ratio test). Distance::compute(a, b, words) returns
+/// the Hamming distance between 2 descriptors
+template <class Distance>
+void knnBlocked(const DescriptorSet& query, int q0, int q1,
+                const DescriptorSet& train, Top2* best)
+{
+  int trainBlock = kTrainBlockBytes / (train.words * 8);
+  if (trainBlock < 16) trainBlock = 16;
+  const int words = query.words;
+
+  for (int qb = q0; qb < q1; qb += kQueryBlock)
+  {
+    const int qe = (qb + kQueryBlock < q1) ? (qb + kQueryBlock) : (q1);
+    for (int q = qb; q < qe; ++q)
+    {
+      best[q].d1 = best[q].d2 = 0x7fffffff;
+      best[q].t1 = best[q].t2 = -1;
+    }
+
+    for (int tb = 0; tb < train.rows; tb += trainBlock)
+    {
+      const int te =
+          (tb + trainBlock < train.rows) ? (tb + trainBlock) : (train.rows);
+      for (int q = qb; q < qe; ++q)
+      {
+        const unsigned char* qd = row(query, q);
+        Top2 b = best[q];
+        for (int t = tb; t < te; ++t)
+        {
+          const int d = Distance::compute(qd, row(train, t), words);
+          if (d < b.d2)
+          {
+            if (d < b.d1)
+            {
+              b.d2 = b.d1;
+              b.t2 = b.t1;
+              b.d1 = d;
+              b.t1 = t;
+            }
+            else
+            {
+              b.d2 = d;
+              b.t2 = t;
+            }
+          }
+        }
+        best[q] = b;
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace hamming
+}  // namespace features
+}  // namespace sofacv
+
+#endif  // SOFACV_FEATURES_HAMMINGKERNELS_INL
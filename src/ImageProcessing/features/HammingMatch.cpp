@@ -0,0 +1,145 @@
+#include "HammingMatch.h"
+#include "HammingKernels.inl"
+#include "utils/ParallelFor.h"
+
+#include <opencv2/core/utility.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace sofacv
+{
+namespace features
+{
+namespace hamming
+{
+namespace
+{
+/// SWAR popcount, for CPUs (or compilers) without a popcount instruction
+struct ScalarDistance
+{
+  static inline int compute(const unsigned char* a, const unsigned char* b,
+                            int words)
+  {
+    int d = 0;
+    for (int w = 0; w < words; ++w)
+    {
+      uint64_t x, y;
+      std::memcpy(&x, a + 8 * w, 8);
+      std::memcpy(&y, b + 8 * w, 8);
+      x ^= y;
+      x = x - ((x >> 1) & 0x5555555555555555ULL);
+      x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+      x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+      d += int((x * 0x0101010101010101ULL) >> 56);
+    }
+    return d;
+  }
+};
+
+struct Kernel
+{
+  KnnKernel run;
+  const char* name;
+};
+
+Kernel selectKernel()
+{
+#ifdef SOFACV_HAMMING_AVX512
+#ifdef CV_CPU_AVX_512VPOPCNTDQ
+  if (cv::checkHardwareSupport(CV_CPU_AVX_512F) &&
+      cv::checkHardwareSupport(CV_CPU_AVX_512VPOPCNTDQ))
+    return Kernel{knnAVX512, "AVX512_VPOPCNTDQ"};
+#endif  // CV_CPU_AVX_512VPOPCNTDQ
+#endif  // SOFACV_HAMMING_AVX512
+#ifdef SOFACV_HAMMING_AVX2
+  if (cv::checkHardwareSupport(CV_CPU_AVX2) &&
+      cv::checkHardwareSupport(CV_CPU_POPCNT))
+    return Kernel{knnAVX2, "AVX2"};
+#endif  // SOFACV_HAMMING_AVX2
+  return Kernel{knnScalar, "SCALAR"};
+}
+
+const Kernel& kernel()
+{
+  static const Kernel k = selectKernel();
+  return k;
+}
+
+/// descriptors as a DescriptorSet, copied into zero-padded rows when their
+/// size is not a whole number of 64-bit words (e.g. 61-byte AKAZE ones)
+DescriptorSet toDescriptorSet(const cv::Mat& desc, cv::Mat& padded)
+{
+  padded = desc;
+  if (desc.cols % 8)
+  {
+    padded = cv::Mat::zeros(desc.rows, (desc.cols + 7) / 8 * 8, CV_8U);
+    desc.copyTo(padded.colRange(0, desc.cols));
+  }
+  DescriptorSet set;
+  set.data = padded.data;
+  set.step = padded.step;
+  set.rows = padded.rows;
+  set.words = padded.cols / 8;
+  return set;
+}
+
+}  // namespace
+
+void knnScalar(const DescriptorSet& query, int q0, int q1,
+               const DescriptorSet& train, Top2* best)
+{
+  knnBlocked<ScalarDistance>(query, q0, q1, train, best);
+}
+
+}  // namespace hamming
+
+void hammingKnnMatch(const cv::Mat& query, const cv::Mat& train,
+                     std::vector<std::vector<cv::DMatch> >& matches, int k,
+                     int chunkSize)
+{
+  CV_Assert(query.type() == CV_8UC1 && train.type() == CV_8UC1);
+  CV_Assert(query.cols == train.cols || query.empty() || train.empty());
+  CV_Assert(k == 1 || k == 2);
+
+  matches.resize(size_t(query.rows));
+  for (std::vector<cv::DMatch>& m : matches) m.clear();
+  if (query.empty() || train.empty()) return;
+
+  cv::Mat q, t;
+  hamming::DescriptorSet querySet = hamming::toDescriptorSet(query, q);
+  hamming::DescriptorSet trainSet = hamming::toDescriptorSet(train, t);
+
+  std::vector<hamming::Top2> best(size_t(query.rows));
+  hamming::KnnKernel run = hamming::kernel().run;
+  if (chunkSize > 0 && query.rows > chunkSize)
+  {
+    // each chunk fills its own range of 'best'
+    const int nChunks = (query.rows + chunkSize - 1) / chunkSize;
+    utils::parallelFor(
+        cv::Range(0, nChunks),
+        [&](const cv::Range& range) {
+          for (int c = range.start; c < range.end; ++c)
+            run(querySet, c * chunkSize,
+                std::min((c + 1) * chunkSize, query.rows), trainSet,
+                best.data());
+        },
+        nChunks);
+  }
+  else
+    run(querySet, 0, query.rows, trainSet, best.data());
+
+  for (int i = 0; i < query.rows; ++i)
+  {
+    const hamming::Top2& b = best[size_t(i)];
+    std::vector<cv::DMatch>& m = matches[size_t(i)];
+    if (b.t1 >= 0) m.push_back(cv::DMatch(i, b.t1, 0, float(b.d1)));
+    if (k == 2 && b.t2 >= 0) m.push_back(cv::DMatch(i, b.t2, 0, float(b.d2)));
+  }
+}
+
+const char* hammingKernelName() { return hamming::kernel().name; }
+
+}  // namespace features
+}  // namespace sofacv
@@ -0,0 +1,32 @@
+#ifndef SOFACV_FEATURES_HAMMINGMATCH_H
+#define SOFACV_FEATURES_HAMMINGMATCH_H
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+namespace sofacv
+{
+namespace features
+{
+/**
+ * @brief Brute-force k-nearest neighbors matching of binary descriptors
+ *
+ * For each row of 'query', finds its k (1 or 2) nearest rows of 'train' in
+ * Hamming distance. Both matrices are CV_8U, with one descriptor per row (ORB,
+ * BRISK, AKAZE...). The matching kernel is picked at runtime depending on the
+ * CPU (AVX-512 VPOPCNTDQ, AVX2 or portable code).
+ * If chunkSize > 0, the queries are split in chunks of chunkSize rows
+ * matched concurrently, with the same output as a single-threaded call.
+ */
+void hammingKnnMatch(const cv::Mat& query, const cv::Mat& train,
+                     std::vector<std::vector<cv::DMatch> >& matches, int k,
+                     int chunkSize = 0);
+
+/// name of the kernel hammingKnnMatch() runs on this CPU
+const char* hammingKernelName();
+
+}  // namespace features
+}  // namespace sofacv
+
+#endif  // SOFACV_FEATURES_HAMMINGMATCH_H
@@ -0,0 +1,184 @@
+#include "KeypointBucketing.h"
+#include "utils/ReleaseIfShared.h"
+
+#include <sofa/core/ObjectFactory.h>
+
+#include <algorithm>
+#include <numeric>
+
+namespace sofacv
+{
+namespace features
+{
+SOFA_DECL_CLASS(KeypointBucketing)
+
+int KeypointBucketingClass =
+    sofa::core::RegisterObject(
+        "component selecting the N best keypoints spread uniformly over a "
+        "grid")
+        .add<KeypointBucketing>();
+
+KeypointBucketing::KeypointBucketing()
+    : d_keypoints(initData(&d_keypoints, "keypoints",
+                           "input vector of keypoints (usually from "
+                           "FeatureDetector)")),
+      d_descriptors(initData(&d_descriptors, "descriptors",
+                             "optional input descriptors, filtered alongside "
+                             "the keypoints")),
+      d_imageSize(initData(&d_imageSize, "imageSize",
+                           "image resolution in pixels. If not set, the "
+                           "keypoints' bounding box is used")),
+      d_grid(initData(&d_grid, Vec2i(8, 8), "grid",
+                      "number of cells along x and y")),
+      d_maxKeypoints(initData(&d_maxKeypoints, 500, "maxKeypoints",
+                              "maximum number of keypoints to select")),
+      d_keypoints_out(initData(&d_keypoints_out, "keypoints_out",
+                               "selected keypoints, in input order")),
+      d_descriptors_out(initData(&d_descriptors_out, "descriptors_out",
+                                 "descriptors of the selected keypoints")),
+      d_indices_out(initData(&d_indices_out, "indices_out",
+                             "indices of the selected keypoints in the input "
+                             "vector"))
+{
+}
+
+void KeypointBucketing::init()
+{
+  addInput(&d_keypoints);
+  addInput(&d_descriptors);
+  addInput(&d_imageSize);
+  addInput(&d_grid);
+  addInput(&d_maxKeypoints);
+
+  addOutput(&d_keypoints_out);
+  addOutput(&d_descriptors_out);
+  addOutput(&d_indices_out);
+}
+
+void KeypointBucketing::select(const sofa::helper::vector<cvKeypoint>& kps)
+{
+  size_t n = kps.size();
+  size_t maxKps = size_t(std::max(0, d_maxKeypoints.getValue()));
+  m_selected.resize(std::min(n, maxKps));
+  if (n <= maxKps)
+  {
+    std::iota(m_selected.begin(), m_selected.end(), 0);
+    return;
+  }
+  m_selected.clear();
+
+  float w = 0.0f, h = 0.0f;
+  if (d_imageSize.isSet())
+  {
+    w = float(d_imageSize.getValue().x());
+    h = float(d_imageSize.getValue().y());
+  }
+  else
+  {
+    for (const cvKeypoint& kp : kps)
+    {
+      w = std::max(w, kp.pt.x + 1.0f);
+      h = std::max(h, kp.pt.y + 1.0f);
+    }
+  }
+  int gx = std::max(1, d_grid.getValue().x());
+  int gy = std::max(1, d_grid.getValue().y());
+  size_t nCells = size_t(gx * gy);
+
+  auto cellOf = [&](const cv::KeyPoint& kp) {
+    int cx = std::min(gx - 1, std::max(0, int(kp.pt.x * gx / w)));
+    int cy = std::min(gy - 1, std::max(0, int(kp.pt.y * gy / h)));
+    return size_t(cy * gx + cx);
+  };
+  // strongest first, ties broken by index to keep the selection deterministic
+  auto stronger = [&](size_t a, size_t b) {
+    return kps[a].response > kps[b].response ||
+           (kps[a].response == kps[b].response && a < b);
+  };
+
+  m_order.resize(n);
+  std::iota(m_order.begin(), m_order.end(), 0);
+  std::sort(m_order.begin(), m_order.end(), stronger);
+
+  // Counting sort of the keypoints in their cells. Filling the buckets in
+  // m_order keeps each bucket sorted by decreasing response
+  m_cellOffsets.assign(nCells + 1, 0);
+  for (const cvKeypoint& kp : kps) ++m_cellOffsets[cellOf(kp) + 1];
+  std::partial_sum(m_cellOffsets.begin(), m_cellOffsets.end(),
+                   m_cellOffsets.begin());
+  m_cursors.assign(m_cellOffsets.begin(), m_cellOffsets.end() - 1);
+  m_buckets.resize(n);
+  for (size_t idx : m_order) m_buckets[m_cursors[cellOf(kps[idx])]++] = idx;
+
+  m_activeCells.clear();
+  for (size_t c = 0; c < nCells; ++c)
+    if (m_cellOffsets[c + 1] > m_cellOffsets[c]) m_activeCells.push_back(c);
+
+  // Round r takes the r-th best keypoint of every non-empty cell. Exhausted
+  // cells are dropped, so their share of the budget goes to the other cells
+  for (size_t r = 0; m_selected.size() < maxKps && !m_activeCells.empty(); ++r)
+  {
+    m_candidates.clear();
+    size_t nActive = 0;
+    for (size_t i = 0; i < m_activeCells.size(); ++i)
+    {
+      size_t c = m_activeCells[i];
+      size_t pos = m_cellOffsets[c] + r;
+      if (pos >= m_cellOffsets[c + 1]) continue;
+      m_candidates.push_back(m_buckets[pos]);
+      m_activeCells[nActive++] = c;
+    }
+    m_activeCells.resize(nActive);
+
+    size_t left = maxKps - m_selected.size();
+    if (m_candidates.size() > left)
+    {
+      // last round: the budget goes to the strongest candidates
+      std::partial_sort(m_candidates.begin(), m_candidates.begin() + left,
+                        m_candidates.end(), stronger);
+      m_candidates.resize(left);
+    }
+    m_selected.insert(m_selected.end(), m_candidates.begin(),
+                      m_candidates.end());
+  }
+  std::sort(m_selected.begin(), m_selected.end());
+}
+
+void KeypointBucketing::doUpdate()
+{
+  const sofa::helper::vector<cvKeypoint>& kps = d_keypoints.getValue();
+  select(kps);
+
+  sofa::helper::vector<cvKeypoint>& kpsOut = *d_keypoints_out.beginWriteOnly();
+  kpsOut.resize(m_selected.size());
+  for (size_t i = 0; i < m_selected.size(); ++i) kpsOut[i] = kps[m_selected[i]];
+  d_keypoints_out.endEdit();
+
+  sofa::helper::vector<size_t>& indices = *d_indices_out.beginWriteOnly();
+  indices.assign(m_selected.begin(), m_selected.end());
+  d_indices_out.endEdit();
+
+  // without descriptors matching the keypoints, none are output rather than
+  // the previous step's ones
+  const cvMat& desc = d_descriptors.getValue();
+  cvMat& descOut = *d_descriptors_out.beginWriteOnly();
+  utils::releaseIfShared(descOut);
+  if (desc.empty())
+    descOut.release();
+  else if (size_t(desc.rows) != kps.size())
+  {
+    msg_error(getName() + "::update()")
+        << "Error: number of keypoints and descriptors differ!";
+    descOut.release();
+  }
+  else
+  {
+    descOut.create(int(m_selected.size()), desc.cols, desc.type());
+    for (size_t i = 0; i < m_selected.size(); ++i)
+      desc.row(int(m_selected[i])).copyTo(descOut.row(int(i)));
+  }
+  d_descriptors_out.endEdit();
+}
+
+}  // namespace features
+}  // namespace sofacv
@@ -0,0 +1,70 @@
+#ifndef SOFACV_FEATURES_KEYPOINTBUCKETING_H
+#define SOFACV_FEATURES_KEYPOINTBUCKETING_H
+
+#include "ImageProcessingPlugin.h"
+
+#include <SofaCV/SofaCV.h>
+
+#include <sofa/defaulttype/Vec.h>
+#include <sofa/helper/vector.h>
+
+#include <opencv2/opencv.hpp>
+
+namespace sofacv
+{
+namespace features
+{
+/**
+ * @brief The KeypointBucketing class
+ *
+ * Selects at most maxKeypoints keypoints spread uniformly over the image:
+ * the image is split in a grid, and cells are served round-robin, each one
+ * giving its strongest remaining keypoint. Cells with few keypoints hand
+ * their share over to the denser ones, so the whole budget is used whenever
+ * enough keypoints are provided. Runs in O(n log n).
+ */
+class SOFA_IMAGEPROCESSING_API KeypointBucketing : public ImplicitDataEngine
+{
+  typedef sofa::defaulttype::Vec2i Vec2i;
+
+ public:
+  SOFA_CLASS(KeypointBucketing, ImplicitDataEngine);
+
+  KeypointBucketing();
+  virtual ~KeypointBucketing() override {}
+
+  void init() override;
+  void doUpdate() override;
+
+  // INPUTS
+  sofa::Data<sofa::helper::vector<cvKeypoint> >
+      d_keypoints;                ///< [INPUT] keypoints to select from
+  sofa::Data<cvMat> d_descriptors;  ///< [INPUT] optional matching descriptors
+  sofa::Data<Vec2i> d_imageSize;  ///< image size (keypoints' bounding box if
+                                  /// not set)
+  sofa::Data<Vec2i> d_grid;       ///< number of cells along x and y
+  sofa::Data<int> d_maxKeypoints;  ///< number of keypoints to select
+
+  // OUTPUTS
+  sofa::Data<sofa::helper::vector<cvKeypoint> >
+      d_keypoints_out;                  ///< [OUTPUT] selected keypoints
+  sofa::Data<cvMat> d_descriptors_out;  ///< [OUTPUT] their descriptors
+  sofa::Data<sofa::helper::vector<size_t> >
+      d_indices_out;  ///< [OUTPUT] indices of the selected keypoints
+
+ private:
+  /// fills m_selected with the indices of the selected keypoints
+  void select(const sofa::helper::vector<cvKeypoint>& kps);
+
+  std::vector<size_t> m_order;
+  std::vector<size_t> m_cellOffsets;
+  std::vector<size_t> m_cursors;
+  std::vector<size_t> m_buckets;
+  std::vector<size_t> m_activeCells;
+  std::vector<size_t> m_candidates;
+  std::vector<size_t> m_selected;
+};
+
+}  // namespace features
+}  // namespace sofacv
+#endif  // SOFACV_FEATURES_KEYPOINTBUCKETING_H
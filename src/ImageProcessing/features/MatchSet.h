@@ -0,0 +1,108 @@
+#ifndef SOFACV_FEATURES_MATCHSET_H
+#define SOFACV_FEATURES_MATCHSET_H
+
+#include <opencv2/core.hpp>
+
+#include <iostream>
+#include <vector>
+
+namespace sofacv
+{
+namespace features
+{
+/**
+ * @brief Matches of a set of query descriptors, stored contiguously
+ *
+ * The matches of query descriptor i (best first) are
+ * matches[offsets[i]] ... matches[offsets[i + 1] - 1]. Unlike a vector of
+ * vectors, refilling a MatchSet every frame reuses its 2 buffers instead of
+ * allocating one vector per query descriptor.
+ */
+struct MatchSet
+{
+  std::vector<cv::DMatch> matches;
+  std::vector<unsigned> offsets;  ///< size() + 1 entries, starting with 0
+
+  MatchSet() : offsets(1, 0) {}
+
+  /// number of query descriptors
+  size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+  bool empty() const { return size() == 0; }
+
+  /// number of matches of query descriptor i
+  size_t count(size_t i) const { return offsets[i + 1] - offsets[i]; }
+  const cv::DMatch* begin(size_t i) const
+  {
+    return matches.data() + offsets[i];
+  }
+  const cv::DMatch* end(size_t i) const
+  {
+    return matches.data() + offsets[i + 1];
+  }
+
+  void clear()
+  {
+    matches.clear();
+    offsets.assign(1, 0);
+  }
+
+  /// appends the matches of the next query descriptor
+  template <class It>
+  void push_back(It first, It last)
+  {
+    matches.insert(matches.end(), first, last);
+    offsets.push_back(unsigned(matches.size()));
+  }
+
+  /// flattens the output of cv::DescriptorMatcher::knnMatch / radiusMatch
+  void assign(const std::vector<std::vector<cv::DMatch> >& m)
+  {
+    size_t n = 0;
+    for (const std::vector<cv::DMatch>& v : m) n += v.size();
+    clear();
+    matches.reserve(n);
+    offsets.reserve(m.size() + 1);
+    for (const std::vector<cv::DMatch>& v : m) push_back(v.begin(), v.end());
+  }
+};
+
+/// "nQueries" followed, for each query, by its number of matches and the
+/// matches themselves as "queryIdx trainIdx imgIdx distance"
+inline std::ostream& operator<<(std::ostream& out, const MatchSet& s)
+{
+  out << s.size();
+  for (size_t i = 0; i < s.size(); ++i)
+  {
+    out << " " << s.count(i);
+    for (const cv::DMatch* m = s.begin(i); m != s.end(i); ++m)
+      out << " " << m->queryIdx << " " << m->trainIdx << " " << m->imgIdx
+          << " " << m->distance;
+  }
+  return out;
+}
+
+inline std::istream& operator>>(std::istream& in, MatchSet& s)
+{
+  s.clear();
+  size_t n = 0;
+  if (!(in >> n)) return in;
+  s.offsets.reserve(n + 1);
+  for (size_t i = 0; i < n && in; ++i)
+  {
+    size_t count = 0;
+    in >> count;
+    for (size_t j = 0; j < count && in; ++j)
+    {
+      cv::DMatch m;
+      in >> m.queryIdx >> m.trainIdx >> m.imgIdx >> m.distance;
+      s.matches.push_back(m);
+    }
+    s.offsets.push_back(unsigned(s.matches.size()));
+  }
+  return in;
+}
+
+}  // namespace features
+}  // namespace sofacv
+
+#endif  // SOFACV_FEATURES_MATCHSET_H
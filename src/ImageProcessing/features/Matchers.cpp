@@ -1,16 +1,84 @@
 #include "Matchers.h"
+#include "HammingMatch.h"
+#include "utils/ParallelFor.h"
 
 namespace sofacv
 {
 namespace features
 {
 BaseMatcher::~BaseMatcher() {}
+bool BaseMatcher::usePartitions(const cvMat& queryDescriptors)
+{
+  return m_chunkSize > 0 && queryDescriptors.rows > m_chunkSize &&
+         canPartition();
+}
+
+template <class MatchChunk>
+void BaseMatcher::matchPartitioned(
+    const cvMat& queryDescriptors, const cvMat& mask,
+    std::vector<std::vector<cv::DMatch> >& matches,
+    const MatchChunk& matchChunk)
+{
+  const int chunkSize = m_chunkSize;
+  const int nChunks = (queryDescriptors.rows + chunkSize - 1) / chunkSize;
+  std::vector<std::vector<std::vector<cv::DMatch> > > chunks(size_t(nChunks));
+
+  utils::parallelFor(
+      cv::Range(0, nChunks),
+      [&](const cv::Range& range) {
+        for (int c = range.start; c < range.end; ++c)
+        {
+          int q0 = c * chunkSize;
+          int q1 = std::min(q0 + chunkSize, queryDescriptors.rows);
+          std::vector<cv::Mat> masks;
+          if (!mask.empty()) masks.push_back(mask.rowRange(q0, q1));
+
+          std::vector<std::vector<cv::DMatch> >& chunk = chunks[size_t(c)];
+          matchChunk(queryDescriptors.rowRange(q0, q1), chunk, masks);
+          for (std::vector<cv::DMatch>& queryMatches : chunk)
+            for (cv::DMatch& m : queryMatches) m.queryIdx += q0;
+        }
+      },
+      nChunks);
+
+  matches.clear();
+  matches.reserve(size_t(queryDescriptors.rows));
+  for (std::vector<std::vector<cv::DMatch> >& chunk : chunks)
+    for (std::vector<cv::DMatch>& queryMatches : chunk)
+    {
+      matches.push_back(std::vector<cv::DMatch>());
+      matches.back().swap(queryMatches);
+    }
+}
+
+cv::Ptr<cv::DescriptorMatcher> BaseMatcher::trainedClone(
+    const cvMat& trainDescriptors)
+{
+  cv::Ptr<cv::DescriptorMatcher> matcher = m_matcher->clone(true);
+  matcher->add(std::vector<cv::Mat>(1, trainDescriptors));
+  matcher->train();
+  return matcher;
+}
+
 void BaseMatcher::knnMatch(const cvMat& queryDescriptors,
                            const cvMat& trainDescriptors,
                            std::vector<std::vector<cv::DMatch> >& matches,
                            int k, const cvMat& mask)
 {
-  m_matcher->knnMatch(queryDescriptors, trainDescriptors, matches, k, mask);
+  if (!usePartitions(queryDescriptors))
+  {
+    m_matcher->knnMatch(queryDescriptors, trainDescriptors, matches, k, mask);
+    return;
+  }
+  // the chunks share a matcher trained once on the train set, instead of
+  // each one indexing it again
+  cv::Ptr<cv::DescriptorMatcher> matcher = trainedClone(trainDescriptors);
+  matchPartitioned(queryDescriptors, mask, matches,
+                   [&](const cv::Mat& q,
+                       std::vector<std::vector<cv::DMatch> >& out,
+                       const std::vector<cv::Mat>& masks) {
+                     matcher->knnMatch(q, out, k, masks);
+                   });
 }
 
 void BaseMatcher::radiusMatch(const cvMat& queryDescriptors,
@@ -18,8 +86,67 @@ void BaseMatcher::radiusMatch(const cvMat& queryDescriptors,
                               std::vector<std::vector<cv::DMatch> >& matches,
                               float maxDistance, const cvMat& mask)
 {
-  m_matcher->radiusMatch(queryDescriptors, trainDescriptors, matches,
-                         maxDistance, mask);
+  if (!usePartitions(queryDescriptors))
+  {
+    m_matcher->radiusMatch(queryDescriptors, trainDescriptors, matches,
+                           maxDistance, mask);
+    return;
+  }
+  cv::Ptr<cv::DescriptorMatcher> matcher = trainedClone(trainDescriptors);
+  matchPartitioned(queryDescriptors, mask, matches,
+                   [&](const cv::Mat& q,
+                       std::vector<std::vector<cv::DMatch> >& out,
+                       const std::vector<cv::Mat>& masks) {
+                     matcher->radiusMatch(q, out, maxDistance, masks);
+                   });
+}
+
+void BaseMatcher::train(const cvMat& trainDescriptors)
+{
+  m_matcher->clear();
+  m_matcher->add(std::vector<cv::Mat>(1, trainDescriptors));
+  m_matcher->train();
+  m_trained = true;
+}
+
+void BaseMatcher::knnMatch(const cvMat& queryDescriptors,
+                           std::vector<std::vector<cv::DMatch> >& matches,
+                           int k, const cvMat& mask)
+{
+  // once trained, the matcher's collection is only read by the queries and
+  // can be shared by concurrent chunks
+  if (usePartitions(queryDescriptors))
+  {
+    matchPartitioned(queryDescriptors, mask, matches,
+                     [&](const cv::Mat& q,
+                         std::vector<std::vector<cv::DMatch> >& out,
+                         const std::vector<cv::Mat>& masks) {
+                       m_matcher->knnMatch(q, out, k, masks);
+                     });
+    return;
+  }
+  std::vector<cv::Mat> masks;
+  if (!mask.empty()) masks.push_back(mask);
+  m_matcher->knnMatch(queryDescriptors, matches, k, masks);
+}
+
+void BaseMatcher::radiusMatch(const cvMat& queryDescriptors,
+                              std::vector<std::vector<cv::DMatch> >& matches,
+                              float maxDistance, const cvMat& mask)
+{
+  if (usePartitions(queryDescriptors))
+  {
+    matchPartitioned(queryDescriptors, mask, matches,
+                     [&](const cv::Mat& q,
+                         std::vector<std::vector<cv::DMatch> >& out,
+                         const std::vector<cv::Mat>& masks) {
+                       m_matcher->radiusMatch(q, out, maxDistance, masks);
+                     });
+    return;
+  }
+  std::vector<cv::Mat> masks;
+  if (!mask.empty()) masks.push_back(mask);
+  m_matcher->radiusMatch(queryDescriptors, matches, maxDistance, masks);
 }
 
 BFMatcher::BFMatcher(sofa::core::objectmodel::BaseObject* c)
@@ -61,6 +188,50 @@ void BFMatcher::init()
 {
   m_matcher = new cv::BFMatcher(cvNorms[normType.getValue().getSelectedId()],
                                 crossCheck.getValue());
+  m_trained = false;
+}
+
+HammingMatcher::HammingMatcher(sofa::core::objectmodel::BaseObject* c)
+    : kernel(c->initData(&kernel, std::string(hammingKernelName()),
+                         "HAMMINGKernel",
+                         "Hamming distance kernel used on this CPU", true,
+                         true))
+{
+}
+
+void HammingMatcher::toggleVisible(bool show) { kernel.setDisplayed(show); }
+
+void HammingMatcher::init()
+{
+  m_matcher = new cv::BFMatcher(cv::NORM_HAMMING);
+  m_trained = false;
+}
+
+void HammingMatcher::knnMatch(const cvMat& queryDescriptors,
+                              const cvMat& trainDescriptors,
+                              std::vector<std::vector<cv::DMatch> >& matches,
+                              int k, const cvMat& mask)
+{
+  if (k > 2 || !mask.empty() || queryDescriptors.type() != CV_8UC1 ||
+      trainDescriptors.type() != CV_8UC1)
+    BaseMatcher::knnMatch(queryDescriptors, trainDescriptors, matches, k,
+                          mask);
+  else
+    hammingKnnMatch(queryDescriptors, trainDescriptors, matches, k,
+                    (usePartitions(queryDescriptors)) ? (m_chunkSize) : (0));
+}
+
+void HammingMatcher::train(const cvMat& trainDescriptors)
+{
+  BaseMatcher::train(trainDescriptors);
+  m_train = trainDescriptors;
+}
+
+void HammingMatcher::knnMatch(const cvMat& queryDescriptors,
+                              std::vector<std::vector<cv::DMatch> >& matches,
+                              int k, const cvMat& mask)
+{
+  knnMatch(queryDescriptors, m_train, matches, k, mask);
 }
 
 FlannMatcher::FlannMatcher(sofa::core::objectmodel::BaseObject* c)
@@ -104,6 +275,7 @@ void FlannMatcher::init()
   }
   m_matcher = new cv::FlannBasedMatcher(m_indexParams->getIndexParams(),
                                         m_searchParams->getSearchParams());
+  m_trained = false;
 }
 
 void FlannMatcher::toggleVisible(bool show)
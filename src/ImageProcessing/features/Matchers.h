@@ -19,6 +19,7 @@ namespace features
 {
 struct BaseMatcher
 {
+  BaseMatcher() : m_matcher(nullptr), m_trained(false), m_chunkSize(0) {}
   virtual ~BaseMatcher();
 
   virtual void toggleVisible(bool) = 0;
@@ -35,8 +36,47 @@ struct BaseMatcher
                            std::vector<std::vector<cv::DMatch> >& matches,
                            float maxDistance, const cvMat& mask);
 
+  /// replaces the matcher's train collection with trainDescriptors and
+  /// trains it (builds the FLANN index) once for the queries to come
+  virtual void train(const cvMat& trainDescriptors);
+  /// whether train() was called since the matcher was last (re)created
+  bool isTrained() const { return m_trained; }
+
+  /// matches against the collection set by train()
+  virtual void knnMatch(const cvMat& queryDescriptors,
+                        std::vector<std::vector<cv::DMatch> >& matches, int k,
+                        const cvMat& mask);
+  /// matches against the collection set by train()
+  virtual void radiusMatch(const cvMat& queryDescriptors,
+                           std::vector<std::vector<cv::DMatch> >& matches,
+                           float maxDistance, const cvMat& mask);
+
+  /// splits the queries in chunks of chunkSize descriptors, matched
+  /// concurrently (0 matches them all at once). The matches are the same,
+  /// in the same order, as in a single call
+  void setChunkSize(int chunkSize) { m_chunkSize = chunkSize; }
+  /// whether the matches of a query can be computed independently of the
+  /// other queries
+  virtual bool canPartition() { return true; }
+
  protected:
+  /// whether the queries should be split in chunks
+  bool usePartitions(const cvMat& queryDescriptors);
+
+  /// runs matchChunk(queries, chunkMatches, chunkMasks) concurrently on each
+  /// chunk of queries, and concatenates the results in query order
+  template <class MatchChunk>
+  void matchPartitioned(const cvMat& queryDescriptors, const cvMat& mask,
+                        std::vector<std::vector<cv::DMatch> >& matches,
+                        const MatchChunk& matchChunk);
+
+  /// copy of m_matcher trained on trainDescriptors, for the chunks to share
+  /// a single index
+  cv::Ptr<cv::DescriptorMatcher> trainedClone(const cvMat& trainDescriptors);
+
   cv::DescriptorMatcher* m_matcher;
+  bool m_trained;
+  int m_chunkSize;
 };
 
 struct BFMatcher : BaseMatcher
@@ -47,10 +87,40 @@ struct BFMatcher : BaseMatcher
   void toggleVisible(bool);
   void init();
   bool acceptsBinary() { return true; }
+  /// cross-checking needs the whole query set
+  bool canPartition() { return !crossCheck.getValue(); }
   sofa::Data<sofa::helper::OptionsGroup> normType;
   sofa::Data<bool> crossCheck;
 };
 
+/**
+ * @brief Brute-force matcher for binary descriptors
+ *
+ * Runs knnMatch with k <= 2 (the ratio test's case) on a native Hamming
+ * distance kernel (see hammingKnnMatch()). Masks, k > 2 and radiusMatch go
+ * through cv::BFMatcher with NORM_HAMMING.
+ */
+struct HammingMatcher : BaseMatcher
+{
+  HammingMatcher(sofa::core::objectmodel::BaseObject* c);
+  void toggleVisible(bool);
+  void init();
+  bool acceptsBinary() { return true; }
+
+  void knnMatch(const cvMat& queryDescriptors, const cvMat& trainDescriptors,
+                std::vector<std::vector<cv::DMatch> >& matches, int k,
+                const cvMat& mask);
+  void train(const cvMat& trainDescriptors);
+  void knnMatch(const cvMat& queryDescriptors,
+                std::vector<std::vector<cv::DMatch> >& matches, int k,
+                const cvMat& mask);
+
+  sofa::Data<std::string> kernel;
+
+ private:
+  cvMat m_train;
+};
+
 struct FlannMatcher : BaseMatcher
 {
   FlannMatcher(sofa::core::objectmodel::BaseObject* c);
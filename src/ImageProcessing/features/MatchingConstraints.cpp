@@ -1,10 +1,14 @@
 #include "MatchingConstraints.h"
+#include "utils/ParallelFor.h"
 
 #include <sofa/core/ObjectFactory.h>
 #include <sofa/simulation/AnimateBeginEvent.h>
 
 #include <opencv2/calib3d.hpp>
 #include <opencv2/imgproc.hpp>
+
+#include <cstring>
+
 namespace sofacv
 {
 namespace features
@@ -35,6 +39,9 @@ MatchingConstraints::MatchingConstraints()
           "set to true to enable k-nearest neighbor filtering constraint")),
       d_knnLambda(initData(&d_knnLambda, 1.4f, "KNNThreshold",
                            "lambda value for KNNFilter (d2 / d1 < lambda)")),
+      d_parallel(initData(&d_parallel, false, "parallel",
+                          "if true, matches are filtered and gathered "
+                          "concurrently")),
       d_keypointsL_in(initData(
           &d_keypointsL_in, "keypoints1",
           "input keypoints left (usually from FeatureDetector)", true, true)),
@@ -50,15 +57,22 @@ MatchingConstraints::MatchingConstraints()
                    "input right descriptors  (usually from FeatureDetector)",
                    false, true)),
       d_matches_in(initData(&d_matches_in, "matches",
-                            "feature matches (usually from DescriptorMatcher)",
+                            "feature matches (usually from DescriptorMatcher)"
+                            ". Ignored if matchSet is set",
                             false, true)),
+      d_matchSet_in(initData(&d_matchSet_in, "matchSet",
+                             "feature matches stored contiguously (usually "
+                             "from DescriptorMatcher)",
+                             false, true)),
       d_matches_out(initData(&d_matches_out, "matches_out",
                              "output matches optional usage, as keypoints and "
                              "descriptors are already paired in their "
                              "respective vectors",
                              false, true)),
       d_outliers_out(initData(&d_outliers_out, "outliers",
-                              "output vector of outliers", false)),
+                              "output vector of outliers (indices of the "
+                              "rejected query descriptors)",
+                              false)),
       d_keypointsL_out(initData(&d_keypointsL_out, "keypoints1_out",
                                 "left keypoints", true, true)),
       d_keypointsR_out(initData(&d_keypointsR_out, "keypoints2_out",
@@ -66,7 +80,9 @@ MatchingConstraints::MatchingConstraints()
       d_descriptorsL_out(initData(&d_descriptorsL_out, "descriptors1_out",
                                   "left descriptors", false, true)),
       d_descriptorsR_out(initData(&d_descriptorsR_out, "descriptors2_out",
-                                  "right descriptors", false, true))
+                                  "right descriptors", false, true)),
+      m_input(nullptr),
+      m_epiDistValid(false)
 {
   addAlias(&d_outliers_out, "outliers_out");
 
@@ -81,6 +97,8 @@ void MatchingConstraints::init()
   addInput(&d_descriptorsL_in);
   addInput(&d_descriptorsR_in);
   addInput(&d_matches_in);
+  addInput(&d_matchSet_in);
+  addInput(&d_parallel);
 
   addOutput(&d_matches_out);
   addOutput(&d_outliers_out);
@@ -123,7 +141,8 @@ bool MatchingConstraints::computeEpipolarLines()
 
   if (d_keypointsL_in.getValue().empty())
   {
-    std::cout << "No Keypoints to compute epipolar lines for!" << std::endl;
+    msg_warning(getName() + "::computeEpipolarLines()")
+        << "No Keypoints to compute epipolar lines for!";
     return false;
   }
   std::vector<cv::Point2f> ptsL;
@@ -134,7 +153,7 @@ bool MatchingConstraints::computeEpipolarLines()
     ptsL.push_back(kp.pt);
   }
 
-  if (!l_cam.get() || !l_cam->getFundamentalMatrix().empty())
+  if (l_cam.get() && !l_cam->getFundamentalMatrix().empty())
   {
     cv::Mat F;
     matrix::sofaMat2cvMat(l_cam->getFundamentalMatrix(), F);
@@ -146,25 +165,59 @@ bool MatchingConstraints::computeEpipolarLines()
         << "Fundamental matrix not provided";
     return false;
   }
+
+  // Lines are given as a*x + b*y + c = 0: normalized once here, the distance
+  // of a point to its line is then just |a*x + b*y + c|
+  for (cv::Vec3f& line : m_epilines)
+    line *= 1.0f / std::sqrt(line(0) * line(0) + line(1) * line(1));
   return true;
 }
 
-float distancePointLine(const cv::Point2f point, const cv::Vec3f& line)
+bool MatchingConstraints::computeEpilineDistances(bool parallel)
 {
-  // Line is given as a*x + b*y + c = 0
-  return fabsf(line(0) * point.x + line(1) * point.y + line(2)) /
-         std::sqrt(line(0) * line(0) + line(1) * line(1));
+  if (!computeEpipolarLines()) return false;
+
+  const std::vector<cv::DMatch>& matches = m_input->matches;
+  const sofa::helper::vector<cvKeypoint>& PointsR = d_keypointsR_in.getValue();
+  m_epiDist.resize(matches.size());
+
+  auto distances = [&](const cv::Range& range) {
+    for (int j = range.start; j < range.end; ++j)
+    {
+      const cv::Vec3f& l = m_epilines[size_t(matches[size_t(j)].queryIdx)];
+      const cv::Point2f& p = PointsR[size_t(matches[size_t(j)].trainIdx)].pt;
+      m_epiDist[size_t(j)] = std::fabs(l(0) * p.x + l(1) * p.y + l(2));
+    }
+  };
+  cv::Range all(0, int(matches.size()));
+  if (parallel)
+    utils::parallelFor(all, distances);
+  else
+    distances(all);
+  return true;
+}
+
+const MatchSet& MatchingConstraints::inputMatches()
+{
+  if (d_matchSet_in.isSet()) return d_matchSet_in.getValue();
+
+  m_legacyMatches.clear();
+  for (const sofa::helper::SVector<cvDMatch>& m : d_matches_in.getValue())
+    m_legacyMatches.push_back(m.begin(), m.end());
+  return m_legacyMatches;
 }
 
 void MatchingConstraints::doUpdate()
 {
-  std::cout << getName() << std::endl;
   // All precomputations for the filters, only done once per new batch of
   // inputs
+  m_input = nullptr;
+  m_epiDistValid = false;
 
   // Making sure we have keypoints, and that we have an even number of keypoints
   // and descriptors
-  if (d_matches_in.getValue().empty())
+  const MatchSet& matches = inputMatches();
+  if (matches.empty())
   {
     msg_error(getName() + "::update()") << "Error: No match to filter!";
     return;
@@ -183,54 +236,14 @@ void MatchingConstraints::doUpdate()
         << "Error: number of Left keypoints and descriptors differ!";
     return;
   }
+  m_input = &matches;
 
+  /// retrieve maximum value for MDF, among the best match of each query
+  /// descriptor
   m_maxDist = .0;
-
-  // copy inputs into Opencv data structures:
-  std::vector<std::vector<cv::DMatch> > matches;
-  for (auto matchVector : d_matches_in.getValue())
-  {
-    std::vector<cv::DMatch> mvec;
-    for (auto match : matchVector) mvec.push_back(match);
-    matches.push_back(mvec);
-  }
-  const sofa::helper::vector<cvKeypoint>& PointsR = d_keypointsR_in.getValue();
-
-  /// Fill matchVector with all the necessary info:
-  m_matchVector.clear();
-
-  /// Precompute all epipolar lines for left keypoints
-  cv::Mat F;
-  matrix::sofaMat2cvMat(l_cam->getFundamentalMatrix(), F);
-  if (d_useEpipolarFilter.getValue()) computeEpipolarLines();
-
-  for (auto matchVector : matches)
-  {
-    /// retrieve maximum value for MDF
-    if (matchVector[0].distance > m_maxDist)
-      m_maxDist = matchVector[0].distance;
-
-    MatchVector mv;
-    mv.idxL = unsigned(matchVector[0].queryIdx);
-    for (const cv::DMatch& match : matchVector)
-    {
-      /// IF you want to filter distance according to EVERY match, including 2nd
-      /// degree matches & more, uncomment the following line:
-      //      if (match.distance > m_maxDist) m_maxDist = match.distance;
-
-      /// Storing, for each right match of a left point, its distance, index,
-      /// and
-      /// distance to the epipolar line
-      MatchStruct ms;
-      ms.distance = unsigned(match.distance);
-      ms.idxR = unsigned(match.trainIdx);
-      ms.distanceToEpiline =
-          unsigned(distancePointLine(PointsR[ms.idxR].pt, m_epilines[mv.idxL]));
-
-      mv.matches.push_back(ms);
-    }
-    m_matchVector.push_back(mv);
-  }
+  for (size_t q = 0; q < matches.size(); ++q)
+    if (matches.count(q) && matches.begin(q)->distance > m_maxDist)
+      m_maxDist = matches.begin(q)->distance;
 
   ImageFilter::update();
 
@@ -240,175 +253,145 @@ void MatchingConstraints::doUpdate()
   d_keypointsR_out.setValue(m_kpR);
   d_descriptorsL_out.setValue(m_descL);
   d_descriptorsR_out.setValue(m_descR);
-  std::cout << "final number of kpL: " << d_keypointsL_out.getValue().size()
-            << std::endl;
-}
-bool MatchingConstraints::EpipolarConstraintFilter(unsigned& filteredByEpipolar,
-                                                   unsigned i, MatchVector& ms,
-                                                   double epiDist)
-{
-  std::vector<MatchStruct> filteredMatches;
-  for (const MatchStruct& match : ms.matches)
-  {
-    if (epiDist >= match.distanceToEpiline) filteredMatches.push_back(match);
-  }
-  if (filteredMatches.empty())
-  {
-    m_outliers_out.push_back(i);
-    filteredByEpipolar++;
-    return false;
-  }
-  ms.matches = filteredMatches;
-  return true;
 }
 
-bool MatchingConstraints::KNearestNeighborFilter(unsigned i, double lambda,
-                                                 MatchVector& ms,
-                                                 unsigned& filteredByKNN)
+void MatchingConstraints::classify(const cv::Range& range, bool epipolar,
+                                   float epiDist, bool knn, float lambda,
+                                   bool mdf, float mdfDist)
 {
-  if (ms.matches[1].distance / ms.matches[0].distance < lambda)
-  {
-    m_outliers_out.push_back(i);
-    filteredByKNN++;
-    return false;
-  }
-  return true;
-}
+  const unsigned* offsets = m_input->offsets.data();
+  const cv::DMatch* matches = m_input->matches.data();
+  const float* distToEpiline = m_epiDist.data();
 
-bool MatchingConstraints::MinimalDistanceFilter(MatchVector& ms,
-                                                unsigned& filteredByMDF,
-                                                unsigned i, float mdfDist)
-{
-  std::vector<MatchStruct> filteredMatches;
-  for (const MatchStruct& match : ms.matches)
-  {
-    float mdfVal = match.distance / m_maxDist;
-    if (mdfDist > mdfVal) filteredMatches.push_back(match);
-  }
-  if (filteredMatches.empty())
+  for (int q = range.start; q < range.end; ++q)
   {
-    m_outliers_out.push_back(i);
-    filteredByMDF++;
-    return false;
+    // the 2 best matches within the epipolar threshold: the best one is the
+    // inlier candidate, the 2nd one is only needed for the KNN ratio test
+    int best = -1;
+    int second = -1;
+    for (unsigned j = offsets[q]; j < offsets[q + 1] && second < 0; ++j)
+    {
+      if (epipolar && distToEpiline[j] > epiDist) continue;
+      (best < 0) ? (best = int(j)) : (second = int(j));
+    }
+    m_best[size_t(q)] = best;
+
+    unsigned char status = INLIER;
+    if (offsets[q] == offsets[q + 1])
+      status = NO_MATCH;
+    else if (best < 0)
+      status = EPIPOLAR;
+    // KNN constraint filtering (k2 / k1 < lambda)
+    else if (knn && second >= 0 &&
+             matches[second].distance < lambda * matches[best].distance)
+      status = KNN;
+    // Minimal distance filtering
+    else if (mdf && !(matches[best].distance < mdfDist * m_maxDist))
+      status = MDF;
+    m_status[size_t(q)] = status;
   }
-  ms.matches = filteredMatches;
-  return true;
 }
 
-void MatchingConstraints::PushInlier(
-    const cvMat& descL, unsigned i,
-    const sofa::helper::vector<cvKeypoint>& PointsL, const cvMat& descR,
-    MatchVector& ms, const sofa::helper::vector<cvKeypoint>& PointsR)
+void MatchingConstraints::gatherInliers(const cv::Range& range)
 {
-  unsigned long inliersIdx = i - m_outliers_out.size();
-  m_matches.push_back(
-      cvDMatch(int(ms.idxL), int(ms.matches[0].idxR), ms.matches[0].distance));
-  m_kpL.push_back(PointsL[ms.idxL]);
-  m_kpR.push_back(PointsR[ms.matches[0].idxR]);
-
-  descL.row(int(ms.idxL)).copyTo(m_descL.row(int(inliersIdx)));
-  descR.row(int(ms.matches[0].idxR)).copyTo(m_descR.row(int(inliersIdx)));
-}
+  const sofa::helper::vector<cvKeypoint>& PointsL = d_keypointsL_in.getValue();
+  const sofa::helper::vector<cvKeypoint>& PointsR = d_keypointsR_in.getValue();
+  const cvMat& descL = d_descriptorsL_in.getValue();
+  const cvMat& descR = d_descriptorsR_in.getValue();
+  const size_t rowSizeL = descL.elemSize() * size_t(descL.cols);
+  const size_t rowSizeR = descR.elemSize() * size_t(descR.cols);
 
-void MatchingConstraints::ClearOutputVectors()
-{
-  m_matches.clear();
-  m_kpL.clear();
-  m_kpR.clear();
-  m_outliers_out.clear();
-  m_descL = cvMat();
-  m_descR = cvMat();
-
-  // preallocating space for structures based on the number of keypoints on the
-  // reference image (Left)
-  m_matches.reserve(d_keypointsL_in.getValue().size());
-  m_kpL.reserve(d_keypointsL_in.getValue().size());
-  m_kpR.reserve(d_keypointsL_in.getValue().size());
-  m_outliers_out.reserve(d_keypointsL_in.getValue().size());
-  m_descL = cvMat(int(d_keypointsL_in.getValue().size()),
-                  d_descriptorsL_in.getValue().cols,
-                  d_descriptorsL_in.getValue().type());
-  m_descR = cvMat(int(d_keypointsL_in.getValue().size()),
-                  d_descriptorsL_in.getValue().cols,
-                  d_descriptorsL_in.getValue().type());
+  for (int i = range.start; i < range.end; ++i)
+  {
+    const cv::DMatch& m =
+        m_input->matches[size_t(m_best[size_t(m_inliers[size_t(i)])])];
+    m_matches[size_t(i)] = cvDMatch(m.queryIdx, m.trainIdx, m.distance);
+    m_kpL[size_t(i)] = PointsL[size_t(m.queryIdx)];
+    m_kpR[size_t(i)] = PointsR[size_t(m.trainIdx)];
+    std::memcpy(m_descL.ptr(i), descL.ptr(m.queryIdx), rowSizeL);
+    std::memcpy(m_descR.ptr(i), descR.ptr(m.trainIdx), rowSizeR);
+  }
 }
 
 void MatchingConstraints::applyFilter(const cv::Mat& in, cv::Mat& out, bool)
 {
+  if (!m_input) return;
+
   // Actual application of filters, filling outputs
   bool epipolar = d_useEpipolarFilter.getValue();
-  double epiDist = d_epipolarThreshold.getValue();
+  float epiDist = float(d_epipolarThreshold.getValue());
 
   bool mdf = d_useMDFilter.getValue();
   float mdfDist = d_mdfRadius.getValue();
 
   bool knn = d_useKNNFilter.getValue();
-  double lambda = double(d_knnLambda.getValue());
-
-  // ensuring that initial output matches, keypoints and descriptors are empty
-  ClearOutputVectors();
+  float lambda = d_knnLambda.getValue();
+
+  bool parallel = d_parallel.getValue();
+
+  // distances to the epipolar lines are only computed once per batch of
+  // inputs, when the filter is first enabled
+  if (epipolar && !m_epiDistValid)
+    m_epiDistValid = computeEpilineDistances(parallel);
+  epipolar = epipolar && m_epiDistValid;
+
+  /// classify each query descriptor in a single pass over all its matches
+  const int nQueries = int(m_input->size());
+  m_best.resize(size_t(nQueries));
+  m_status.resize(size_t(nQueries));
+  auto classifyRange = [&](const cv::Range& range) {
+    classify(range, epipolar, epiDist, knn, lambda, mdf, mdfDist);
+  };
+  if (parallel)
+    utils::parallelFor(cv::Range(0, nQueries), classifyRange);
+  else
+    classifyRange(cv::Range(0, nQueries));
 
-  /// Prepare the output matrix to display the colored points
-  if (d_outputImage.getValue())
+  /// compact inliers / outliers
+  unsigned filtered[MatchStatus_COUNT] = {0};
+  m_inliers.clear();
+  m_outliers_out.clear();
+  for (int q = 0; q < nQueries; ++q)
   {
-    in.copyTo(out);
-    if (in.depth() == CV_32F)
-    {
-      std::cout << "converting to 8bit" << std::endl;
-      out.convertTo(out, 0, 255.0);
-    }
-    if (out.channels() == 1)
-    {
-      std::cout << "converting from grayscale to BGR" << std::endl;
-      cv::cvtColor(out, out, CV_GRAY2BGR);
-    }
+    unsigned char status = m_status[size_t(q)];
+    filtered[status]++;
+    if (status == INLIER)
+      m_inliers.push_back(q);
+    else
+      m_outliers_out.push_back(size_t(q));
   }
 
-  const sofa::helper::vector<cvKeypoint>& PointsL = d_keypointsL_in.getValue();
-  const sofa::helper::vector<cvKeypoint>& PointsR = d_keypointsR_in.getValue();
-
+  /// gather inliers' matches, keypoints and descriptors into output vectors
+  const int nInliers = int(m_inliers.size());
   const cvMat& descL = d_descriptorsL_in.getValue();
   const cvMat& descR = d_descriptorsR_in.getValue();
+  m_matches.resize(size_t(nInliers));
+  m_kpL.resize(size_t(nInliers));
+  m_kpR.resize(size_t(nInliers));
+  m_descL = cvMat(nInliers, descL.cols, descL.type());
+  m_descR = cvMat(nInliers, descR.cols, descR.type());
+  auto gatherRange = [&](const cv::Range& range) { gatherInliers(range); };
+  if (parallel)
+    utils::parallelFor(cv::Range(0, nInliers), gatherRange);
+  else
+    gatherRange(cv::Range(0, nInliers));
 
-  unsigned filteredByEpipolar = 0;
-  unsigned filteredByKNN = 0;
-  unsigned filteredByMDF = 0;
-
-  /// Start filtering points out
-  for (unsigned i = 0; i < m_matchVector.size(); ++i)
+  /// Prepare the output matrix to display the colored points
+  if (d_outputImage.getValue())
   {
-    MatchVector& ms = m_matchVector[i];
-
-    // Epipolar constraint filtering
-    if (epipolar &&
-        !EpipolarConstraintFilter(filteredByEpipolar, i, ms, epiDist))
-      continue;
-
-    // KNN constraint filtering (k2 / k1 < lambda)
-    if (knn && ms.matches.size() > 1 &&
-        !KNearestNeighborFilter(i, lambda, ms, filteredByKNN))
-      continue;
-
-    // Minimal distance filtering
-    if (mdf && !MinimalDistanceFilter(ms, filteredByMDF, i, mdfDist)) continue;
-
-    /// store Inliers into output vectors
-    PushInlier(descL, i, PointsL, descR, ms, PointsR);
-
-    // Draw inlier on output image
-    if (d_outputImage.getValue())
-      cv::circle(out, m_kpL.back().pt, 3, cv::Scalar(0, 255, 0));
+    in.copyTo(out);
+    if (in.depth() == CV_32F) out.convertTo(out, CV_8U, 255.0);
+    if (out.channels() == 1)
+      cv::cvtColor(out, out, CV_GRAY2BGR);
+    // Draw inliers on output image
+    for (const cvKeypoint& kp : m_kpL)
+      cv::circle(out, kp.pt, 3, cv::Scalar(0, 255, 0));
   }
 
-  std::cout << "inliers: " << m_kpL.size() << std::endl;
-
-  std::cout << filteredByEpipolar << " points filtered by Epipolar Constraint"
-            << std::endl;
-  std::cout << filteredByKNN << " points filtered by K-Nearest-Neighbor"
-            << std::endl;
-  std::cout << filteredByMDF << " points filtered by Minimal Distance"
-            << std::endl;
-  std::cout << m_outliers_out.size() << " outliers in total" << std::endl;
+  msg_info() << m_kpL.size() << " inliers, " << m_outliers_out.size()
+             << " outliers (" << filtered[EPIPOLAR] << " epipolar, "
+             << filtered[KNN] << " k-nearest-neighbor, " << filtered[MDF]
+             << " minimal distance)";
 }
 
 }  // namespace features
@@ -3,6 +3,7 @@
 
 #include <SofaCV/SofaCV.h>
 #include "Detectors.h"
+#include "MatchSet.h"
 #include "camera/common/StereoSettings.h"
 
 #include <sofa/helper/OptionsGroup.h>
@@ -40,12 +41,14 @@ class SOFA_IMAGEPROCESSING_API MatchingConstraints : public ImageFilter
   sofa::Data<float> d_mdfRadius;
   sofa::Data<bool> d_useKNNFilter;
   sofa::Data<float> d_knnLambda;
+  sofa::Data<bool> d_parallel;
   sofa::Data<sofa::helper::vector<cvKeypoint> > d_keypointsL_in;
   sofa::Data<sofa::helper::vector<cvKeypoint> > d_keypointsR_in;
   sofa::Data<cvMat> d_descriptorsL_in;
   sofa::Data<cvMat> d_descriptorsR_in;
   sofa::Data<sofa::helper::SVector<sofa::helper::SVector<cvDMatch> > >
       d_matches_in;
+  sofa::Data<MatchSet> d_matchSet_in;
 
   // OUTPUTS
   sofa::Data<sofa::helper::vector<cvDMatch> > d_matches_out;
@@ -61,36 +64,40 @@ class SOFA_IMAGEPROCESSING_API MatchingConstraints : public ImageFilter
   cvMat m_descL, m_descR;
   sofa::helper::vector<size_t> m_outliers_out;
 
-  std::vector<cv::Vec3f> m_epilines;
+  std::vector<cv::Vec3f> m_epilines;  ///< normalized, per left keypoint
   float m_maxDist;
 
-  struct MatchStruct
+  enum MatchStatus
   {
-    unsigned idxR;
-    unsigned distance;
-    unsigned distanceToEpiline;
+    INLIER = 0,
+    NO_MATCH,
+    EPIPOLAR,
+    KNN,
+    MDF,
+    MatchStatus_COUNT
   };
 
-  struct MatchVector
-  {
-    unsigned idxL;
-    std::vector<MatchStruct> matches;
-  };
-  std::vector<MatchVector> m_matchVector;
+  // Filters run in one pass over flat arrays indexed like the input MatchSet:
+  // per match (m_epiDist) or per query descriptor (m_best, m_status)
+  const MatchSet* m_input;  ///< matches to filter, null if inputs are invalid
+  MatchSet m_legacyMatches;  ///< d_matches_in, when matchSet is not set
+  std::vector<float> m_epiDist;  ///< distance of each match to its epiline
+  bool m_epiDistValid;
+  std::vector<int> m_best;  ///< best match within the epipolar threshold
+  std::vector<unsigned char> m_status;  ///< MatchStatus of each query
+  std::vector<int> m_inliers;  ///< inlier query descriptors, in order
+
+  /// the input matches, from matchSet or else from the legacy matches input
+  const MatchSet& inputMatches();
 
   bool computeEpipolarLines();
+  bool computeEpilineDistances(bool parallel);
 
-  bool EpipolarConstraintFilter(unsigned& filteredByEpipolar, unsigned i,
-                                MatchVector& ms, double epiDist);
-  bool KNearestNeighborFilter(unsigned i, double lambda, MatchVector& ms,
-                              unsigned& filteredByKNN);
-  bool MinimalDistanceFilter(MatchVector& ms, unsigned& filteredByMDF,
-                             unsigned i, float mdfDist);
-  void PushInlier(const cvMat& descL, unsigned i,
-                  const sofa::helper::vector<cvKeypoint>& PointsL,
-                  const cvMat& descR, MatchVector& ms,
-                  const sofa::helper::vector<cvKeypoint>& PointsR);
-  void ClearOutputVectors();
+  /// sets m_best and m_status of the query descriptors in range
+  void classify(const cv::Range& range, bool epipolar, float epiDist, bool knn,
+                float lambda, bool mdf, float mdfDist);
+  /// copies the matches, keypoints and descriptors of m_inliers[range]
+  void gatherInliers(const cv::Range& range);
 };
 
 }  // namespace features
@@ -1,11 +1,50 @@
 #include "OpticalFlow.h"
+#include "utils/ParallelFor.h"
+#include "utils/ReleaseIfShared.h"
+
 #include <opencv2/imgproc.hpp>
 #include <opencv2/video.hpp>
 
+#include <algorithm>
+
 namespace sofacv
 {
 namespace features
 {
+namespace
+{
+/// converts a frame to grayscale, into 'gray' unless it already is
+void toGray(const cv::Mat& in, cv::Mat& gray)
+{
+  if (in.type() == CV_8UC1)
+  {
+    gray = in;
+    return;
+  }
+  utils::releaseIfShared(gray);
+  cv::cvtColor(in, gray, CV_BGRA2GRAY);
+}
+
+/// whether the levels' borders hold the winSize pixels calcOpticalFlowPyrLK
+/// reads around them (it asserts it on pyramid inputs)
+bool hasBorder(const sofa::helper::vector<cvMat>& pyramid,
+               const cv::Size& winSize)
+{
+  cv::Size whole;
+  cv::Point ofs;
+  for (const cv::Mat& level : pyramid)
+  {
+    level.locateROI(whole, ofs);
+    if (ofs.x < winSize.width || ofs.y < winSize.height ||
+        ofs.x + level.cols + winSize.width > whole.width ||
+        ofs.y + level.rows + winSize.height > whole.height)
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
 OpticalFlow::OpticalFlow()
     : d_winSize(initData(&d_winSize, sofa::defaulttype::Vec2i(21, 21),
                          "win_size", "")),
@@ -28,8 +67,47 @@ OpticalFlow::OpticalFlow()
       d_error_out(initData(&d_error_out, "error_out", "tracking error")),
       d_img2(initData(&d_img2, "img2",
                       "second image to use for the optical flow (do not use if "
-                      "you want to detect flow between 2 simulation steps)"))
+                      "you want to detect flow between 2 simulation steps)")),
+      d_pyramid(initData(&d_pyramid, "pyramid",
+                         "(optional) pyramid of the input frame, as built by "
+                         "an ImagePyramid component. When set, the flow is "
+                         "computed between the previous and current frames' "
+                         "pyramids instead of rebuilding them")),
+      d_maxError(initData(&d_maxError, 0.0, "max_error",
+                          "tracks with a larger error are dropped (0 to only "
+                          "drop the tracks that were lost)")),
+      d_maxPoints(initData(&d_maxPoints, 0, "max_points",
+                           "if > 0, new corners are detected in the empty "
+                           "cells of the grid to keep this many tracks")),
+      d_grid(initData(&d_grid, sofa::defaulttype::Vec2i(8, 6), "grid",
+                      "number of cells along x and y of the re-detection "
+                      "grid")),
+      d_qualityLevel(initData(&d_qualityLevel, 0.01, "quality_level",
+                              "minimal quality of the detected corners, "
+                              "relative to the best one of their cell")),
+      d_minDistance(initData(&d_minDistance, 10.0, "min_distance",
+                             "minimal distance between detected corners")),
+      d_ids_out(initData(&d_ids_out, "ids_out",
+                         "track id of each output point (index in 'points' "
+                         "for the input points)")),
+      d_fbThreshold(initData(&d_fbThreshold, 0.0, "fb_threshold",
+                             "if > 0, points tracked back to the previous "
+                             "frame farther than this many pixels from "
+                             "their start are dropped")),
+      d_chunkSize(initData(&d_chunkSize, 256, "chunk_size",
+                           "number of points per chunk of tracked points: "
+                           "chunks are tracked concurrently")),
+      d_visualization(initData(&d_visualization, "visualization",
+                               "debug output (OVERLAY: previous frame "
+                               "blended in red, TRACKS: track arrows)")),
+      m_externalPyramid(false),
+      m_pyramidBorderWarned(false),
+      m_nextId(0)
 {
+  sofa::helper::OptionsGroup* t = d_visualization.beginEdit();
+  t->setNames(2, "OVERLAY", "TRACKS");
+  t->setSelectedItem("OVERLAY");
+  d_visualization.endEdit();
 }
 
 void OpticalFlow::init()
@@ -38,143 +116,324 @@ void OpticalFlow::init()
   registerData(&d_maxCount, 0, 100, 1);
   registerData(&d_epsilon, 0.0, 0.2, 0.001);
   registerData(&d_minEigThresh, 0.001, 0.1, 0.001);
+  registerData(&d_maxError, 0.0, 100.0, 0.5);
+  registerData(&d_maxPoints, 0, 2000, 10);
+  registerData(&d_fbThreshold, 0.0, 10.0, 0.1);
+  registerData(&d_visualization);
 
   addInput(&d_points_in);
   addInput(&d_img2);
+  addInput(&d_pyramid);
   addOutput(&d_points_out);
+  addOutput(&d_status_out);
   addOutput(&d_error_out);
+  addOutput(&d_ids_out);
   ImageFilter::init();
 }
 
-void OpticalFlow::applyFilter(const cv::Mat& in, cv::Mat& out, bool)
+void OpticalFlow::resetTracks()
 {
-  cv::Mat gray;
-  if (in.empty()) return;
+  const sofa::helper::vector<sofa::defaulttype::Vec2d>& points =
+      d_points_in.getValue();
+  m_pts_in.resize(points.size());
+  m_ids.resize(points.size());
+  for (size_t i = 0; i < points.size(); ++i)
+  {
+    m_pts_in[i] = cv::Point2f(float(points[i].x()), float(points[i].y()));
+    m_ids[i] = i;
+  }
+  m_nextId = points.size();
+}
 
-  if (!d_startTracking.getValue() || m_pts_in.empty())
+void OpticalFlow::trackPoints(const cv::Size& winSize, int maxLevel)
+{
+  const size_t n = m_pts_in.size();
+  const int flags = d_flags.getValue();
+  const double minEig = d_minEigThresh.getValue();
+  const double fbThreshold = d_fbThreshold.getValue();
+  const cv::TermCriteria tc =
+      cv::TermCriteria(d_criteria_type.getValue(), d_maxCount.getValue(),
+                       d_epsilon.getValue());
+
+  // with OPTFLOW_USE_INITIAL_FLOW, the points start from their last position
+  m_pts_out = m_pts_in;
+  m_status.resize(n);
+  m_error.resize(n);
+  if (fbThreshold > 0.0)
   {
-    // Keep things well initialized:
-    if (!m_prev.empty())  // m_prev should stay empty
-      m_prev.zeros(m_prev.rows, m_prev.cols, m_prev.type());
+    // the backward pass starts from the original positions
+    m_pts_back = m_pts_in;
+    m_backStatus.resize(n);
+    m_backError.resize(n);
+  }
 
-    // set prev_points to the current input
-    if (d_points_in.getValue().empty()) return;
-    m_pts_in.reserve(d_points_in.getValue().size());
-    m_pts_in.clear();
-    for (const sofa::defaulttype::Vec2d& pt : d_points_in.getValue())
-      m_pts_in.push_back(cv::Point2f(pt.x(), pt.y()));
+  // each chunk is tracked forward then backward, so the backward pass of a
+  // chunk runs alongside the forward passes of the others. Chunks write in
+  // place into the output vectors, through Mat headers of the right size
+  // and type that calcOpticalFlowPyrLK does not reallocate
+  const int chunkSize = std::max(1, d_chunkSize.getValue());
+  const int nChunks = int((n + size_t(chunkSize) - 1) / size_t(chunkSize));
+  utils::parallelFor(
+      cv::Range(0, nChunks),
+      [&](const cv::Range& range) {
+        for (int c = range.start; c < range.end; ++c)
+        {
+          const size_t begin = size_t(c) * size_t(chunkSize);
+          const int count = int(std::min(size_t(chunkSize), n - begin));
+          cv::Mat prevPts(count, 1, CV_32FC2, &m_pts_in[begin]);
+          cv::Mat nextPts(count, 1, CV_32FC2, &m_pts_out[begin]);
+          cv::Mat status(count, 1, CV_8UC1, &m_status[begin]);
+          cv::Mat error(count, 1, CV_32FC1, &m_error[begin]);
+          cv::calcOpticalFlowPyrLK(m_prevPyramid, m_pyramid, prevPts, nextPts,
+                                   status, error, winSize, maxLevel, tc,
+                                   flags, minEig);
+          if (fbThreshold <= 0.0) continue;
 
-    // copy in in out
-    in.copyTo(out);
-    d_points_out.setValue(d_points_in.getValue());
-    return;
+          cv::Mat backPts(count, 1, CV_32FC2, &m_pts_back[begin]);
+          cv::Mat backStatus(count, 1, CV_8UC1, &m_backStatus[begin]);
+          cv::Mat backError(count, 1, CV_32FC1, &m_backError[begin]);
+          cv::calcOpticalFlowPyrLK(
+              m_pyramid, m_prevPyramid, nextPts, backPts, backStatus,
+              backError, winSize, maxLevel, tc,
+              flags | cv::OPTFLOW_USE_INITIAL_FLOW, minEig);
+          const double maxDist2 = fbThreshold * fbThreshold;
+          for (size_t i = begin; i < begin + size_t(count); ++i)
+          {
+            const cv::Point2f d = m_pts_back[i] - m_pts_in[i];
+            if (!m_backStatus[i] || d.dot(d) > maxDist2) m_status[i] = 0;
+          }
+        }
+      },
+      nChunks);
+}
+
+void OpticalFlow::pruneTracks(const cv::Size& size)
+{
+  const float maxError = float(d_maxError.getValue());
+  size_t n = 0;
+  for (size_t i = 0; i < m_pts_out.size(); ++i)
+  {
+    const cv::Point2f& p = m_pts_out[i];
+    if (!m_status[i] || (maxError > 0.0f && m_error[i] > maxError) ||
+        p.x < 0.0f || p.y < 0.0f || p.x >= float(size.width) ||
+        p.y >= float(size.height))
+      continue;
+    m_pts_out[n] = p;
+    m_pts_in[n] = m_pts_in[i];
+    m_ids[n] = m_ids[i];
+    m_error[n] = m_error[i];
+    m_status[n] = 1;
+    ++n;
   }
+  m_pts_out.resize(n);
+  m_pts_in.resize(n);
+  m_ids.resize(n);
+  m_error.resize(n);
+  m_status.resize(n);
+}
 
-  // IF THE TRACKER HAS BEEN STARTED:
-  if (in.type() != CV_8UC1)
-    cv::cvtColor(in, gray, CV_BGRA2GRAY);
-  else
-    gray = in;
+void OpticalFlow::detectFeatures(const cv::Mat& gray)
+{
+  const int maxPoints = d_maxPoints.getValue();
+  if (maxPoints <= 0 || int(m_pts_out.size()) >= maxPoints) return;
 
-  if (d_img2.isSet())
+  const int gx = std::max(1, d_grid.getValue().x());
+  const int gy = std::max(1, d_grid.getValue().y());
+  const int w = gray.cols, h = gray.rows;
+
+  // only the cells without any track are searched, so the detection cost is
+  // bounded by the area left uncovered
+  m_cellCount.assign(size_t(gx * gy), 0);
+  for (const cv::Point2f& p : m_pts_out)
+  {
+    // tracks that drifted out of the image are not pruned yet on the first
+    // tracked frame: they cover no cell
+    if (!(p.x >= 0 && p.y >= 0 && p.x < w && p.y < h)) continue;
+    const int cx = std::min(gx - 1, int(p.x) * gx / w);
+    const int cy = std::min(gy - 1, int(p.y) * gy / h);
+    ++m_cellCount[size_t(cy * gx + cx)];
+  }
+  m_emptyCells.clear();
+  for (int c = 0; c < gx * gy; ++c)
+    if (!m_cellCount[size_t(c)]) m_emptyCells.push_back(c);
+  if (m_emptyCells.empty()) return;
+
+  const int perCell = (maxPoints + gx * gy - 1) / (gx * gy);
+  const double quality = d_qualityLevel.getValue();
+  const double minDistance = d_minDistance.getValue();
+  m_cellCorners.resize(m_emptyCells.size());
+  utils::parallelFor(
+      cv::Range(0, int(m_emptyCells.size())), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i)
+        {
+          const int cx = m_emptyCells[size_t(i)] % gx;
+          const int cy = m_emptyCells[size_t(i)] / gx;
+          const cv::Rect cell(cv::Point(w * cx / gx, h * cy / gy),
+                              cv::Point(w * (cx + 1) / gx, h * (cy + 1) / gy));
+          std::vector<cv::Point2f>& corners = m_cellCorners[size_t(i)];
+          corners.clear();
+          if (cell.area() == 0) continue;
+          cv::goodFeaturesToTrack(gray(cell), corners, perCell, quality,
+                                  minDistance);
+          for (cv::Point2f& p : corners)
+            p += cv::Point2f(float(cell.x), float(cell.y));
+        }
+      });
+
+  for (const std::vector<cv::Point2f>& corners : m_cellCorners)
+    for (const cv::Point2f& p : corners)
+    {
+      if (int(m_pts_out.size()) >= maxPoints) return;
+      m_pts_out.push_back(p);
+      m_ids.push_back(m_nextId++);
+      m_status.push_back(0);
+      m_error.push_back(0.0f);
+    }
+}
+
+void OpticalFlow::writeOutputs()
+{
+  sofa::helper::vector<sofa::defaulttype::Vec2d>& points =
+      *d_points_out.beginWriteOnly();
+  points.resize(m_pts_out.size());
+  for (size_t i = 0; i < m_pts_out.size(); ++i)
+    points[i] = sofa::defaulttype::Vec2d(m_pts_out[i].x, m_pts_out[i].y);
+  d_points_out.endEdit();
+
+  sofa::helper::vector<uchar>& status = *d_status_out.beginWriteOnly();
+  status.assign(m_status.begin(), m_status.end());
+  d_status_out.endEdit();
+  sofa::helper::vector<float>& error = *d_error_out.beginWriteOnly();
+  error.assign(m_error.begin(), m_error.end());
+  d_error_out.endEdit();
+  sofa::helper::vector<size_t>& ids = *d_ids_out.beginWriteOnly();
+  ids.assign(m_ids.begin(), m_ids.end());
+  d_ids_out.endEdit();
+}
+
+void OpticalFlow::drawDebug(const cv::Mat& in, cv::Mat& out)
+{
+  if (d_visualization.getValue().getSelectedId() == 1)
   {
-    if (d_img2.getValue().type() != CV_8UC1)
-      cv::cvtColor(d_img2.getValue(), m_prev, CV_BGRA2GRAY);
+    // tracked points as arrows from their previous position, new ones as
+    // circles
+    if (in.channels() == 1)
+      cv::cvtColor(in, out, CV_GRAY2BGR);
     else
-      m_prev = d_img2.getValue();
-    // set prev_points to the current input
-    if (d_points_in.getValue().empty()) return;
-    m_pts_in.reserve(d_points_in.getValue().size());
-    m_pts_in.clear();
-    for (const sofa::defaulttype::Vec2d& pt : d_points_in.getValue())
-      m_pts_in.push_back(cv::Point2f(pt.x(), pt.y()));
+      in.copyTo(out);
+    for (size_t i = 0; i < m_pts_out.size(); ++i)
+      if (m_status[i] && i < m_pts_in.size())
+        cv::arrowedLine(out, m_pts_in[i], m_pts_out[i], cv::Scalar(0, 255, 0),
+                        1, cv::LINE_AA);
+      else
+        cv::circle(out, m_pts_out[i], 3, cv::Scalar(0, 0, 255), 1,
+                   cv::LINE_AA);
+    return;
   }
-  // If it's the first step of the optical flow:
+
   if (m_prev.empty())
   {
-    // we then want to initialize some of the prev values:
-    m_prev = gray.clone();
+    in.copyTo(out);
     return;
   }
+  // the previous frame's dark areas (<= 128), amplified 5 times, are added
+  // to the red channel of the current frame
+  if (m_lut.empty())
+  {
+    m_lut.create(1, 256, CV_8U);
+    for (int v = 0; v < 256; ++v)
+      m_lut.at<uchar>(v) = (v > 128) ? 0 : cv::saturate_cast<uchar>(v * 5);
+  }
+  cv::LUT(m_prev, m_lut, m_red);
+  cv::add(m_red, m_gray, m_red);
+  const cv::Mat channels[] = {m_gray, m_gray, m_red};
+  cv::merge(channels, 3, out);
+}
 
-  m_pts_out = m_pts_in;
+void OpticalFlow::applyFilter(const cv::Mat& in, cv::Mat& out, bool)
+{
+  if (in.empty()) return;
 
-  if (m_pts_in.empty() || m_prev.empty() || gray.empty())
+  if (!d_startTracking.getValue() ||
+      (m_pts_in.empty() && d_maxPoints.getValue() <= 0))
   {
-    msg_error(getName() + "::applyFilter()")
-        << "something is wrong: please check your input frames and / "
-           "or input points";
+    // tracking (re)starts from the input points on the next frame
+    m_prev.release();
+    m_prevPyramid.clear();
+    resetTracks();
+
+    // copy in in out
+    in.copyTo(out);
+    d_points_out.setValue(d_points_in.getValue());
     return;
   }
-  std::vector<uchar> status = d_status_out.getValue();
-  std::vector<float> error = d_error_out.getValue();
 
-  cv::TermCriteria tc = cv::TermCriteria(
-      d_criteria_type.getValue(), d_maxCount.getValue(), d_epsilon.getValue());
-  cv::Size winSize(d_winSize.getValue().x(), d_winSize.getValue().y());
+  // IF THE TRACKER HAS BEEN STARTED:
+  toGray(in, m_gray);
+  const cv::Size winSize(d_winSize.getValue().x(), d_winSize.getValue().y());
 
-  cv::calcOpticalFlowPyrLK(m_prev, gray, m_pts_in, m_pts_out, status, error,
-                           winSize, d_maxLevel.getValue(), tc,
-                           d_flags.getValue(), d_minEigThresh.getValue());
+  // the shared pyramid can only be used when tracking between 2 steps, and
+  // if it was built with a border of at least win_size
+  bool usePyramid = !d_img2.isSet() && !d_pyramid.getValue().empty();
+  if (usePyramid && !hasBorder(d_pyramid.getValue(), winSize))
+  {
+    if (!m_pyramidBorderWarned)
+      msg_warning(getName() + "::update()")
+          << "the pyramid's border is smaller than win_size: the pyramid is "
+             "rebuilt instead (set the ImagePyramid's win_size to at least "
+          << winSize.width << " " << winSize.height << ")";
+    m_pyramidBorderWarned = true;
+    usePyramid = false;
+  }
+  else
+    m_pyramidBorderWarned = false;
+  if (usePyramid != m_externalPyramid) m_prevPyramid.clear();
+  m_externalPyramid = usePyramid;
+  int maxLevel = d_maxLevel.getValue();
+  if (usePyramid)
+    m_pyramid.assign(d_pyramid.getValue().begin(), d_pyramid.getValue().end());
+  else
+    maxLevel = cv::buildOpticalFlowPyramid(m_gray, m_pyramid, winSize,
+                                           maxLevel);
 
-  sofa::helper::vector<sofa::defaulttype::Vec2d> points_out =
-      d_points_out.getValue();
-  sofa::helper::vector<sofa::defaulttype::Vec2d> points_in =
-      d_points_in.getValue();
-  points_out.clear();
-  points_in.clear();
-  for (size_t i = 0; i < m_pts_out.size(); ++i)
+  if (d_img2.isSet())
   {
-    cv::Point2f ptPrev, ptNext;
-    ptPrev = m_pts_in[i];
-    ptNext = m_pts_out[i];
-    points_out.push_back(sofa::defaulttype::Vec2d(ptNext.x, ptNext.y));
-    points_in.push_back(sofa::defaulttype::Vec2d(ptPrev.x, ptPrev.y));
+    // flow from img2 to the input frame, for the input points
+    toGray(d_img2.getValue(), m_prev);
+    cv::buildOpticalFlowPyramid(m_prev, m_prevPyramid, winSize, maxLevel);
+    resetTracks();
   }
-  d_status_out.setValue(status);
-  d_error_out.setValue(error);
-
-  //    // copy in in out
-  //    in.copyTo(out);
-  //    if (d_outputImage.getValue())
-  //    {
-  //        for (size_t i = 0; i < m_pts_out.size(); ++i)
-  //        {
-  //            if (!status[i])
-  //                cv::circle(out, m_pts_out[i], 3, cv::Scalar(0, 0, 255), 1
-  //                           , cv::LINE_AA);
-  //            else
-  //                cv::circle(out, m_pts_out[i], 3, cv::Scalar(0, 255, 0), 1
-  //                           , cv::LINE_AA);
-  //        }
-  //    }
-
-  // copy in in out
-  in.copyTo(out);
-  if (d_outputImage.getValue())
+
+  if (!m_prevPyramid.empty() && !m_pts_in.empty())
+  {
+    // with a shared pyramid, both frames' pyramids come from the same
+    // ImagePyramid and have as many levels
+    if (usePyramid)
+      maxLevel = std::min(maxLevel, int(std::min(m_prevPyramid.size(),
+                                                 m_pyramid.size())) - 1);
+    trackPoints(winSize, maxLevel);
+    pruneTracks(m_gray.size());
+  }
+  else
   {
-    cv::Mat visu;
-    cv::cvtColor(gray, gray, CV_GRAY2BGR);
-    m_prev.copyTo(visu);
-    cv::Mat zero = cv::Mat::zeros(visu.rows, visu.cols, visu.type());
-    for (int i = 0; i < visu.cols; ++i)
-      for (int j = 0; j < visu.rows; ++j)
-        if (visu.at<uchar>(i, j) > 128)
-          visu.at<uchar>(i, j) = 0;
-        else
-          visu.at<uchar>(i, j) *= 5;
-
-    std::vector<cv::Mat> channels;
-    channels.push_back(zero);
-    channels.push_back(zero);
-    channels.push_back(visu);
-    cv::merge(channels, visu);
-
-    cv::add(visu, gray, out);
+    // first tracked frame: the tracks start from their current position
+    m_pts_out = m_pts_in;
+    m_status.assign(m_pts_out.size(), 0);
+    m_error.assign(m_pts_out.size(), 0.0f);
   }
-  m_pts_in = m_pts_out;
-  d_points_out.setValue(points_out);
-  m_prev = gray.clone();
+  detectFeatures(m_gray);
+  writeOutputs();
+
+  if (d_outputImage.getValue())
+    drawDebug(in, out);
+  else
+    in.copyTo(out);
+
+  // the current frame, pyramid and points become the previous ones, and
+  // their buffers are reused for the next frame
+  m_pts_in.swap(m_pts_out);
+  cv::swap(m_prev, m_gray);
+  m_prevPyramid.swap(m_pyramid);
 }
 
 }  // namespace features
@@ -5,12 +5,30 @@
 #include "ImageProcessingPlugin.h"
 
 #include <sofa/defaulttype/Vec.h>
+#include <sofa/helper/OptionsGroup.h>
 #include <sofa/helper/vector.h>
 
 namespace sofacv
 {
 namespace features
 {
+/**
+ * @brief The OpticalFlow class
+ *
+ * Pyramidal Lucas-Kanade tracker. Once started, the points are tracked from
+ * one step to the next: the previous frame's pyramid is kept and reused,
+ * tracks that failed (or whose error exceeds max_error, or that left the
+ * image) are dropped, and if max_points is set, new corners are detected in
+ * the empty cells of a grid to keep the number of tracks up to max_points.
+ * Each output point has a track id: its index in 'points' for the input
+ * points, and new ids for the detected ones.
+ * If fb_threshold is set, each point is also tracked back from the current
+ * frame to the previous one, and dropped if it does not land within
+ * fb_threshold pixels of where it started (forward-backward check). Large
+ * point sets are split in chunks tracked concurrently.
+ * If img2 is set, the flow is instead computed from img2 to the input frame,
+ * for the input points, at every step.
+ */
 class SOFA_IMAGEPROCESSING_API OpticalFlow : public ImageFilter
 {
  public:
@@ -29,6 +47,16 @@ class SOFA_IMAGEPROCESSING_API OpticalFlow : public ImageFilter
   sofa::Data<bool> d_startTracking;
   sofa::Data<sofa::helper::vector<float> > d_error_out;
   sofa::Data<sofacv::cvMat> d_img2;
+  sofa::Data<sofa::helper::vector<cvMat> > d_pyramid;
+  sofa::Data<double> d_maxError;  ///< max tracking error (0: not checked)
+  sofa::Data<int> d_maxPoints;    ///< track count kept up by re-detection
+  sofa::Data<sofa::defaulttype::Vec2i> d_grid;  ///< re-detection grid
+  sofa::Data<double> d_qualityLevel;  ///< min corner quality of new points
+  sofa::Data<double> d_minDistance;   ///< min distance between new points
+  sofa::Data<sofa::helper::vector<size_t> > d_ids_out;  ///< track ids
+  sofa::Data<double> d_fbThreshold;  ///< forward-backward error (0: off)
+  sofa::Data<int> d_chunkSize;       ///< points per concurrent LK call
+  sofa::Data<sofa::helper::OptionsGroup> d_visualization;  ///< debug output
 
   std::vector<cv::Point2f> m_pts_in;
   std::vector<cv::Point2f> m_pts_out;
@@ -40,7 +68,47 @@ class SOFA_IMAGEPROCESSING_API OpticalFlow : public ImageFilter
   void applyFilter(const cv::Mat& in, cv::Mat& out, bool);
 
  private:
+  /// restarts the tracks from the input points
+  void resetTracks();
+  /// tracks m_pts_in into m_pts_out, forward and optionally backward
+  void trackPoints(const cv::Size& winSize, int maxLevel);
+  /// drops the tracks that failed or left the image
+  void pruneTracks(const cv::Size& size);
+  /// detects new points in the empty grid cells, up to max_points tracks
+  void detectFeatures(const cv::Mat& gray);
+  void writeOutputs();
+  /// draws the debug output selected by 'visualization'
+  void drawDebug(const cv::Mat& in, cv::Mat& out);
+
   cv::Mat m_prev;
+  cv::Mat m_gray;
+
+  // previous and current frame's pyramids, either built here or provided
+  // through 'pyramid'
+  std::vector<cv::Mat> m_prevPyramid;
+  std::vector<cv::Mat> m_pyramid;
+  bool m_externalPyramid;
+  bool m_pyramidBorderWarned;  ///< the shared pyramid's border is too small
+
+  // current tracks, aligned with m_pts_out
+  std::vector<size_t> m_ids;
+  std::vector<uchar> m_status;
+  std::vector<float> m_error;
+  size_t m_nextId;
+
+  // backward tracking results, for the forward-backward check
+  std::vector<cv::Point2f> m_pts_back;
+  std::vector<uchar> m_backStatus;
+  std::vector<float> m_backError;
+
+  // re-detection buffers
+  std::vector<int> m_cellCount;
+  std::vector<int> m_emptyCells;
+  std::vector<std::vector<cv::Point2f> > m_cellCorners;
+
+  // debug output buffers
+  cv::Mat m_lut;
+  cv::Mat m_red;
 };
 
 SOFA_DECL_CLASS(OpticalFlow)
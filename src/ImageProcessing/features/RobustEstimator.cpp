@@ -0,0 +1,429 @@
+#include "RobustEstimator.h"
+#include "utils/ParallelFor.h"
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <numeric>
+
+namespace sofacv
+{
+namespace features
+{
+namespace
+{
+/// least squares refinements of each new best model
+const int kLoIterations = 4;
+/// SPRT's prior probability for a match to be consistent with a bad model
+const double kInitialDelta = 0.05;
+
+/// 7-point minimal solver, squared Sampson error
+struct FundamentalModel
+{
+  enum
+  {
+    sampleSize = 7,
+    minFitSize = 8,
+    maxModels = 3
+  };
+  /// cost of a hypothesis in number of verified matches, and average number
+  /// of models per sample, for the SPRT (Matas & Chum)
+  static double modelCost() { return 200.0; }
+  static double modelsPerSample() { return 2.38; }
+
+  static int solve(cv::Point2f* a, cv::Point2f* b, cv::Matx33d* models)
+  {
+    cv::Mat F = cv::findFundamentalMat(cv::Mat(sampleSize, 1, CV_32FC2, a),
+                                       cv::Mat(sampleSize, 1, CV_32FC2, b),
+                                       cv::FM_7POINT);
+    int n = std::min(F.rows / 3, int(maxModels));
+    for (int i = 0; i < n; ++i) models[i] = cv::Matx33d(F.ptr<double>(3 * i));
+    return n;
+  }
+
+  static bool fit(const std::vector<cv::Point2f>& a,
+                  const std::vector<cv::Point2f>& b, cv::Matx33d& M)
+  {
+    cv::Mat F = cv::findFundamentalMat(a, b, cv::FM_8POINT);
+    if (F.rows != 3) return false;
+    M = cv::Matx33d(F.ptr<double>());
+    return true;
+  }
+
+  static inline double error(const cv::Matx33d& F, const cv::Point2f& a,
+                             const cv::Point2f& b)
+  {
+    const double fx = F(0, 0) * a.x + F(0, 1) * a.y + F(0, 2);
+    const double fy = F(1, 0) * a.x + F(1, 1) * a.y + F(1, 2);
+    const double fz = F(2, 0) * a.x + F(2, 1) * a.y + F(2, 2);
+    const double tx = F(0, 0) * b.x + F(1, 0) * b.y + F(2, 0);
+    const double ty = F(0, 1) * b.x + F(1, 1) * b.y + F(2, 1);
+    const double num = b.x * fx + b.y * fy + fz;
+    const double den = fx * fx + fy * fy + tx * tx + ty * ty;
+    return (den > DBL_EPSILON) ? (num * num / den) : (DBL_MAX);
+  }
+};
+
+/// 4-point minimal solver, squared transfer error from image 1 to image 2
+struct HomographyModel
+{
+  enum
+  {
+    sampleSize = 4,
+    minFitSize = 4,
+    maxModels = 1
+  };
+  static double modelCost() { return 100.0; }
+  static double modelsPerSample() { return 1.0; }
+
+  static int solve(cv::Point2f* a, cv::Point2f* b, cv::Matx33d* models)
+  {
+    cv::Mat H = cv::getPerspectiveTransform(a, b);
+    // collinear samples give singular (or non finite) solutions
+    if (!cv::checkRange(H) || std::fabs(cv::determinant(H)) < 1e-12)
+      return 0;
+    models[0] = cv::Matx33d(H.ptr<double>());
+    return 1;
+  }
+
+  static bool fit(const std::vector<cv::Point2f>& a,
+                  const std::vector<cv::Point2f>& b, cv::Matx33d& M)
+  {
+    cv::Mat H = cv::findHomography(a, b, 0);
+    if (H.rows != 3) return false;
+    M = cv::Matx33d(H.ptr<double>());
+    return true;
+  }
+
+  static inline double error(const cv::Matx33d& H, const cv::Point2f& a,
+                             const cv::Point2f& b)
+  {
+    double w = H(2, 0) * a.x + H(2, 1) * a.y + H(2, 2);
+    if (std::fabs(w) < DBL_EPSILON) return DBL_MAX;
+    w = 1.0 / w;
+    const double dx = (H(0, 0) * a.x + H(0, 1) * a.y + H(0, 2)) * w - b.x;
+    const double dy = (H(1, 0) * a.x + H(1, 1) * a.y + H(1, 2)) * w - b.y;
+    return dx * dx + dy * dy;
+  }
+};
+
+/**
+ * PROSAC sampler (Chum & Matas, 2005): the t-th sample is made of the n-th
+ * best match and m - 1 matches drawn among the n - 1 better ones, n growing
+ * with t so that the first samples are drawn among the most reliable matches.
+ * Once all N matches are used, samples are drawn uniformly as in RANSAC.
+ */
+class ProsacSampler
+{
+ public:
+  ProsacSampler(int N, int m, int maxIterations, cv::RNG& rng)
+      : m_N(N), m_m(m), m_n(m), m_t(0), m_TnPrime(1), m_rng(rng)
+  {
+    // average number of samples drawn from the first n matches in
+    // maxIterations uniform samples
+    m_Tn = maxIterations;
+    for (int i = 0; i < m; ++i) m_Tn *= double(m - i) / double(N - i);
+  }
+
+  void next(int* sample)
+  {
+    ++m_t;
+    if (m_t > m_TnPrime && m_n < m_N)
+    {
+      ++m_n;
+      const double Tn1 = m_Tn * m_n / (m_n - m_m);
+      m_TnPrime += int(std::ceil(Tn1 - m_Tn));
+      m_Tn = Tn1;
+    }
+    int k = 0;
+    int n = m_n;
+    if (m_t <= m_TnPrime)
+    {
+      sample[k++] = m_n - 1;
+      --n;
+    }
+    while (k < m_m)
+    {
+      const int s = m_rng.uniform(0, n);
+      if (std::find(sample, sample + k, s) == sample + k) sample[k++] = s;
+    }
+  }
+
+ private:
+  int m_N;
+  int m_m;
+  int m_n;
+  int m_t;
+  int m_TnPrime;
+  double m_Tn;
+  cv::RNG& m_rng;
+};
+
+/// Wald's sequential probability ratio test (Matas & Chum, 2005)
+struct Sprt
+{
+  double epsilon;  ///< probability for a match to be consistent with a good
+                   /// model, i.e. the inlier ratio
+  double delta;    ///< probability for a match to be consistent with a bad one
+  double A;        ///< decision threshold
+  double inlierStep;
+  double outlierStep;
+
+  Sprt() : epsilon(0), delta(kInitialDelta), A(DBL_MAX)
+  {
+    inlierStep = outlierStep = 1.0;
+  }
+
+  void set(double eps, double del, double modelCost, double modelsPerSample)
+  {
+    epsilon = std::min(eps, 0.99);
+    delta = del;
+    if (epsilon <= delta)
+    {
+      // a bad model cannot be told from a good one: never reject early
+      A = DBL_MAX;
+      inlierStep = outlierStep = 1.0;
+      return;
+    }
+    inlierStep = delta / epsilon;
+    outlierStep = (1.0 - delta) / (1.0 - epsilon);
+    const double C = (1.0 - delta) * std::log(outlierStep) +
+                     delta * std::log(inlierStep);
+    const double K = modelCost * C / modelsPerSample;
+    A = K + 1.0;
+    for (int i = 0; i < 10; ++i) A = K + 1.0 + std::log(A);
+  }
+};
+
+/// best model of a sample, and SPRT statistics of its rejected models
+struct Hypothesis
+{
+  cv::Matx33d M;
+  int inliers;  ///< -1 if no model was accepted
+  int rejected;
+  double rejectedInlierRatio;  ///< sum over the rejected models
+};
+
+int requiredIterations(double inlierRatio, int sampleSize, double confidence)
+{
+  const double p = std::pow(inlierRatio, sampleSize);
+  if (p >= 1.0) return 0;
+  if (p <= DBL_EPSILON) return INT_MAX;
+  const double k = std::log(1.0 - confidence) / std::log(1.0 - p);
+  return (k >= INT_MAX) ? (INT_MAX) : (int(std::ceil(k)));
+}
+
+template <class Model>
+class Estimation
+{
+ public:
+  Estimation(const RobustEstimator& params,
+             const std::vector<cv::Point2f>& pts1,
+             const std::vector<cv::Point2f>& pts2)
+      : m_params(params),
+        m_p1(pts1.data()),
+        m_p2(pts2.data()),
+        m_n(int(pts1.size())),
+        m_thr2(params.threshold * params.threshold),
+        m_rng(0x5eed)
+  {
+    // SPRT assumes matches are verified in random order, not by quality
+    m_order.resize(size_t(m_n));
+    std::iota(m_order.begin(), m_order.end(), 0);
+    cv::randShuffle(m_order, 1.0, &m_rng);
+  }
+
+  /// counts the matches consistent with M. Returns false if the SPRT
+  /// rejected M, after 'tested' matches
+  bool verify(const cv::Matx33d& M, const Sprt& sprt, int& inliers,
+              int& tested) const
+  {
+    double lambda = 1.0;
+    inliers = 0;
+    for (tested = 0; tested < m_n;)
+    {
+      const int i = m_order[size_t(tested++)];
+      if (Model::error(M, m_p1[i], m_p2[i]) < m_thr2)
+      {
+        ++inliers;
+        lambda *= sprt.inlierStep;
+      }
+      else if ((lambda *= sprt.outlierStep) > sprt.A)
+        return false;
+    }
+    return true;
+  }
+
+  int countInliers(const cv::Matx33d& M) const
+  {
+    int inliers, tested;
+    verify(M, Sprt(), inliers, tested);
+    return inliers;
+  }
+
+  /// generates the models of a sample and keeps the best one
+  void evaluate(const int* sample, const Sprt& sprt, Hypothesis& h) const
+  {
+    cv::Point2f a[Model::sampleSize], b[Model::sampleSize];
+    for (int i = 0; i < Model::sampleSize; ++i)
+    {
+      a[i] = m_p1[sample[i]];
+      b[i] = m_p2[sample[i]];
+    }
+    cv::Matx33d models[Model::maxModels];
+    const int nModels = Model::solve(a, b, models);
+
+    h.inliers = -1;
+    h.rejected = 0;
+    h.rejectedInlierRatio = 0.0;
+    for (int j = 0; j < nModels; ++j)
+    {
+      int inliers, tested;
+      if (!verify(models[j], sprt, inliers, tested))
+      {
+        h.rejected++;
+        h.rejectedInlierRatio += double(inliers) / double(tested);
+      }
+      else if (inliers > h.inliers)
+      {
+        h.inliers = inliers;
+        h.M = models[j];
+      }
+    }
+  }
+
+  /// iterated least squares fits on the inliers of M, as long as they
+  /// increase its number of inliers
+  void localOptimization(cv::Matx33d& M, int& inliers) const
+  {
+    std::vector<cv::Point2f> a, b;
+    for (int it = 0; it < kLoIterations; ++it)
+    {
+      a.clear();
+      b.clear();
+      for (int i = 0; i < m_n; ++i)
+        if (Model::error(M, m_p1[i], m_p2[i]) < m_thr2)
+        {
+          a.push_back(m_p1[i]);
+          b.push_back(m_p2[i]);
+        }
+      cv::Matx33d fitted;
+      if (int(a.size()) < Model::minFitSize || !Model::fit(a, b, fitted))
+        return;
+      const int fittedInliers = countInliers(fitted);
+      if (fittedInliers <= inliers) return;
+      M = fitted;
+      inliers = fittedInliers;
+    }
+  }
+
+  bool run(cv::Matx33d& M, std::vector<unsigned char>& mask, int& iterations)
+  {
+    const int m = Model::sampleSize;
+    mask.assign(size_t(m_n), 0);
+    iterations = 0;
+    if (m_n < std::max(int(Model::sampleSize), int(Model::minFitSize)))
+      return false;
+
+    const int batchSize = std::max(1, m_params.batchSize);
+    std::vector<int> samples(size_t(batchSize * m));
+    std::vector<Hypothesis> batch(size_t(batchSize));
+    ProsacSampler sampler(m_n, m, m_params.maxIterations, m_rng);
+
+    Sprt sprt;
+    double rejectedInlierRatio = kInitialDelta;
+    int rejected = 1;
+    int bestInliers = -1;
+    int maxIterations = m_params.maxIterations;
+    while (iterations < maxIterations)
+    {
+      // samples are drawn sequentially to keep PROSAC's ordering, and
+      // verified concurrently
+      const int nHyps = std::min(batchSize, maxIterations - iterations);
+      for (int h = 0; h < nHyps; ++h) sampler.next(&samples[size_t(h * m)]);
+      auto evaluateRange = [&](const cv::Range& range) {
+        for (int h = range.start; h < range.end; ++h)
+          evaluate(&samples[size_t(h * m)], sprt, batch[size_t(h)]);
+      };
+      if (m_params.parallel)
+        utils::parallelFor(cv::Range(0, nHyps), evaluateRange);
+      else
+        evaluateRange(cv::Range(0, nHyps));
+      iterations += nHyps;
+
+      bool improved = false;
+      for (int h = 0; h < nHyps; ++h)
+      {
+        const Hypothesis& hyp = batch[size_t(h)];
+        rejected += hyp.rejected;
+        rejectedInlierRatio += hyp.rejectedInlierRatio;
+        if (hyp.inliers > bestInliers)
+        {
+          M = hyp.M;
+          bestInliers = hyp.inliers;
+          improved = true;
+        }
+      }
+      if (!improved) continue;
+
+      if (m_params.localOptimization) localOptimization(M, bestInliers);
+      const double epsilon = double(bestInliers) / double(m_n);
+      // delta is estimated from the models rejected so far
+      sprt.set(epsilon, rejectedInlierRatio / rejected, Model::modelCost(),
+               Model::modelsPerSample());
+      maxIterations =
+          std::min(m_params.maxIterations,
+                   requiredIterations(epsilon, m, m_params.confidence));
+    }
+    if (bestInliers < m) return false;
+
+    // final least squares fit on all the inliers
+    localOptimization(M, bestInliers);
+    for (int i = 0; i < m_n; ++i)
+      mask[size_t(i)] = (Model::error(M, m_p1[i], m_p2[i]) < m_thr2) ? 1 : 0;
+    return true;
+  }
+
+ private:
+  const RobustEstimator& m_params;
+  const cv::Point2f* m_p1;
+  const cv::Point2f* m_p2;
+  int m_n;
+  double m_thr2;
+  cv::RNG m_rng;
+  std::vector<int> m_order;
+};
+
+}  // namespace
+
+RobustEstimator::RobustEstimator()
+    : model(FUNDAMENTAL),
+      threshold(1.0),
+      confidence(0.999),
+      maxIterations(10000),
+      batchSize(64),
+      parallel(false),
+      localOptimization(true),
+      m_iterations(0)
+{
+}
+
+bool RobustEstimator::estimate(const std::vector<cv::Point2f>& pts1,
+                               const std::vector<cv::Point2f>& pts2,
+                               cv::Matx33d& M,
+                               std::vector<unsigned char>& mask)
+{
+  CV_Assert(pts1.size() == pts2.size());
+  if (model == HOMOGRAPHY)
+    return Estimation<HomographyModel>(*this, pts1, pts2)
+        .run(M, mask, m_iterations);
+  return Estimation<FundamentalModel>(*this, pts1, pts2)
+      .run(M, mask, m_iterations);
+}
+
+}  // namespace features
+}  // namespace sofacv
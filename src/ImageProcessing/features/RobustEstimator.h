@@ -0,0 +1,65 @@
+#ifndef SOFACV_FEATURES_ROBUSTESTIMATOR_H
+#define SOFACV_FEATURES_ROBUSTESTIMATOR_H
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+namespace sofacv
+{
+namespace features
+{
+/**
+ * @brief Robust estimation of the fundamental matrix or homography relating
+ * 2 sets of matched points
+ *
+ * Hypotheses are drawn with PROSAC: progressively from the best ranked
+ * matches first, then uniformly. They are generated and verified in batches,
+ * concurrently if 'parallel' is set, each model being verified with Wald's
+ * SPRT, which stops scoring a model as soon as it is likely to be bad. Every
+ * new best model is refined by local optimization (iterated least squares
+ * fits on its inliers, LO-RANSAC). Sampling stops once a model with
+ * 'confidence' was found, or after maxIterations hypotheses.
+ */
+class RobustEstimator
+{
+ public:
+  enum Model
+  {
+    FUNDAMENTAL = 0,
+    HOMOGRAPHY = 1,
+    Model_COUNT
+  };
+
+  RobustEstimator();
+
+  Model model;
+  double threshold;   ///< max Sampson (F) or transfer (H) error, in pixels
+  double confidence;  ///< probability that the model found is correct
+  int maxIterations;
+  int batchSize;  ///< number of hypotheses generated and verified together
+  bool parallel;
+  bool localOptimization;
+
+  /**
+   * @brief estimates the model relating pts1[i] and pts2[i]
+   *
+   * Matches must be sorted by decreasing quality (e.g. increasing
+   * descriptor distance). mask[i] is set to 1 for inliers, 0 otherwise.
+   * Returns false if not enough matches were given, or no model was found.
+   */
+  bool estimate(const std::vector<cv::Point2f>& pts1,
+                const std::vector<cv::Point2f>& pts2, cv::Matx33d& M,
+                std::vector<unsigned char>& mask);
+
+  /// number of hypotheses drawn by the last call to estimate()
+  int iterations() const { return m_iterations; }
+
+ private:
+  int m_iterations;
+};
+
+}  // namespace features
+}  // namespace sofacv
+
+#endif  // SOFACV_FEATURES_ROBUSTESTIMATOR_H
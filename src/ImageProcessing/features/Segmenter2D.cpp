@@ -1,7 +1,12 @@
 #include "Segmenter2D.h"
+#include "utils/ParallelFor.h"
+#include "utils/ReleaseIfShared.h"
+
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include <algorithm>
+
 namespace sofacv
 {
 namespace features
@@ -27,9 +32,15 @@ Segmenter2D::Segmenter2D()
       d_points(initData(&d_points, "points", "input vector keypoints")),
       d_regionPoly(initData(&d_regionPoly, "poly", "optional input polygon")),
       d_regionPoints(initData(&d_regionPoints, "points_out",
-                              "output vector of points fitting in the poly"))
+                              "output vector of points fitting in the poly")),
+      d_regionMask(initData(&d_regionMask, "mask",
+                            "mask of the polygon (255 inside, 0 outside), "
+                            "the size of the input frame",
+                            false, true)),
+      m_polyCounter(-1)
 {
   addAlias(&d_regionPoly, "poly_out");
+  addAlias(&d_regionMask, "mask_out");
 }
 
 void Segmenter2D::init()
@@ -37,37 +48,84 @@ void Segmenter2D::init()
   addInput(&d_points);
   addInput(&d_regionPoly);
   addOutput(&d_regionPoints);
+  addOutput(&d_regionMask);
   ImageFilter::activateMouseCallback();
   setMouseState(&Segmenter2D::freeMove);
   ImageFilter::init();
 }
 
-void Segmenter2D::doUpdate()
+void Segmenter2D::updateMask(cv::Mat& mask)
 {
-  ImageFilter::doUpdate();
-  if (d_regionPoly.getValue().size() <= 2)
+  const sofa::helper::vector<sofa::defaulttype::Vec2i>& poly =
+      d_regionPoly.getValue();
+  if (poly.size() <= 2)
   {
-    d_regionPoints.setValue(d_points.getValue());
+    mask.release();
+    m_polyCounter = d_regionPoly.getCounter();
     return;
   }
 
-  std::vector<cv::Point2i> polygon;
-  for (const sofa::defaulttype::Vec2i& pt : d_regionPoly.getValue())
+  // without a frame, the mask only needs to cover the polygon
+  cv::Size size = d_img.getValue().size();
+  if (size.area() == 0)
+    for (const sofa::defaulttype::Vec2i& pt : poly)
+    {
+      size.width = std::max(size.width, pt.x() + 1);
+      size.height = std::max(size.height, pt.y() + 1);
+    }
+  if (d_regionPoly.getCounter() == m_polyCounter && mask.size() == size)
+    return;
+
+  m_polygon.resize(1);
+  m_polygon[0].clear();
+  m_polygon[0].reserve(poly.size());
+  for (const sofa::defaulttype::Vec2i& pt : poly)
+    m_polygon[0].push_back(cv::Point2i(pt.x(), pt.y()));
+
+  utils::releaseIfShared(mask);
+  mask.create(size, CV_8UC1);
+  mask.setTo(cv::Scalar::all(0));
+  cv::fillPoly(mask, m_polygon, cv::Scalar(255));
+  m_polyCounter = d_regionPoly.getCounter();
+}
+
+void Segmenter2D::doUpdate()
+{
+  ImageFilter::doUpdate();
+  // the mask is rasterized straight into its output
+  cvMat& mask = *d_regionMask.beginWriteOnly();
+  updateMask(mask);
+  d_regionMask.endEdit();
+  if (mask.empty())
   {
-    polygon.push_back(cv::Point2i(pt.x(), pt.y()));
+    d_regionPoints.setValue(d_points.getValue());
+    return;
   }
-  sofa::helper::vector<sofa::defaulttype::Vec2i>& points =
-      *d_regionPoints.beginWriteOnly();
-  points.clear();
 
   const sofa::helper::vector<sofa::defaulttype::Vec2i>& pts =
       d_points.getValue();
+  m_inside.resize(pts.size());
+  auto classify = [&](const cv::Range& range) {
+    for (int i = range.start; i < range.end; ++i)
+    {
+      const sofa::defaulttype::Vec2i& pt = pts[size_t(i)];
+      m_inside[size_t(i)] = pt.x() >= 0 && pt.y() >= 0 &&
+                            pt.x() < mask.cols && pt.y() < mask.rows &&
+                            mask.at<uchar>(pt.y(), pt.x());
+    }
+  };
+  // lookups are cheap: only large point sets are worth splitting
+  const cv::Range all(0, int(pts.size()));
+  if (pts.size() >= 8192)
+    utils::parallelFor(all, classify);
+  else
+    classify(all);
 
-  for (auto point : pts)
-  {
-    cv::Point2f pt(point.x(), point.y());
-    if (cv::pointPolygonTest(polygon, pt, false) > 0) points.push_back(point);
-  }
+  sofa::helper::vector<sofa::defaulttype::Vec2i>& points =
+      *d_regionPoints.beginWriteOnly();
+  points.clear();
+  for (size_t i = 0; i < pts.size(); ++i)
+    if (m_inside[i]) points.push_back(pts[i]);
   d_regionPoints.endEdit();
 }
 
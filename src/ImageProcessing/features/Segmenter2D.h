@@ -9,6 +9,15 @@ namespace sofacv
 {
 namespace features
 {
+/**
+ * @brief The Segmenter2D class
+ *
+ * Lets the user draw a polygon over the input frame, and outputs the input
+ * points that lie inside it. The polygon is rasterized into a mask the size
+ * of the input frame whenever it changes: points are then classified with a
+ * single lookup each, and the mask can be used as the 'mask' of a
+ * FeatureDetector.
+ */
 class SOFA_IMAGEPROCESSING_API Segmenter2D : public ImageFilter
 {
  public:
@@ -22,6 +31,7 @@ class SOFA_IMAGEPROCESSING_API Segmenter2D : public ImageFilter
   // OUTPUTS
   sofa::Data<sofa::helper::vector<sofa::defaulttype::Vec2i> > d_regionPoly;
   sofa::Data<sofa::helper::vector<sofa::defaulttype::Vec2i> > d_regionPoints;
+  sofa::Data<cvMat> d_regionMask;  ///< [OUTPUT] 8 bit mask of the polygon
 
   Segmenter2D();
 
@@ -46,6 +56,14 @@ class SOFA_IMAGEPROCESSING_API Segmenter2D : public ImageFilter
   void mouseCallback(int event, int x, int y, int flags) override;
 
   std::list<cv::Point2i> m_poly;
+
+ private:
+  /// rasterizes the polygon in 'mask' if it or the frame size changed
+  void updateMask(cv::Mat& mask);
+
+  int m_polyCounter;
+  std::vector<std::vector<cv::Point2i> > m_polygon;
+  std::vector<uchar> m_inside;  ///< per input point classification
 };
 
 SOFA_DECL_CLASS(Segmenter2D)
@@ -0,0 +1,117 @@
+#include "ImagePyramid.h"
+#include "utils/ReleaseIfShared.h"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video.hpp>
+
+namespace sofacv
+{
+namespace imgproc
+{
+ImagePyramid::ImagePyramid()
+    : d_levels(initData(&d_levels, 3, "levels",
+                        "0-based index of the coarsest pyramid level")),
+      d_winSize(initData(&d_winSize, sofa::defaulttype::Vec2i(21, 21),
+                         "win_size",
+                         "border added around each level. Should be at least "
+                         "the window size of the OpticalFlow consuming the "
+                         "pyramid")),
+      d_grayscale(initData(&d_grayscale, true, "grayscale",
+                           "if true, color frames are converted to grayscale "
+                           "before being downsampled")),
+      d_displayLevel(initData(&d_displayLevel, 0, "displayLevel",
+                              "pyramid level copied to the output image")),
+      d_pyramid(initData(&d_pyramid, "pyramid",
+                         "pyramid levels, from full resolution to coarsest",
+                         false, true)),
+      m_rebuilt(false),
+      m_frameData(nullptr),
+      m_frameCounter(-1),
+      m_builtLevels(-1),
+      m_builtGrayscale(false)
+{
+  addAlias(&d_pyramid, "pyramid_out");
+}
+
+void ImagePyramid::init()
+{
+  registerData(&d_levels, 0, 8, 1);
+  registerData(&d_displayLevel, 0, 8, 1);
+
+  addInput(&d_levels);
+  addInput(&d_winSize);
+  addInput(&d_grayscale);
+  addInput(&d_displayLevel);
+  addOutput(&d_pyramid);
+  ImageFilter::init();
+}
+
+bool ImagePyramid::isOutdated(const cv::Mat& in) const
+{
+  return m_levels.empty() || in.data != m_frameData ||
+         d_img.getCounter() != m_frameCounter ||
+         d_levels.getValue() != m_builtLevels ||
+         d_winSize.getValue() != m_builtWinSize ||
+         d_grayscale.getValue() != m_builtGrayscale;
+}
+
+void ImagePyramid::applyFilter(const cv::Mat& in, cv::Mat& out, bool)
+{
+  if (in.empty()) return;
+
+  if (isOutdated(in))
+  {
+    cv::Mat img = in;
+    if (d_grayscale.getValue() && in.channels() != 1)
+      cv::cvtColor(in, img, (in.channels() == 4) ? (cv::COLOR_BGRA2GRAY)
+                                                 : (cv::COLOR_BGR2GRAY));
+    if (img.depth() == CV_32F || img.depth() == CV_64F)
+      img.convertTo(img, CV_8U, 255.0);
+    else if (img.depth() != CV_8U)
+      img.convertTo(img, CV_8U);
+
+    const sofa::defaulttype::Vec2i& w = d_winSize.getValue();
+    cv::Size winSize(std::max(3, w.x()), std::max(3, w.y()));
+    // the levels published on the previous step are dropped from the
+    // output first: they are then only shared with downstream holders
+    d_pyramid.beginWriteOnly()->clear();
+    d_pyramid.endEdit();
+    utils::releaseIfShared(m_levels);
+    cv::buildOpticalFlowPyramid(img, m_levels, winSize,
+                                std::max(0, d_levels.getValue()), false);
+
+    m_frameData = in.data;
+    m_frameCounter = d_img.getCounter();
+    m_builtLevels = d_levels.getValue();
+    m_builtWinSize = w;
+    m_builtGrayscale = d_grayscale.getValue();
+    m_rebuilt = true;
+  }
+
+  int level = std::min(std::max(0, d_displayLevel.getValue()),
+                       int(m_levels.size()) - 1);
+  m_levels[size_t(level)].copyTo(out);
+}
+
+void ImagePyramid::doUpdate()
+{
+  ImageFilter::doUpdate();
+  if (!m_rebuilt) return;
+
+  sofa::helper::vector<cvMat>& pyr = *d_pyramid.beginWriteOnly();
+  pyr.resize(m_levels.size());
+  for (size_t i = 0; i < m_levels.size(); ++i) pyr[i] = m_levels[i];
+  d_pyramid.endEdit();
+  m_rebuilt = false;
+}
+
+SOFA_DECL_CLASS(ImagePyramid)
+
+int ImagePyramidClass =
+    sofa::core::RegisterObject(
+        "Gaussian image pyramid, built once per frame and shared between "
+        "OpticalFlow, TemplateMatcher and FeatureDetector")
+        .add<ImagePyramid>();
+
+}  // namespace imgproc
+}  // namespace sofacv
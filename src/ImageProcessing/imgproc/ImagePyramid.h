@@ -0,0 +1,63 @@
+#ifndef SOFACV_IMGPROC_IMAGEPYRAMID_H
+#define SOFACV_IMGPROC_IMAGEPYRAMID_H
+
+#include <SofaCV/SofaCV.h>
+#include "ImageProcessingPlugin.h"
+
+#include <sofa/defaulttype/Vec.h>
+#include <sofa/helper/vector.h>
+
+namespace sofacv
+{
+namespace imgproc
+{
+/**
+ * @brief The ImagePyramid class
+ *
+ * Builds the Gaussian pyramid of the input frame once, and shares its levels
+ * with the components downsampling that same frame (OpticalFlow,
+ * TemplateMatcher, FeatureDetector). The pyramid is laid out as
+ * cv::buildOpticalFlowPyramid does (8-bit levels padded by winSize), so that
+ * it can be handed over to cv::calcOpticalFlowPyrLK as is.
+ * The cached pyramid is only rebuilt when a new frame comes in (different
+ * buffer or Data counter) or when its parameters change.
+ */
+class SOFA_IMAGEPROCESSING_API ImagePyramid : public ImageFilter
+{
+ public:
+  SOFA_CLASS(ImagePyramid, ImageFilter);
+
+  sofa::Data<int> d_levels;  ///< index of the coarsest level
+  sofa::Data<sofa::defaulttype::Vec2i> d_winSize;  ///< border of each level
+  sofa::Data<bool> d_grayscale;    ///< converts the frame to grayscale first
+  sofa::Data<int> d_displayLevel;  ///< level copied to the output image
+
+  sofa::Data<sofa::helper::vector<cvMat> >
+      d_pyramid;  ///< [OUTPUT] levels, from full resolution to coarsest
+
+  ImagePyramid();
+
+  void init() override;
+  void doUpdate() override;
+
+  void applyFilter(const cv::Mat& in, cv::Mat& out, bool) override;
+
+ private:
+  /// true if the cached pyramid was built from another frame or other
+  /// parameters
+  bool isOutdated(const cv::Mat& in) const;
+
+  std::vector<cv::Mat> m_levels;
+  bool m_rebuilt;
+
+  // cache key
+  const uchar* m_frameData;
+  int m_frameCounter;
+  int m_builtLevels;
+  sofa::defaulttype::Vec2i m_builtWinSize;
+  bool m_builtGrayscale;
+};
+
+}  // namespace imgproc
+}  // namespace sofacv
+#endif  // SOFACV_IMGPROC_IMAGEPYRAMID_H
@@ -8,7 +8,17 @@ TemplateMatcher::TemplateMatcher()
     : d_template(initData(&d_template, "template_img",
                           "template image to search for in the input img.")),
       d_method(initData(&d_method, "method",
-                        "comparison method to use for matching."))
+                        "comparison method to use for matching.")),
+      d_pyramid(initData(&d_pyramid, "pyramid",
+                         "(optional) pyramid of the input image, as built by "
+                         "an ImagePyramid component")),
+      d_level(initData(&d_level, 0, "level",
+                       "pyramid level to match on. The template is "
+                       "downsampled accordingly. 0 matches on the input "
+                       "image")),
+      m_templateData(nullptr),
+      m_templateCounter(-1),
+      m_templateLevel(-1)
 {
   sofa::helper::OptionsGroup *t = d_method.beginEdit();
   t->setNames(6, "SQDIFF", "SQDIFF_NORMED", "CCORR", "CCORR_NORMED", "CCOEFF",
@@ -20,24 +30,64 @@ TemplateMatcher::TemplateMatcher()
 void TemplateMatcher::init()
 {
   addInput(&d_template);
+  addInput(&d_pyramid);
+  addInput(&d_level);
   registerData(&d_method);
+  registerData(&d_level, 0, 8, 1);
   ImageFilter::init();
 }
 
-void TemplateMatcher::applyFilter(const cv::Mat &in, cv::Mat &out, bool)
+const cv::Mat &TemplateMatcher::scaledTemplate(int level)
 {
-  if (in.empty()) return;
+  const cvMat &templ = d_template.getValue();
+  if (templ.data != m_templateData ||
+      d_template.getCounter() != m_templateCounter || level != m_templateLevel)
+  {
+    m_scaledTemplate = templ;
+    for (int l = 0; l < level; ++l)
+    {
+      cv::Mat down;
+      cv::pyrDown(m_scaledTemplate, down);
+      m_scaledTemplate = down;
+    }
+    m_templateData = templ.data;
+    m_templateCounter = d_template.getCounter();
+    m_templateLevel = level;
+  }
+  return m_scaledTemplate;
+}
+
+void TemplateMatcher::applyFilter(const cv::Mat &_in, cv::Mat &out, bool)
+{
+  if (_in.empty()) return;
+
+  // Matches on a level of the shared pyramid rather than on the full
+  // resolution image when requested
+  cv::Mat in = _in;
+  cv::Mat templ = d_template.getValue();
+  const sofa::helper::vector<cvMat> &pyramid = d_pyramid.getValue();
+  int level = std::min(d_level.getValue(), int(pyramid.size()) - 1);
+  if (d_level.getValue() > 0 && pyramid.empty())
+    msg_warning("TemplateMatcher::applyFilter()")
+        << "No pyramid linked: running on the full resolution image instead "
+           "of level "
+        << d_level.getValue();
+  if (level > 0)
+  {
+    in = pyramid[size_t(level)];
+    templ = scaledTemplate(level);
+  }
 
   if (in.type() != CV_8UC1)
     msg_error("TemplateMatcher::applyFilter()")
         << "TemplateMatcher::img must be grayscale";
-  if (d_template.getValue().type() != CV_8UC1)
+  if (templ.type() != CV_8UC1)
     msg_error("TemplateMatcher::applyFilter()")
         << "TemplateMatcher::template_img must be grayscale";
 
   out = in.clone();
 
-  cv::matchTemplate(in, d_template.getValue(), out,
+  cv::matchTemplate(in, templ, out,
                     int(d_method.getValue().getSelectedId()));
 
   /// Localizing the best match with minMaxLoc
@@ -66,8 +116,6 @@ void TemplateMatcher::applyFilter(const cv::Mat &in, cv::Mat &out, bool)
     matchLoc = maxLoc;
   }
 
-  cv::Mat templ = d_template.getValue().clone();
-
   /// Show me what you got
   cv::rectangle(img_display, matchLoc,
                 cv::Point(matchLoc.x + templ.cols, matchLoc.y + templ.rows),
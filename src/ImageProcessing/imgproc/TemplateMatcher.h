@@ -5,6 +5,7 @@
 #include "ImageProcessingPlugin.h"
 
 #include <sofa/helper/OptionsGroup.h>
+#include <sofa/helper/vector.h>
 
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
@@ -20,12 +21,24 @@ class SOFA_IMAGEPROCESSING_API TemplateMatcher : public ImageFilter
 
   sofa::Data<cvMat> d_template;
   sofa::Data<sofa::helper::OptionsGroup> d_method;
+  sofa::Data<sofa::helper::vector<cvMat> > d_pyramid;
+  sofa::Data<int> d_level;
 
   TemplateMatcher();
 
   void init() override;
 
   void applyFilter(const cv::Mat& in, cv::Mat& out, bool) override;
+
+ private:
+  /// template downsampled to the matching level, rebuilt when the template
+  /// or the level changes
+  const cv::Mat& scaledTemplate(int level);
+
+  cv::Mat m_scaledTemplate;
+  const uchar* m_templateData;
+  int m_templateCounter;
+  int m_templateLevel;
 };
 
 }  // namespace imgproc
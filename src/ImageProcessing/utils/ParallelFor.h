@@ -0,0 +1,44 @@
+#ifndef SOFACV_UTILS_PARALLELFOR_H
+#define SOFACV_UTILS_PARALLELFOR_H
+
+#include <opencv2/core/utility.hpp>
+
+namespace sofacv
+{
+namespace utils
+{
+/**
+ * @brief cv::ParallelLoopBody forwarding each sub-range to a callable
+ *
+ * The callable is held by reference and must outlive the parallel loop.
+ */
+template <class Function>
+class ParallelLoopFunctor : public cv::ParallelLoopBody
+{
+ public:
+  ParallelLoopFunctor(const Function& f) : m_f(f) {}
+  void operator()(const cv::Range& range) const override { m_f(range); }
+
+ private:
+  const Function& m_f;
+};
+
+/**
+ * @brief Runs f(subRange) over 'range' on OpenCV's thread pool
+ *
+ * Lets components parallelize a loop with a lambda without declaring a
+ * cv::ParallelLoopBody each time (cv::parallel_for_'s own std::function
+ * overload is only available from OpenCV 3.3 on). Sub-ranges are processed
+ * concurrently, so f must only write to per-index outputs.
+ */
+template <class Function>
+void parallelFor(const cv::Range& range, const Function& f,
+                 double nstripes = -1.0)
+{
+  cv::parallel_for_(range, ParallelLoopFunctor<Function>(f), nstripes);
+}
+
+}  // namespace utils
+}  // namespace sofacv
+
+#endif  // SOFACV_UTILS_PARALLELFOR_H
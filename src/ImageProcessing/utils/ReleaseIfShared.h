@@ -0,0 +1,39 @@
+#ifndef SOFACV_UTILS_RELEASEIFSHARED_H
+#define SOFACV_UTILS_RELEASEIFSHARED_H
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+namespace sofacv
+{
+namespace utils
+{
+/**
+ * @brief Detaches a buffer about to be overwritten if anyone else holds it
+ *
+ * cv::Mat copies share their buffer: refilling a frame in place would modify
+ * it under the feet of whoever kept a copy (e.g. the OpticalFlow tracks
+ * between the previous and current pyramids, and a linked Data holds a copy
+ * until it is updated). Calling this before refilling 'm' releases the
+ * buffer in that case only, so that the next create() allocates a new one,
+ * and reuses it otherwise.
+ *
+ * 'm' must be the only reference its component holds: outputs are written
+ * straight into their Data's value, or the Data's copy is dropped first, as
+ * it would otherwise always count as another holder.
+ */
+inline void releaseIfShared(cv::Mat& m)
+{
+  if (m.u && m.u->refcount > 1) m.release();
+}
+
+inline void releaseIfShared(std::vector<cv::Mat>& mats)
+{
+  for (cv::Mat& m : mats) releaseIfShared(m);
+}
+
+}  // namespace utils
+}  // namespace sofacv
+
+#endif  // SOFACV_UTILS_RELEASEIFSHARED_H